@@ -0,0 +1,123 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <kernel/vmm.h>
+
+#include "acpi.h"
+
+#define BDA_EBDA_SEGMENT 0x40E
+#define EBDA_SEARCH_SIZE 1024
+#define BIOS_AREA_START  0xE0000
+#define BIOS_AREA_END    0x100000
+
+struct acpi_rsdp {
+	char signature[8];
+	uint8_t checksum;
+	char oem_id[6];
+	uint8_t revision;
+	uint32_t rsdt_address;
+	// ACPI 2.0 and later.
+	uint32_t length;
+	uint64_t xsdt_address;
+	uint8_t extended_checksum;
+	uint8_t reserved[3];
+} __attribute__((packed));
+
+#define RSDP_V1_SIZE offsetof(struct acpi_rsdp, length)
+
+// Either the RSDT, with 32-bit entries, or the XSDT, with 64-bit ones.
+static const struct acpi_sdt_header* root;
+static size_t root_entry_size;
+static bool searched;
+
+static bool checksum_ok(const void* data, size_t size) {
+	const uint8_t* bytes = data;
+	uint8_t sum = 0;
+
+	for (size_t i = 0; i < size; i++)
+		sum += bytes[i];
+	return sum == 0;
+}
+
+// Firmware tables usually sit at the top of RAM, which may be past the
+// direct map.
+static const void* acpi_map(uint64_t phys, size_t size) {
+	if (phys + size <= KERNEL_DIRECT_MAP_SIZE)
+		return phys_to_virt((uintptr_t) phys);
+	if (phys + size > UINT32_MAX)
+		return NULL;
+	return vmm_map_mmio((uintptr_t) phys, size, 0);
+}
+
+static const struct acpi_sdt_header* map_table(uint64_t phys) {
+	const struct acpi_sdt_header* header = acpi_map(phys, sizeof(*header));
+	if (!header || header->length < sizeof(*header))
+		return NULL;
+	const struct acpi_sdt_header* table = acpi_map(phys, header->length);
+	if (!table || !checksum_ok(table, table->length))
+		return NULL;
+	return table;
+}
+
+static const struct acpi_rsdp* scan_rsdp(uintptr_t start, uintptr_t end) {
+	// The RSDP sits on a 16-byte boundary.
+	for (uintptr_t p = start; p + sizeof(struct acpi_rsdp) <= end; p += 16) {
+		const struct acpi_rsdp* rsdp = phys_to_virt(p);
+		if (memcmp(rsdp->signature, "RSD PTR ", sizeof(rsdp->signature)) == 0 &&
+		    checksum_ok(rsdp, RSDP_V1_SIZE))
+			return rsdp;
+	}
+	return NULL;
+}
+
+static void find_root(void) {
+	uintptr_t ebda = (uintptr_t) *(const uint16_t*) phys_to_virt(BDA_EBDA_SEGMENT) << 4;
+	const struct acpi_rsdp* rsdp = NULL;
+
+	if (ebda != 0)
+		rsdp = scan_rsdp(ebda, ebda + EBDA_SEARCH_SIZE);
+	if (!rsdp)
+		rsdp = scan_rsdp(BIOS_AREA_START, BIOS_AREA_END);
+	if (!rsdp)
+		return;
+
+	if (rsdp->revision >= 2 && rsdp->xsdt_address != 0 && checksum_ok(rsdp, sizeof(*rsdp))) {
+		root = map_table(rsdp->xsdt_address);
+		root_entry_size = sizeof(uint64_t);
+	}
+	if (!root) {
+		root = map_table(rsdp->rsdt_address);
+		root_entry_size = sizeof(uint32_t);
+	}
+}
+
+const struct acpi_sdt_header* acpi_find_table(const char* signature) {
+	if (!searched) {
+		searched = true;
+		find_root();
+	}
+	if (!root)
+		return NULL;
+
+	const char* entries = (const char*) (root + 1);
+	size_t count = (root->length - sizeof(*root)) / root_entry_size;
+	for (size_t i = 0; i < count; i++) {
+		uint64_t phys;
+		if (root_entry_size == sizeof(uint64_t))
+			memcpy(&phys, entries + i * sizeof(uint64_t), sizeof(phys));
+		else {
+			uint32_t phys32;
+			memcpy(&phys32, entries + i * sizeof(uint32_t), sizeof(phys32));
+			phys = phys32;
+		}
+		const struct acpi_sdt_header* header = acpi_map(phys, sizeof(*header));
+		if (header && memcmp(header->signature, signature, sizeof(header->signature)) == 0) {
+			const struct acpi_sdt_header* table = map_table(phys);
+			if (table)
+				return table;
+		}
+	}
+	return NULL;
+}
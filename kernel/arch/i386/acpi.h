@@ -0,0 +1,24 @@
+#ifndef ARCH_I386_ACPI_H
+#define ARCH_I386_ACPI_H
+
+#include <stdint.h>
+
+// Header common to every ACPI system description table.
+struct acpi_sdt_header {
+	char signature[4];
+	uint32_t length;
+	uint8_t revision;
+	uint8_t checksum;
+	char oem_id[6];
+	char oem_table_id[8];
+	uint32_t oem_revision;
+	uint32_t creator_id;
+	uint32_t creator_revision;
+} __attribute__((packed));
+
+// The first table with the given four character signature whose checksum
+// holds, mapped for good. NULL when the firmware has no ACPI or no such table.
+// Needs the page allocator for tables outside the direct map.
+const struct acpi_sdt_header* acpi_find_table(const char* signature);
+
+#endif
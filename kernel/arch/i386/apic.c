@@ -0,0 +1,308 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <kernel/cpu.h>
+#include <kernel/idt.h>
+#include <kernel/irq.h>
+#include <kernel/pmm.h>
+#include <kernel/smp.h>
+#include <kernel/vmm.h>
+#include <kernel/workqueue.h>
+
+#include "acpi.h"
+#include "apic.h"
+
+#define MSR_APIC_BASE         0x1B
+#define APIC_BASE_X2APIC      (1u << 10)
+#define APIC_BASE_ENABLE      (1u << 11)
+#define APIC_BASE_ADDRESS     0xFFFFF000u
+
+#define LAPIC_SVR_ENABLE      (1u << 8)
+#define LAPIC_DEFAULT_ADDRESS 0xFEE00000u
+
+#define IOAPIC_REGSEL  0x00
+#define IOAPIC_WINDOW  0x10
+#define IOAPIC_VERSION 0x01
+#define IOAPIC_REDIRECTION(n) (0x10 + 2 * (n))
+
+#define IOAPIC_ACTIVE_LOW (1u << 13)
+#define IOAPIC_LEVEL      (1u << 15)
+#define IOAPIC_MASKED     (1u << 16)
+
+#define MAX_IOAPICS 8
+
+#define LAPIC_ICR_PENDING     (1u << 12)
+
+// MADT entry types.
+#define MADT_LAPIC           0
+#define MADT_IOAPIC          1
+#define MADT_SOURCE_OVERRIDE 2
+#define MADT_LAPIC_ADDRESS   5
+
+// Interrupt source override flags. 0 in either field means "as the bus
+// says", which for ISA is active high and edge triggered.
+#define MPS_POLARITY_MASK 0x3
+#define MPS_ACTIVE_LOW    0x3
+#define MPS_TRIGGER_MASK  0xC
+#define MPS_LEVEL         0xC
+
+// Processor flags. Processors without it can at most be hot-added later.
+#define MADT_LAPIC_ENABLED (1u << 0)
+
+struct madt {
+	struct acpi_sdt_header header;
+	uint32_t lapic_address;
+	uint32_t flags;
+	uint8_t entries[];
+} __attribute__((packed));
+
+struct madt_entry {
+	uint8_t type;
+	uint8_t length;
+} __attribute__((packed));
+
+struct madt_lapic {
+	struct madt_entry entry;
+	uint8_t processor_id;
+	uint8_t apic_id;
+	uint32_t flags;
+} __attribute__((packed));
+
+struct madt_ioapic {
+	struct madt_entry entry;
+	uint8_t id;
+	uint8_t reserved;
+	uint32_t address;
+	uint32_t gsi_base;
+} __attribute__((packed));
+
+struct madt_source_override {
+	struct madt_entry entry;
+	uint8_t bus;
+	uint8_t source;
+	uint32_t gsi;
+	uint16_t flags;
+} __attribute__((packed));
+
+struct madt_lapic_address {
+	struct madt_entry entry;
+	uint16_t reserved;
+	uint64_t address;
+} __attribute__((packed));
+
+struct ioapic {
+	volatile uint32_t* regs;
+	uint32_t gsi_base;
+	uint32_t gsi_count;
+};
+
+// Where a legacy IRQ ends up: an IO-APIC pin and the trigger bits for it.
+struct legacy_route {
+	struct ioapic* ioapic;
+	uint32_t pin;
+	uint32_t flags;
+};
+
+volatile uint32_t* lapic;
+
+static uintptr_t lapic_phys;
+static uint8_t processors[MAX_CPUS];
+static size_t processor_count;
+static struct ioapic ioapics[MAX_IOAPICS];
+static size_t ioapic_count;
+static struct legacy_route legacy_routes[IRQ_LEGACY];
+// ESR bits each CPU latched since the last report.
+static uint32_t lapic_errors[MAX_CPUS];
+static struct work lapic_error_work;
+
+static uint32_t ioapic_read(struct ioapic* ioapic, uint32_t reg) {
+	ioapic->regs[IOAPIC_REGSEL / 4] = reg;
+	return ioapic->regs[IOAPIC_WINDOW / 4];
+}
+
+static void ioapic_write(struct ioapic* ioapic, uint32_t reg, uint32_t value) {
+	ioapic->regs[IOAPIC_REGSEL / 4] = reg;
+	ioapic->regs[IOAPIC_WINDOW / 4] = value;
+}
+
+static struct ioapic* ioapic_for(uint32_t gsi) {
+	for (size_t i = 0; i < ioapic_count; i++) {
+		if (gsi >= ioapics[i].gsi_base && gsi - ioapics[i].gsi_base < ioapics[i].gsi_count)
+			return &ioapics[i];
+	}
+	return NULL;
+}
+
+// Registers are uncached: the reads have side effects and the writes must
+// not be merged.
+static volatile uint32_t* map_registers(uintptr_t phys) {
+	return vmm_map_mmio(phys, PAGE_SIZE, VMM_WRITE | VMM_NO_CACHE | VMM_WRITE_THROUGH);
+}
+
+static void add_ioapic(const struct madt_ioapic* entry) {
+	if (ioapic_count == MAX_IOAPICS)
+		return;
+
+	struct ioapic* ioapic = &ioapics[ioapic_count];
+	ioapic->regs = map_registers(entry->address);
+	if (!ioapic->regs)
+		return;
+	ioapic->gsi_base = entry->gsi_base;
+	ioapic->gsi_count = ((ioapic_read(ioapic, IOAPIC_VERSION) >> 16) & 0xFF) + 1;
+	for (uint32_t pin = 0; pin < ioapic->gsi_count; pin++)
+		ioapic_write(ioapic, IOAPIC_REDIRECTION(pin), IOAPIC_MASKED);
+	ioapic_count++;
+}
+
+static void add_processor(const struct madt_lapic* entry) {
+	if (processor_count == MAX_CPUS || !(entry->flags & MADT_LAPIC_ENABLED))
+		return;
+	processors[processor_count++] = entry->apic_id;
+}
+
+static void set_override(const struct madt_source_override* entry) {
+	if (entry->bus != 0 || entry->source >= IRQ_LEGACY)
+		return;
+
+	uint32_t flags = 0;
+	if ((entry->flags & MPS_POLARITY_MASK) == MPS_ACTIVE_LOW)
+		flags |= IOAPIC_ACTIVE_LOW;
+	if ((entry->flags & MPS_TRIGGER_MASK) == MPS_LEVEL)
+		flags |= IOAPIC_LEVEL;
+
+	struct ioapic* ioapic = ioapic_for(entry->gsi);
+	legacy_routes[entry->source].ioapic = ioapic;
+	legacy_routes[entry->source].pin = ioapic ? entry->gsi - ioapic->gsi_base : 0;
+	legacy_routes[entry->source].flags = flags;
+}
+
+static void write_route(unsigned irq, uint32_t masked) {
+	struct legacy_route* route = &legacy_routes[irq];
+	uint32_t reg = IOAPIC_REDIRECTION(route->pin);
+
+	if (!route->ioapic)
+		return;
+	ioapic_write(route->ioapic, reg + 1, (uint32_t) lapic_id() << 24);
+	ioapic_write(route->ioapic, reg, (IRQ_VECTOR_BASE + irq) | route->flags | masked);
+}
+
+void ioapic_mask(unsigned irq) {
+	write_route(irq, IOAPIC_MASKED);
+}
+
+void ioapic_unmask(unsigned irq) {
+	write_route(irq, 0);
+}
+
+static void lapic_spurious(unsigned vector) {
+	// Not a real interrupt: no EOI.
+	(void) vector;
+}
+
+// Reported by a worker: the handler may have interrupted printf itself.
+static void lapic_error_report(void* data) {
+	(void) data;
+	for (unsigned id = 0; id < smp_cpu_count(); id++) {
+		uint32_t esr = __atomic_exchange_n(&lapic_errors[id], 0, __ATOMIC_RELAXED);
+		if (esr != 0)
+			printf("apic: cpu %u error %#x\n", id, esr);
+	}
+}
+
+static void lapic_error(unsigned vector) {
+	(void) vector;
+	// The ESR latches on a write.
+	lapic_write(LAPIC_ESR, 0);
+	__atomic_fetch_or(&lapic_errors[this_cpu()->id], lapic_read(LAPIC_ESR), __ATOMIC_RELAXED);
+	queue_work(&lapic_error_work);
+	lapic_eoi();
+}
+
+void lapic_initialize(void) {
+	uint64_t base = cpu_read_msr(MSR_APIC_BASE);
+
+	cpu_write_msr(MSR_APIC_BASE, (base & ~(uint64_t) APIC_BASE_ADDRESS) | lapic_phys | APIC_BASE_ENABLE);
+	lapic_write(LAPIC_TPR, 0);
+	// The PIC no longer reaches the CPU through LINT0. LINT1 keeps the NMI
+	// setup the firmware gave it.
+	lapic_write(LAPIC_LVT_LINT0, LAPIC_LVT_MASKED);
+	lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+	lapic_write(LAPIC_LVT_ERROR, APIC_ERROR_VECTOR);
+	lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | APIC_SPURIOUS_VECTOR);
+}
+
+void lapic_send_ipi(uint8_t apic_id, uint32_t command) {
+	lapic_write(LAPIC_ICR_HIGH, (uint32_t) apic_id << 24);
+	lapic_write(LAPIC_ICR_LOW, command);
+	while (lapic_read(LAPIC_ICR_LOW) & LAPIC_ICR_PENDING)
+		__asm__ volatile ("pause");
+}
+
+const uint8_t* apic_processors(size_t* count) {
+	*count = processor_count;
+	return processors;
+}
+
+bool apic_initialize(void) {
+	if (!cpu_has_feature(CPU_FEATURE_APIC))
+		return false;
+	// In x2APIC mode the MMIO page is gone; that needs the MSR interface.
+	uint64_t base = cpu_read_msr(MSR_APIC_BASE);
+	if (base & APIC_BASE_X2APIC)
+		return false;
+
+	const struct madt* madt = (const struct madt*) acpi_find_table("APIC");
+	if (!madt)
+		return false;
+
+	// Legacy IRQs are identity mapped to GSIs unless overridden. The
+	// overrides are applied once all IO-APICs are known.
+	const uint8_t* end = (const uint8_t*) madt + madt->header.length;
+	uintptr_t lapic_address = madt->lapic_address ? madt->lapic_address : LAPIC_DEFAULT_ADDRESS;
+	for (const uint8_t* p = madt->entries; p + sizeof(struct madt_entry) <= end; ) {
+		const struct madt_entry* entry = (const struct madt_entry*) p;
+		if (entry->length < sizeof(*entry) || p + entry->length > end)
+			break;
+		if (entry->type == MADT_LAPIC)
+			add_processor((const struct madt_lapic*) entry);
+		else if (entry->type == MADT_IOAPIC)
+			add_ioapic((const struct madt_ioapic*) entry);
+		else if (entry->type == MADT_LAPIC_ADDRESS &&
+		         ((const struct madt_lapic_address*) entry)->address <= UINT32_MAX)
+			lapic_address = (uintptr_t) ((const struct madt_lapic_address*) entry)->address;
+		p += entry->length;
+	}
+	if (ioapic_count == 0)
+		return false;
+
+	lapic = map_registers(lapic_address);
+	if (!lapic)
+		return false;
+	lapic_phys = lapic_address;
+
+	for (unsigned irq = 0; irq < IRQ_LEGACY; irq++) {
+		legacy_routes[irq].ioapic = ioapic_for(irq);
+		legacy_routes[irq].pin = legacy_routes[irq].ioapic ? irq - legacy_routes[irq].ioapic->gsi_base : 0;
+		legacy_routes[irq].flags = 0;
+	}
+	for (const uint8_t* p = madt->entries; p + sizeof(struct madt_entry) <= end; ) {
+		const struct madt_entry* entry = (const struct madt_entry*) p;
+		if (entry->length < sizeof(*entry) || p + entry->length > end)
+			break;
+		if (entry->type == MADT_SOURCE_OVERRIDE)
+			set_override((const struct madt_source_override*) entry);
+		p += entry->length;
+	}
+
+	idt_set_leaf_handler(APIC_SPURIOUS_VECTOR, lapic_spurious);
+	work_init(&lapic_error_work, lapic_error_report, NULL);
+	idt_set_leaf_handler(APIC_ERROR_VECTOR, lapic_error);
+
+	lapic_initialize();
+
+	for (unsigned irq = 0; irq < IRQ_LEGACY; irq++)
+		ioapic_mask(irq);
+	return true;
+}
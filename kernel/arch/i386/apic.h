@@ -0,0 +1,83 @@
+#ifndef ARCH_I386_APIC_H
+#define ARCH_I386_APIC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Local APIC registers, as byte offsets into its MMIO page.
+#define LAPIC_ID            0x020
+#define LAPIC_VERSION       0x030
+#define LAPIC_TPR           0x080
+#define LAPIC_EOI           0x0B0
+#define LAPIC_SVR           0x0F0
+#define LAPIC_ESR           0x280
+#define LAPIC_ICR_LOW       0x300
+#define LAPIC_ICR_HIGH      0x310
+#define LAPIC_LVT_TIMER     0x320
+#define LAPIC_LVT_LINT0     0x350
+#define LAPIC_LVT_LINT1     0x360
+#define LAPIC_LVT_ERROR     0x370
+#define LAPIC_TIMER_INITIAL 0x380
+#define LAPIC_TIMER_CURRENT 0x390
+#define LAPIC_TIMER_DIVIDE  0x3E0
+
+#define LAPIC_LVT_MASKED        (1u << 16)
+#define LAPIC_TIMER_ONESHOT     (0u << 17)
+#define LAPIC_TIMER_TSC_DEADLINE (2u << 17)
+#define LAPIC_TIMER_DIVIDE_1    0xB
+
+// Interrupt command register: delivery mode and level.
+#define LAPIC_ICR_FIXED     (0u << 8)
+#define LAPIC_ICR_INIT      (5u << 8)
+#define LAPIC_ICR_STARTUP   (6u << 8)
+#define LAPIC_ICR_ASSERT    (1u << 14)
+#define LAPIC_ICR_LEVEL     (1u << 15)
+
+// Vectors owned by the local APIC. The spurious vector's low four bits must
+// be set on older APICs.
+#define APIC_TIMER_VECTOR    0xF0
+#define APIC_CALL_VECTOR     0xF1
+#define APIC_ERROR_VECTOR    0xFE
+#define APIC_SPURIOUS_VECTOR 0xFF
+
+// Find the local APIC, the IO-APICs and the processors in the ACPI MADT,
+// enable the local APIC and route the 16 legacy IRQs through the IO-APICs,
+// masked, to IRQ_VECTOR_BASE + irq. Returns false, touching nothing, when
+// the CPU or the firmware lacks either APIC, in which case the PIC stays in
+// charge.
+bool apic_initialize(void);
+
+// Enable the running CPU's local APIC with apic_initialize's setup. Other
+// CPUs call it when they start.
+void lapic_initialize(void);
+
+// Send an interprocessor interrupt and wait until the APIC has taken it.
+void lapic_send_ipi(uint8_t apic_id, uint32_t command);
+
+// Local APIC ids of the usable processors in the MADT, the boot CPU's among
+// them, at most MAX_CPUS.
+const uint8_t* apic_processors(size_t* count);
+
+void ioapic_mask(unsigned irq);
+void ioapic_unmask(unsigned irq);
+
+extern volatile uint32_t* lapic;
+
+static inline uint32_t lapic_read(unsigned reg) {
+	return lapic[reg / 4];
+}
+
+static inline void lapic_write(unsigned reg, uint32_t value) {
+	lapic[reg / 4] = value;
+}
+
+static inline uint8_t lapic_id(void) {
+	return (uint8_t) (lapic_read(LAPIC_ID) >> 24);
+}
+
+static inline void lapic_eoi(void) {
+	lapic_write(LAPIC_EOI, 0);
+}
+
+#endif
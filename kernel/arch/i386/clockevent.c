@@ -0,0 +1,167 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <kernel/clockevent.h>
+#include <kernel/cpu.h>
+#include <kernel/idt.h>
+#include <kernel/irq.h>
+#include <kernel/ktime.h>
+
+#include "apic.h"
+#include "pit.h"
+
+#define MSR_TSC_DEADLINE 0x6E0
+
+#define PIT_IRQ 0
+
+// 10 ms of PIT ticks to measure the other clocks against.
+#define CALIBRATION_TICKS (PIT_HZ / 100)
+
+// Longer delays are cut to this, which keeps the scaling within 64 bits.
+#define MAX_DELTA_NS (UINT64_C(1) << 32)
+
+enum clockevent_mode {
+	MODE_TSC_DEADLINE,
+	MODE_LAPIC,
+	MODE_PIT,
+};
+
+static enum clockevent_mode mode;
+static void (*event_handler)(void);
+static volatile bool armed;
+
+static uint64_t tsc_hz;
+static struct clock_scale tsc_scale;
+static struct clock_scale lapic_scale;
+static struct clock_scale pit_scale;
+
+static const char* const mode_names[] = {
+	[MODE_TSC_DEADLINE] = "tsc-deadline",
+	[MODE_LAPIC] = "lapic",
+	[MODE_PIT] = "pit",
+};
+
+static void clockevent_fire(void) {
+	if (!armed)
+		return;
+	armed = false;
+	if (event_handler)
+		event_handler();
+}
+
+static void lapic_timer_interrupt(unsigned vector) {
+	(void) vector;
+	lapic_eoi();
+	clockevent_fire();
+}
+
+static void pit_interrupt(unsigned vector) {
+	(void) vector;
+	irq_eoi(PIT_IRQ);
+	clockevent_fire();
+}
+
+// Count TSC and local APIC timer ticks over CALIBRATION_TICKS of the PIT.
+static void calibrate(bool with_lapic, uint64_t* lapic_hz) {
+	if (with_lapic) {
+		lapic_write(LAPIC_TIMER_DIVIDE, LAPIC_TIMER_DIVIDE_1);
+		lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED | LAPIC_TIMER_ONESHOT);
+	}
+
+	pit_wait_begin(CALIBRATION_TICKS);
+	uint64_t tsc_start = cpu_timestamp();
+	if (with_lapic)
+		lapic_write(LAPIC_TIMER_INITIAL, UINT32_MAX);
+	pit_wait_end();
+	uint64_t tsc_end = cpu_timestamp();
+	uint32_t lapic_left = with_lapic ? lapic_read(LAPIC_TIMER_CURRENT) : 0;
+
+	tsc_hz = (tsc_end - tsc_start) * PIT_HZ / CALIBRATION_TICKS;
+	if (with_lapic) {
+		lapic_write(LAPIC_TIMER_INITIAL, 0);
+		*lapic_hz = (uint64_t) (UINT32_MAX - lapic_left) * PIT_HZ / CALIBRATION_TICKS;
+	}
+}
+
+void clockevent_initialize(void (*handler)(void)) {
+	uint64_t lapic_hz = 0;
+	bool apic = irq_uses_apic();
+
+	event_handler = handler;
+	armed = false;
+	calibrate(apic, &lapic_hz);
+	tsc_scale = clock_scale(NSEC_PER_SEC, tsc_hz);
+
+	if (apic && cpu_has_feature(CPU_FEATURE_TSC_DEADLINE) && tsc_hz != 0) {
+		mode = MODE_TSC_DEADLINE;
+		lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_TSC_DEADLINE | APIC_TIMER_VECTOR);
+		// The mode switch has to be visible before the first deadline
+		// write, which is not ordered against MMIO on its own.
+		__asm__ volatile ("mfence" : : : "memory");
+	} else if (apic && lapic_hz != 0) {
+		mode = MODE_LAPIC;
+		lapic_scale = clock_scale(NSEC_PER_SEC, lapic_hz);
+		lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_ONESHOT | APIC_TIMER_VECTOR);
+	} else {
+		mode = MODE_PIT;
+		pit_scale = clock_scale(NSEC_PER_SEC, PIT_HZ);
+		// The firmware leaves channel 0 periodic; one long shot stops that.
+		pit_oneshot(0);
+	}
+
+	if (mode == MODE_PIT) {
+		idt_set_leaf_handler(IRQ_VECTOR_BASE + PIT_IRQ, pit_interrupt);
+		irq_unmask(PIT_IRQ);
+	} else {
+		idt_set_leaf_handler(APIC_TIMER_VECTOR, lapic_timer_interrupt);
+	}
+}
+
+void clockevent_program(uint64_t delta_ns) {
+	uint64_t ticks;
+
+	if (delta_ns > MAX_DELTA_NS)
+		delta_ns = MAX_DELTA_NS;
+	armed = true;
+
+	switch (mode) {
+	case MODE_TSC_DEADLINE:
+		// A deadline already in the past fires at once.
+		cpu_write_msr(MSR_TSC_DEADLINE, cpu_timestamp() + clock_scale_apply(delta_ns, tsc_scale));
+		break;
+	case MODE_LAPIC:
+		// An initial count of 0 stops the timer instead.
+		ticks = clock_scale_apply(delta_ns, lapic_scale);
+		lapic_write(LAPIC_TIMER_INITIAL, ticks == 0 ? 1 : ticks > UINT32_MAX ? UINT32_MAX : (uint32_t) ticks);
+		break;
+	case MODE_PIT:
+		// A count of 0 means 65536, the longest wait there is.
+		ticks = clock_scale_apply(delta_ns, pit_scale);
+		pit_oneshot(ticks == 0 ? 1 : ticks >= 0x10000 ? 0 : (uint16_t) ticks);
+		break;
+	}
+}
+
+void clockevent_cancel(void) {
+	armed = false;
+	switch (mode) {
+	case MODE_TSC_DEADLINE:
+		cpu_write_msr(MSR_TSC_DEADLINE, 0);
+		break;
+	case MODE_LAPIC:
+		lapic_write(LAPIC_TIMER_INITIAL, 0);
+		break;
+	case MODE_PIT:
+		// Channel 0 cannot be stopped; its interrupt is ignored.
+		break;
+	}
+}
+
+const char* clockevent_name(void) {
+	return mode_names[mode];
+}
+
+uint64_t clockevent_tsc_hz(void) {
+	return tsc_hz;
+}
@@ -0,0 +1,109 @@
+#include <cpuid.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <kernel/cpu.h>
+
+#define CPUID_EDX_FPU  (1u << 0)
+#define CPUID_EDX_TSC  (1u << 4)
+#define CPUID_EDX_APIC (1u << 9)
+#define CPUID_EDX_PGE  (1u << 13)
+#define CPUID_EDX_PAT  (1u << 16)
+#define CPUID_EDX_SSE  (1u << 25)
+#define CPUID_EDX_SSE2 (1u << 26)
+#define CPUID_ECX_TSC_DEADLINE (1u << 24)
+#define CPUID_ECX_XSAVE (1u << 26)
+#define CPUID_EAX_XSAVEOPT (1u << 0)      // leaf 0xD, subleaf 1
+#define CPUID_EDX_INVARIANT_TSC (1u << 8) // leaf 0x80000007
+
+#define CR4_OSFXSR (1u << 9)
+
+static uint32_t cpu_features;
+static size_t cpu_l2_size;
+
+static inline uint32_t read_cr4(void) {
+	uint32_t cr4;
+	__asm__ volatile ("movl %%cr4, %0" : "=r"(cr4));
+	return cr4;
+}
+
+void cpu_initialize(void) {
+	uint32_t eax, ebx, ecx, edx;
+
+	cpu_features = 0;
+	cpu_l2_size = 0;
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return;
+
+	if (edx & CPUID_EDX_FPU)
+		cpu_features |= CPU_FEATURE_FPU;
+	if (edx & CPUID_EDX_TSC)
+		cpu_features |= CPU_FEATURE_TSC;
+	if (edx & CPUID_EDX_PGE)
+		cpu_features |= CPU_FEATURE_PGE;
+	if (edx & CPUID_EDX_PAT)
+		cpu_features |= CPU_FEATURE_PAT;
+	if (edx & CPUID_EDX_APIC)
+		cpu_features |= CPU_FEATURE_APIC;
+	if (ecx & CPUID_ECX_TSC_DEADLINE)
+		cpu_features |= CPU_FEATURE_TSC_DEADLINE;
+
+	// boot.S only sets CR4.OSFXSR when the CPU has SSE, so SSE code is
+	// usable exactly when the bit is set.
+	if (read_cr4() & CR4_OSFXSR) {
+		if (edx & CPUID_EDX_SSE)
+			cpu_features |= CPU_FEATURE_SSE;
+		if (edx & CPUID_EDX_SSE2)
+			cpu_features |= CPU_FEATURE_SSE2;
+		// XSAVE is only used in place of FXSAVE, so it needs the same setup.
+		if (ecx & CPUID_ECX_XSAVE) {
+			cpu_features |= CPU_FEATURE_XSAVE;
+			if (__get_cpuid_count(0xD, 1, &eax, &ebx, &ecx, &edx) && (eax & CPUID_EAX_XSAVEOPT))
+				cpu_features |= CPU_FEATURE_XSAVEOPT;
+		}
+	}
+
+	// L2 size in KiB is in ECX[31:16] of the extended cache leaf.
+	if (__get_cpuid(0x80000006, &eax, &ebx, &ecx, &edx))
+		cpu_l2_size = (size_t) (ecx >> 16) * 1024;
+
+	// An invariant TSC ticks at the same rate in every P-, C- and T-state.
+	if (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) && (edx & CPUID_EDX_INVARIANT_TSC))
+		cpu_features |= CPU_FEATURE_INVARIANT_TSC;
+
+	if (cpu_features & CPU_FEATURE_SSE2) {
+		__string_enable_sse2(cpu_l2_size);
+		__math_enable_sse2();
+	}
+}
+
+bool cpu_has_feature(enum cpu_feature feature) {
+	return (cpu_features & feature) == (uint32_t) feature;
+}
+
+size_t cpu_l2_cache_size(void) {
+	return cpu_l2_size;
+}
+
+uint64_t cpu_timestamp(void) {
+	uint32_t lo, hi;
+
+	if (!(cpu_features & CPU_FEATURE_TSC))
+		return 0;
+	__asm__ volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+	return (uint64_t) hi << 32 | lo;
+}
+
+uint64_t cpu_read_msr(uint32_t msr) {
+	uint32_t lo, hi;
+
+	__asm__ volatile ("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+	return (uint64_t) hi << 32 | lo;
+}
+
+void cpu_write_msr(uint32_t msr, uint64_t value) {
+	__asm__ volatile ("wrmsr" : : "c"(msr), "a"((uint32_t) value), "d"((uint32_t) (value >> 32)) : "memory");
+}
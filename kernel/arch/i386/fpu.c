@@ -0,0 +1,228 @@
+#include <cpuid.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <kernel/cpu.h>
+#include <kernel/fpu.h>
+#include <kernel/idt.h>
+#include <kernel/sched.h>
+#include <kernel/smp.h>
+
+/*
+ * Lazy FPU switching. The x87 and SSE registers belong to one thread at a
+ * time, fpu_owner, and stay in the CPU across switches to threads that do
+ * not touch them. Switching to anyone else sets CR0.TS, so their first FPU
+ * or SSE instruction raises #NM; the handler saves the registers to the
+ * owner's area, loads the current thread's and makes it the owner.
+ *
+ * Every thread has a save area from its creation on, filled with the
+ * initial state, so the trap never allocates and never has to tell a
+ * thread's first use from a later one.
+ */
+
+#define EXCEPTION_DEVICE_NOT_AVAILABLE 7
+
+#define CR0_TS (1u << 3)
+#define CR4_OSXSAVE (1u << 18)
+
+#define XCR0_X87 (1u << 0)
+#define XCR0_SSE (1u << 1)
+
+#define MXCSR_DEFAULT 0x1F80 // all exceptions masked, round to nearest
+
+#define FNSAVE_SIZE 108
+#define FXSAVE_SIZE 512
+
+enum fpu_method {
+	FPU_NONE,
+	FPU_FNSAVE,
+	FPU_FXSAVE,
+	FPU_XSAVE,
+	FPU_XSAVEOPT,
+};
+
+static enum fpu_method fpu_method;
+static size_t fpu_size;
+static struct kmem_cache* fpu_cache;
+static void* fpu_init_state;
+static struct thread* fpu_owner;
+// Mirrors CR0.TS, so a switch between threads that both leave the FPU
+// alone does not write CR0.
+static bool fpu_ts;
+
+static inline uint32_t read_cr0(void) {
+	uint32_t cr0;
+	__asm__ volatile ("movl %%cr0, %0" : "=r"(cr0));
+	return cr0;
+}
+
+static inline void write_cr0(uint32_t cr0) {
+	__asm__ volatile ("movl %0, %%cr0" : : "r"(cr0) : "memory");
+}
+
+static void fpu_save(void* area) {
+	switch (fpu_method) {
+	case FPU_NONE:
+		break;
+	case FPU_FNSAVE:
+		__asm__ volatile ("fnsave (%0)" : : "r"(area) : "memory");
+		break;
+	case FPU_FXSAVE:
+		__asm__ volatile ("fxsave (%0)" : : "r"(area) : "memory");
+		break;
+	case FPU_XSAVE:
+		__asm__ volatile ("xsave (%0)" : : "r"(area), "a"(XCR0_X87 | XCR0_SSE), "d"(0) : "memory");
+		break;
+	case FPU_XSAVEOPT:
+		__asm__ volatile ("xsaveopt (%0)" : : "r"(area), "a"(XCR0_X87 | XCR0_SSE), "d"(0) : "memory");
+		break;
+	}
+}
+
+static void fpu_restore(const void* area) {
+	switch (fpu_method) {
+	case FPU_NONE:
+		break;
+	case FPU_FNSAVE:
+		__asm__ volatile ("frstor (%0)" : : "r"(area) : "memory");
+		break;
+	case FPU_FXSAVE:
+		__asm__ volatile ("fxrstor (%0)" : : "r"(area) : "memory");
+		break;
+	case FPU_XSAVE:
+	case FPU_XSAVEOPT:
+		__asm__ volatile ("xrstor (%0)" : : "r"(area), "a"(XCR0_X87 | XCR0_SSE), "d"(0) : "memory");
+		break;
+	}
+}
+
+static void fpu_trap(unsigned vector) {
+	struct thread* thread = thread_current();
+
+	(void) vector;
+	// The #NM itself counts once. Any more and it came from a handler, and
+	// the registers would go to a thread that did not use them.
+	if (this_cpu()->irq_nesting > 1) {
+		printf("kernel: FPU or SSE used in an interrupt handler\n");
+		abort();
+	}
+	__asm__ volatile ("clts" : : : "memory");
+	fpu_ts = false;
+	if (fpu_owner == thread)
+		return;
+	if (fpu_owner)
+		fpu_save(fpu_owner->fpu_state);
+	fpu_restore(thread->fpu_state);
+	fpu_owner = thread;
+}
+
+// Pick the fastest way to save the registers and return the size of its
+// save area.
+static size_t fpu_choose_method(void) {
+	if (!cpu_has_feature(CPU_FEATURE_FPU)) {
+		fpu_method = FPU_NONE;
+		return 0;
+	}
+	if (!cpu_has_feature(CPU_FEATURE_SSE)) {
+		fpu_method = FPU_FNSAVE;
+		return FNSAVE_SIZE;
+	}
+	if (!cpu_has_feature(CPU_FEATURE_XSAVE)) {
+		fpu_method = FPU_FXSAVE;
+		return FXSAVE_SIZE;
+	}
+
+	// Only the x87 and SSE state is enabled; the kernel uses nothing newer.
+	uint32_t cr4, eax, ebx, ecx, edx;
+	__asm__ volatile ("movl %%cr4, %0" : "=r"(cr4));
+	__asm__ volatile ("movl %0, %%cr4" : : "r"(cr4 | CR4_OSXSAVE));
+	__asm__ volatile ("xsetbv" : : "c"(0), "a"(XCR0_X87 | XCR0_SSE), "d"(0));
+	fpu_method = FPU_XSAVE;
+	// EBX is the area size for the features enabled in XCR0.
+	__cpuid_count(0xD, 0, eax, ebx, ecx, edx);
+	return ebx;
+}
+
+bool fpu_initialize(struct thread* boot) {
+	size_t size = fpu_choose_method();
+
+	boot->fpu_state = NULL;
+	if (fpu_method == FPU_NONE)
+		return true;
+
+	fpu_size = size;
+	// XSAVE wants 64 byte alignment, FXSAVE 16.
+	fpu_cache = kmem_cache_create("fpu", size, 64, NULL);
+	if (!fpu_cache)
+		return false;
+	fpu_init_state = kmem_cache_alloc(fpu_cache);
+	boot->fpu_state = kmem_cache_alloc(fpu_cache);
+	if (!fpu_init_state || !boot->fpu_state)
+		return false;
+	// XRSTOR faults on a header with stray bits.
+	memset(fpu_init_state, 0, size);
+	memset(boot->fpu_state, 0, size);
+
+	// Capture the initial state without losing the boot thread's. Nothing
+	// between the save and the restore may touch the FPU or SSE.
+	fpu_save(boot->fpu_state);
+	__asm__ volatile ("fninit");
+	if (cpu_has_feature(CPU_FEATURE_SSE)) {
+		uint32_t mxcsr = MXCSR_DEFAULT;
+		__asm__ volatile ("ldmxcsr %0" : : "m"(mxcsr));
+		__asm__ volatile ("xorps %%xmm0, %%xmm0\n\t"
+		                  "xorps %%xmm1, %%xmm1\n\t"
+		                  "xorps %%xmm2, %%xmm2\n\t"
+		                  "xorps %%xmm3, %%xmm3\n\t"
+		                  "xorps %%xmm4, %%xmm4\n\t"
+		                  "xorps %%xmm5, %%xmm5\n\t"
+		                  "xorps %%xmm6, %%xmm6\n\t"
+		                  "xorps %%xmm7, %%xmm7" : : : "memory");
+	}
+	fpu_save(fpu_init_state);
+	fpu_restore(boot->fpu_state);
+
+	// XSAVEOPT skips what it knows to be unchanged since the last XRSTOR
+	// from the same area, so only areas that went through XRSTOR may be
+	// saved with it. Every area is filled by XSAVE above or copied from
+	// one that was.
+	if (fpu_method == FPU_XSAVE && FPU_USE_XSAVEOPT && cpu_has_feature(CPU_FEATURE_XSAVEOPT))
+		fpu_method = FPU_XSAVEOPT;
+
+	fpu_owner = boot;
+	fpu_ts = (read_cr0() & CR0_TS) != 0;
+	idt_set_leaf_handler(EXCEPTION_DEVICE_NOT_AVAILABLE, fpu_trap);
+	return true;
+}
+
+bool fpu_thread_init(struct thread* thread) {
+	thread->fpu_state = NULL;
+	if (fpu_method == FPU_NONE)
+		return true;
+	thread->fpu_state = kmem_cache_alloc(fpu_cache);
+	if (!thread->fpu_state)
+		return false;
+	memcpy(thread->fpu_state, fpu_init_state, fpu_size);
+	return true;
+}
+
+void fpu_thread_free(struct thread* thread) {
+	if (fpu_owner == thread)
+		fpu_owner = NULL;
+	if (thread->fpu_state)
+		kmem_cache_free(fpu_cache, thread->fpu_state);
+	thread->fpu_state = NULL;
+}
+
+void fpu_switch(struct thread* next) {
+	bool ts = next != fpu_owner;
+
+	if (fpu_method == FPU_NONE || ts == fpu_ts)
+		return;
+	write_cr0(ts ? read_cr0() | CR0_TS : read_cr0() & ~CR0_TS);
+	fpu_ts = ts;
+}
@@ -0,0 +1,58 @@
+#include <stdint.h>
+
+#include <kernel/smp.h>
+
+#include "gdt.h"
+
+#define GDT_ENTRIES (GDT_PERCPU(0) / 8 + MAX_CPUS)
+
+// Access byte: present, ring 0, code/data, and the segment type.
+#define GDT_ACCESS_CODE 0x9A // execute/read
+#define GDT_ACCESS_DATA 0x92 // read/write
+// Flags nibble: 32-bit, with 4 KiB or byte granularity.
+#define GDT_FLAGS_FLAT 0xC
+#define GDT_FLAGS_BYTE 0x4
+
+struct gdt_pointer {
+	uint16_t limit;
+	uint32_t base;
+} __attribute__((packed));
+
+static uint64_t gdt[GDT_ENTRIES];
+
+static uint64_t gdt_entry(uint32_t base, uint32_t limit, uint8_t access, uint8_t flags) {
+	return (uint64_t) (limit & 0xFFFF)
+		| (uint64_t) (base & 0xFFFFFF) << 16
+		| (uint64_t) access << 40
+		| (uint64_t) ((limit >> 16) & 0xF) << 48
+		| (uint64_t) (flags & 0xF) << 52
+		| (uint64_t) (base >> 24) << 56;
+}
+
+void gdt_initialize(void) {
+	gdt[0] = 0;
+	gdt[GDT_KERNEL_CODE / 8] = gdt_entry(0, 0xFFFFF, GDT_ACCESS_CODE, GDT_FLAGS_FLAT);
+	gdt[GDT_KERNEL_DATA / 8] = gdt_entry(0, 0xFFFFF, GDT_ACCESS_DATA, GDT_FLAGS_FLAT);
+	gdt_set_cpu(0, smp_cpu(0));
+	gdt_load(0);
+}
+
+void gdt_set_cpu(unsigned id, struct cpu* cpu) {
+	gdt[GDT_PERCPU(id) / 8] = gdt_entry((uint32_t) cpu, sizeof(*cpu) - 1, GDT_ACCESS_DATA, GDT_FLAGS_BYTE);
+}
+
+void gdt_load(unsigned id) {
+	struct gdt_pointer pointer = { sizeof(gdt) - 1, (uint32_t) gdt };
+
+	// A far jump reloads CS; the data segment registers are loaded by hand.
+	__asm__ volatile (
+		"lgdt %0\n\t"
+		"ljmp %1, $1f\n"
+		"1:\n\t"
+		"movw %w2, %%ds\n\t"
+		"movw %w2, %%es\n\t"
+		"movw %w2, %%fs\n\t"
+		"movw %w3, %%gs\n\t"
+		"movw %w2, %%ss"
+		: : "m"(pointer), "i"(GDT_KERNEL_CODE), "r"(GDT_KERNEL_DATA), "r"(GDT_PERCPU(id)) : "memory");
+}
@@ -0,0 +1,20 @@
+#ifndef ARCH_I386_GDT_H
+#define ARCH_I386_GDT_H
+
+struct cpu;
+
+// Segment selectors of the flat kernel segments.
+#define GDT_KERNEL_CODE 0x08
+#define GDT_KERNEL_DATA 0x10
+// CPU id's %gs segment, which covers just its struct cpu.
+#define GDT_PERCPU(id) (0x18 + 8 * (id))
+
+// Load the kernel's own GDT on the boot CPU, with %gs on smp_cpu(0). The
+// loader's one may be anywhere, or gone.
+void gdt_initialize(void);
+
+// Add the per-CPU segment of CPU id, then load the GDT on that CPU.
+void gdt_set_cpu(unsigned id, struct cpu* cpu);
+void gdt_load(unsigned id);
+
+#endif
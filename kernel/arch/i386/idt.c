@@ -0,0 +1,161 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <kernel/cpu.h>
+#include <kernel/idt.h>
+#include <kernel/irq.h>
+
+#include "gdt.h"
+#include "pic.h"
+
+// Keep in step with isr.S.
+#define ISR_STUB_SIZE 16
+
+#define IDT_INTERRUPT_GATE 0x8E // present, ring 0, 32-bit interrupt gate
+
+#define EXCEPTIONS 32
+#define EXCEPTION_PAGE_FAULT 14
+
+struct idt_gate {
+	uint16_t offset_low;
+	uint16_t selector;
+	uint8_t zero;
+	uint8_t type;
+	uint16_t offset_high;
+} __attribute__((packed));
+
+struct idt_pointer {
+	uint16_t limit;
+	uint32_t base;
+} __attribute__((packed));
+
+union idt_handler {
+	interrupt_handler full;
+	interrupt_leaf_handler leaf;
+};
+
+extern char isr_stubs[];
+
+// Read by isr_common.
+union idt_handler idt_handlers[IDT_VECTORS];
+uint8_t idt_leaf[IDT_VECTORS];
+
+static struct idt_gate idt[IDT_VECTORS];
+
+static const char* const exception_names[EXCEPTIONS] = {
+	"divide error", "debug", "NMI", "breakpoint",
+	"overflow", "bound range exceeded", "invalid opcode", "device not available",
+	"double fault", "coprocessor segment overrun", "invalid TSS", "segment not present",
+	"stack fault", "general protection", "page fault", "reserved",
+	"x87 floating point", "alignment check", "machine check", "SIMD floating point",
+	"virtualization", "control protection", "reserved", "reserved",
+	"reserved", "reserved", "reserved", "reserved",
+	"hypervisor injection", "VMM communication", "security", "reserved",
+};
+
+static inline uint32_t read_cr2(void) {
+	uint32_t cr2;
+	__asm__ volatile ("movl %%cr2, %0" : "=r"(cr2));
+	return cr2;
+}
+
+static void exception_handler(struct interrupt_frame* frame) {
+	printf("kernel: exception %u (%s), error code %#x\n",
+	       frame->vector, exception_names[frame->vector], frame->error);
+	if (frame->vector == EXCEPTION_PAGE_FAULT)
+		printf("cr2=%08x\n", read_cr2());
+	printf("eax=%08x ebx=%08x ecx=%08x edx=%08x\n", frame->eax, frame->ebx, frame->ecx, frame->edx);
+	// Without a privilege change the CPU did not push esp; it pointed just
+	// past the frame.
+	printf("esi=%08x edi=%08x ebp=%08x esp=%08x\n", frame->esi, frame->edi, frame->ebp,
+	       (uint32_t) (frame + 1));
+	printf("eip=%08x cs=%04x eflags=%08x\n", frame->eip, frame->cs, frame->eflags);
+	abort();
+}
+
+static void unexpected_interrupt(unsigned vector) {
+	printf("kernel: unexpected interrupt %u\n", vector);
+}
+
+static void idt_set_gate(uint8_t vector, uintptr_t entry) {
+	idt[vector] = (struct idt_gate) {
+		.offset_low = (uint16_t) entry,
+		.selector = GDT_KERNEL_CODE,
+		.zero = 0,
+		.type = IDT_INTERRUPT_GATE,
+		.offset_high = (uint16_t) (entry >> 16),
+	};
+}
+
+// The handler and its kind change together, so no interrupt can see one
+// without the other.
+static void idt_install(uint8_t vector, union idt_handler handler, bool leaf) {
+	uint32_t eflags = irq_save();
+	idt_handlers[vector] = handler;
+	idt_leaf[vector] = leaf;
+	irq_restore(eflags);
+}
+
+void idt_set_handler(uint8_t vector, interrupt_handler handler) {
+	idt_install(vector, (union idt_handler) { .full = handler }, false);
+}
+
+void idt_set_leaf_handler(uint8_t vector, interrupt_leaf_handler handler) {
+	idt_install(vector, (union idt_handler) { .leaf = handler }, true);
+}
+
+void idt_initialize(void) {
+	gdt_initialize();
+
+	for (unsigned vector = 0; vector < IDT_VECTORS; vector++) {
+		idt_set_gate((uint8_t) vector, (uintptr_t) isr_stubs + vector * ISR_STUB_SIZE);
+		if (vector < EXCEPTIONS)
+			idt_set_handler((uint8_t) vector, exception_handler);
+		else
+			idt_set_leaf_handler((uint8_t) vector, unexpected_interrupt);
+	}
+	idt_load();
+
+	pic_initialize();
+}
+
+void idt_load(void) {
+	struct idt_pointer pointer = { sizeof(idt) - 1, (uint32_t) idt };
+
+	__asm__ volatile ("lidt %0" : : "m"(pointer));
+}
+
+#if KERNEL_SELFTEST
+// Free in the kernel's vector map.
+#define SELFTEST_VECTOR 0xE0
+#define SELFTEST_ROUNDS 10000
+
+static void selftest_leaf(unsigned vector) {
+	(void) vector;
+}
+
+static void selftest_full(struct interrupt_frame* frame) {
+	(void) frame;
+}
+
+// Cycles per int $SELFTEST_VECTOR through the stub into an empty handler
+// and back out through iret.
+static uint64_t time_round_trips(void) {
+	uint64_t start = cpu_timestamp();
+	for (unsigned i = 0; i < SELFTEST_ROUNDS; i++)
+		__asm__ volatile ("int %0" : : "i"(SELFTEST_VECTOR) : "memory");
+	return (cpu_timestamp() - start) / SELFTEST_ROUNDS;
+}
+
+void idt_selftest(void) {
+	idt_set_leaf_handler(SELFTEST_VECTOR, selftest_leaf);
+	uint64_t leaf = time_round_trips();
+	idt_set_handler(SELFTEST_VECTOR, selftest_full);
+	uint64_t full = time_round_trips();
+	idt_set_leaf_handler(SELFTEST_VECTOR, unexpected_interrupt);
+
+	printf("idt: int round trip %llu cycles to a leaf handler, %llu to a full handler\n", leaf, full);
+}
+#endif
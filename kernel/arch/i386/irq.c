@@ -0,0 +1,44 @@
+#include <stdbool.h>
+
+#include <kernel/idt.h>
+#include <kernel/irq.h>
+
+#include "apic.h"
+#include "pic.h"
+
+static bool use_apic;
+
+static void irq_unhandled(unsigned vector) {
+	irq_eoi(vector - IRQ_VECTOR_BASE);
+}
+
+void irq_initialize(void) {
+	for (unsigned irq = 0; irq < IRQ_LEGACY; irq++)
+		idt_set_leaf_handler(IRQ_VECTOR_BASE + irq, irq_unhandled);
+	use_apic = apic_initialize();
+}
+
+bool irq_uses_apic(void) {
+	return use_apic;
+}
+
+void irq_mask(unsigned irq) {
+	if (use_apic)
+		ioapic_mask(irq);
+	else
+		pic_mask(irq);
+}
+
+void irq_unmask(unsigned irq) {
+	if (use_apic)
+		ioapic_unmask(irq);
+	else
+		pic_unmask(irq);
+}
+
+void irq_eoi(unsigned irq) {
+	if (use_apic)
+		lapic_eoi();
+	else
+		pic_eoi(irq);
+}
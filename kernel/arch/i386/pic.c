@@ -0,0 +1,76 @@
+#include <stdint.h>
+
+#include "io.h"
+#include "pic.h"
+
+#define PIC1_COMMAND 0x20
+#define PIC1_DATA    0x21
+#define PIC2_COMMAND 0xA0
+#define PIC2_DATA    0xA1
+
+#define ICW1_ICW4  0x01 // ICW4 follows
+#define ICW1_INIT  0x10
+#define ICW4_8086  0x01
+#define OCW2_SPECIFIC_EOI 0x60
+
+#define PIC_CASCADE_IRQ 2
+
+// Last masks written, so masking a line costs one port write and no read.
+static uint16_t pic_masks;
+
+// Port 0x80 is unused; writing it gives the PICs time between commands.
+static inline void io_wait(void) {
+	outb(0x80, 0);
+}
+
+static void pic_write_masks(void) {
+	outb(PIC1_DATA, (uint8_t) pic_masks);
+	outb(PIC2_DATA, (uint8_t) (pic_masks >> 8));
+}
+
+void pic_mask(unsigned irq) {
+	pic_masks |= (uint16_t) (1u << irq);
+	if (irq < 8)
+		outb(PIC1_DATA, (uint8_t) pic_masks);
+	else
+		outb(PIC2_DATA, (uint8_t) (pic_masks >> 8));
+}
+
+void pic_unmask(unsigned irq) {
+	pic_masks &= (uint16_t) ~(1u << irq);
+	if (irq < 8)
+		outb(PIC1_DATA, (uint8_t) pic_masks);
+	else
+		outb(PIC2_DATA, (uint8_t) (pic_masks >> 8));
+}
+
+void pic_eoi(unsigned irq) {
+	if (irq >= 8) {
+		outb(PIC2_COMMAND, OCW2_SPECIFIC_EOI | (irq & 7));
+		outb(PIC1_COMMAND, OCW2_SPECIFIC_EOI | PIC_CASCADE_IRQ);
+	} else {
+		outb(PIC1_COMMAND, OCW2_SPECIFIC_EOI | irq);
+	}
+}
+
+void pic_initialize(void) {
+	outb(PIC1_COMMAND, ICW1_INIT | ICW1_ICW4);
+	io_wait();
+	outb(PIC2_COMMAND, ICW1_INIT | ICW1_ICW4);
+	io_wait();
+	outb(PIC1_DATA, IRQ_VECTOR_BASE);
+	io_wait();
+	outb(PIC2_DATA, IRQ_VECTOR_BASE + 8);
+	io_wait();
+	outb(PIC1_DATA, 1u << PIC_CASCADE_IRQ);
+	io_wait();
+	outb(PIC2_DATA, PIC_CASCADE_IRQ);
+	io_wait();
+	outb(PIC1_DATA, ICW4_8086);
+	io_wait();
+	outb(PIC2_DATA, ICW4_8086);
+	io_wait();
+
+	pic_masks = (uint16_t) ~(1u << PIC_CASCADE_IRQ);
+	pic_write_masks();
+}
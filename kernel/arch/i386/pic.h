@@ -0,0 +1,17 @@
+#ifndef ARCH_I386_PIC_H
+#define ARCH_I386_PIC_H
+
+#include <kernel/irq.h>
+
+// Remap both PICs to IRQ_VECTOR_BASE, clear of the 32 CPU exceptions, and
+// mask every line.
+void pic_initialize(void);
+void pic_mask(unsigned irq);
+void pic_unmask(unsigned irq);
+
+// Specific end of interrupt for irq. Unlike a non-specific EOI it cannot
+// retire some other in-service IRQ, so it is also safe for a spurious IRQ 7
+// or 15.
+void pic_eoi(unsigned irq);
+
+#endif
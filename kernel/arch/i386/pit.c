@@ -0,0 +1,38 @@
+#include <stdint.h>
+
+#include "io.h"
+#include "pit.h"
+
+#define PIT_CHANNEL0 0x40
+#define PIT_CHANNEL2 0x42
+#define PIT_COMMAND  0x43
+#define PIT_GATE     0x61 // port B of the old keyboard controller
+
+// Command byte: channel, lobyte/hibyte access, mode 0 (interrupt on terminal
+// count), binary.
+#define PIT_CMD_CHANNEL0_ONESHOT 0x30
+#define PIT_CMD_CHANNEL2_ONESHOT 0xB0
+
+#define GATE_CHANNEL2 0x01
+#define GATE_SPEAKER  0x02
+#define GATE_OUT2     0x20
+
+void pit_wait_begin(uint16_t ticks) {
+	// Gate channel 2 on with the speaker off. Mode 0 starts counting as
+	// soon as the count is written, and OUT stays low until it runs out.
+	outb(PIT_GATE, (inb(PIT_GATE) & ~GATE_SPEAKER) | GATE_CHANNEL2);
+	outb(PIT_COMMAND, PIT_CMD_CHANNEL2_ONESHOT);
+	outb(PIT_CHANNEL2, (uint8_t) ticks);
+	outb(PIT_CHANNEL2, (uint8_t) (ticks >> 8));
+}
+
+void pit_wait_end(void) {
+	while (!(inb(PIT_GATE) & GATE_OUT2))
+		;
+}
+
+void pit_oneshot(uint16_t ticks) {
+	outb(PIT_COMMAND, PIT_CMD_CHANNEL0_ONESHOT);
+	outb(PIT_CHANNEL0, (uint8_t) ticks);
+	outb(PIT_CHANNEL0, (uint8_t) (ticks >> 8));
+}
@@ -0,0 +1,16 @@
+#ifndef ARCH_I386_PIT_H
+#define ARCH_I386_PIT_H
+
+#include <stdint.h>
+
+#define PIT_HZ 1193182
+
+// A busy wait of ticks on channel 2, which raises no interrupt. Calibration
+// samples the clock it measures right after each call.
+void pit_wait_begin(uint16_t ticks);
+void pit_wait_end(void);
+
+// Raise IRQ 0 once, after ticks. A count of 0 means 65536.
+void pit_oneshot(uint16_t ticks);
+
+#endif
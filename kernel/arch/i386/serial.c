@@ -0,0 +1,77 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <kernel/console.h>
+#include <kernel/serial.h>
+
+#include "io.h"
+
+#define COM1 0x3F8
+
+// 16550 registers, as offsets from the base port.
+#define UART_DATA 0     // Transmit/receive buffer, divisor low with DLAB
+#define UART_IER  1     // Interrupt enable, divisor high with DLAB
+#define UART_FCR  2     // FIFO control
+#define UART_LCR  3     // Line control
+#define UART_MCR  4     // Modem control
+#define UART_LSR  5     // Line status
+
+#define LCR_8N1   0x03
+#define LCR_DLAB  0x80
+#define FCR_ENABLE_CLEAR_14 0xC7
+#define MCR_DTR_RTS_OUT2 0x0B
+#define MCR_LOOPBACK 0x1E
+#define MCR_NORMAL 0x0F
+#define LSR_THRE  0x20  // Transmit holding register (and FIFO) empty
+
+#define UART_FIFO_SIZE 16
+
+static void serial_write(const char* data, size_t size) {
+	size_t i = 0;
+
+	while (i < size) {
+		// An empty holding register means the whole FIFO is free, so one
+		// status poll buys up to UART_FIFO_SIZE bytes.
+		while (!(inb(COM1 + UART_LSR) & LSR_THRE))
+			;
+		for (size_t room = UART_FIFO_SIZE; room != 0 && i < size; room--) {
+			char c = data[i];
+			if (c == '\n') {
+				// Terminals want CR LF; the LF goes out with the next
+				// batch if the CR took the last slot.
+				if (room < 2)
+					break;
+				outb(COM1 + UART_DATA, '\r');
+				room--;
+			}
+			outb(COM1 + UART_DATA, (uint8_t) c);
+			i++;
+		}
+	}
+}
+
+static struct console_sink serial_sink = {
+	.name = "com1",
+	.write = serial_write,
+};
+
+bool serial_initialize(void) {
+	outb(COM1 + UART_IER, 0x00);
+	outb(COM1 + UART_LCR, LCR_DLAB);
+	outb(COM1 + UART_DATA, 0x01);   // Divisor 1: 115200 baud
+	outb(COM1 + UART_IER, 0x00);
+	outb(COM1 + UART_LCR, LCR_8N1);
+	outb(COM1 + UART_FCR, FCR_ENABLE_CLEAR_14);
+	outb(COM1 + UART_MCR, MCR_DTR_RTS_OUT2);
+
+	// Check that something echoes a byte back in loopback mode.
+	outb(COM1 + UART_MCR, MCR_LOOPBACK);
+	outb(COM1 + UART_DATA, 0xAE);
+	if (inb(COM1 + UART_DATA) != 0xAE)
+		return false;
+
+	outb(COM1 + UART_MCR, MCR_NORMAL);
+	console_register(&serial_sink);
+	return true;
+}
@@ -0,0 +1,262 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <kernel/idt.h>
+#include <kernel/irq.h>
+#include <kernel/ktime.h>
+#include <kernel/pmm.h>
+#include <kernel/smp.h>
+#include <kernel/sync.h>
+#include <kernel/vmm.h>
+
+#include "apic.h"
+#include "gdt.h"
+#include "pit.h"
+
+/*
+ * Application processors are started one at a time with Intel's sequence:
+ * an INIT IPI, 10 ms, then two startup IPIs 200 us apart pointing at the
+ * trampoline in low memory. The trampoline has the processor in the higher
+ * half on its own stack within a few instructions; ap_main then sets it up
+ * like the boot CPU and reports it online.
+ *
+ * The scheduler stays on the boot CPU. The others sleep in hlt until
+ * smp_call hands them a function and wakes them with an IPI.
+ */
+
+// Keep in step with trampoline.S. The first MiB is never handed out by the
+// page allocator, and this part of it is free conventional memory.
+#define TRAMPOLINE_PHYS 0x8000
+
+#define AP_STACK_ORDER 2 // 16 KiB
+#define PDE_IDENTITY_4M 0x83 // present, writable, 4 MiB page
+
+#define INIT_DELAY_US 10000
+#define STARTUP_DELAY_US 200
+#define ONLINE_TIMEOUT_MS 100
+
+// Laid out as trampoline.S reads it.
+struct trampoline_args {
+	uint32_t cr3;
+	uint32_t esp;
+	uint32_t entry;
+	struct cpu* cpu;
+};
+
+extern char trampoline_start[];
+extern char trampoline_end[];
+extern struct trampoline_args trampoline_args;
+
+// From boot.S.
+extern uint32_t boot_page_directory[1024];
+extern void enable_fpu(void);
+
+_Static_assert(offsetof(struct cpu, need_resched) == 4, "isr_common reads need_resched at %gs:4");
+_Static_assert(offsetof(struct cpu, irq_nesting) == 5, "isr_common counts irq_nesting at %gs:5");
+
+static struct cpu cpus[MAX_CPUS] = {
+	[0] = { .self = &cpus[0], .online = true },
+};
+static unsigned cpu_count = 1;
+
+static inline void write_cr3(uint32_t cr3) {
+	__asm__ volatile ("movl %0, %%cr3" : : "r"(cr3) : "memory");
+}
+
+// At most 65535 PIT ticks, about 55 ms.
+static void delay_us(unsigned us) {
+	pit_wait_begin((uint16_t) ((uint64_t) us * PIT_HZ / 1000000 + 1));
+	pit_wait_end();
+}
+
+static void call_interrupt(unsigned vector) {
+	// Only there to end a hlt.
+	(void) vector;
+	lapic_eoi();
+}
+
+__attribute__((__noreturn__))
+static void ap_main(struct cpu* cpu) {
+	// The trampoline's page directory is freed once every CPU is up.
+	write_cr3(virt_to_phys(boot_page_directory));
+	enable_fpu();
+	gdt_load(cpu->id);
+	idt_load();
+	vmm_initialize();
+	lapic_initialize();
+	// Before going online, so the boot CPU's summary comes after it.
+	printf("smp: cpu %u up, APIC id %u\n", cpu->id, cpu->apic_id);
+	cpu->online = true;
+
+	for (;;) {
+		// The call is checked with interrupts off; an IPI for one that
+		// comes after the check stays pending and ends the hlt.
+		irq_disable();
+		while (!cpu->call)
+			__asm__ volatile ("sti; hlt; cli" : : : "memory");
+		void (*func)(void* arg) = cpu->call;
+		void* arg = cpu->call_arg;
+		cpu->call = NULL;
+		irq_enable();
+		func(arg);
+	}
+}
+
+// Returns false when the processor did not come up. Whatever it might
+// still use, should it turn up late, is left allocated.
+static bool start_cpu(uint8_t apic_id, struct trampoline_args* args, uintptr_t directory) {
+	struct cpu* cpu = &cpus[cpu_count];
+	uintptr_t stack = pmm_alloc(AP_STACK_ORDER);
+	if (!stack)
+		return false;
+
+	*cpu = (struct cpu) {
+		.self = cpu,
+		.id = cpu_count,
+		.apic_id = apic_id,
+		.stack = phys_to_virt(stack),
+	};
+	gdt_set_cpu(cpu->id, cpu);
+	args->cr3 = directory;
+	args->esp = (uint32_t) cpu->stack + (PAGE_SIZE << AP_STACK_ORDER);
+	args->entry = (uint32_t) ap_main;
+	args->cpu = cpu;
+
+	lapic_write(LAPIC_ESR, 0);
+	lapic_send_ipi(apic_id, LAPIC_ICR_INIT | LAPIC_ICR_ASSERT | LAPIC_ICR_LEVEL);
+	delay_us(INIT_DELAY_US);
+	for (int i = 0; i < 2 && !cpu->online; i++) {
+		lapic_send_ipi(apic_id, LAPIC_ICR_STARTUP | (TRAMPOLINE_PHYS >> PAGE_SHIFT));
+		delay_us(STARTUP_DELAY_US);
+	}
+	for (unsigned ms = 0; !cpu->online && ms < ONLINE_TIMEOUT_MS; ms++)
+		delay_us(1000);
+	if (!cpu->online)
+		return false;
+	cpu_count++;
+	return true;
+}
+
+void smp_initialize(void) {
+	if (!irq_uses_apic())
+		return;
+	cpus[0].apic_id = lapic_id();
+	idt_set_leaf_handler(APIC_CALL_VECTOR, call_interrupt);
+
+	size_t count;
+	const uint8_t* ids = apic_processors(&count);
+	if (count <= 1)
+		return;
+
+	// The kernel's mappings plus an identity map of the trampoline, to
+	// turn paging on from it.
+	uintptr_t directory = pmm_alloc(0);
+	if (!directory)
+		return;
+	uint32_t* pd = phys_to_virt(directory);
+	memcpy(pd, boot_page_directory, PAGE_SIZE);
+	pd[0] = PDE_IDENTITY_4M;
+
+	char* trampoline = phys_to_virt(TRAMPOLINE_PHYS);
+	memcpy(trampoline, trampoline_start, (size_t) (trampoline_end - trampoline_start));
+	struct trampoline_args* args =
+		(struct trampoline_args*) (trampoline + ((char*) &trampoline_args - trampoline_start));
+
+	for (size_t i = 0; i < count && cpu_count < MAX_CPUS; i++) {
+		if (ids[i] != cpus[0].apic_id && !start_cpu(ids[i], args, directory))
+			return;
+	}
+	pmm_free(directory, 0);
+}
+
+unsigned smp_cpu_count(void) {
+	return cpu_count;
+}
+
+struct cpu* smp_cpu(unsigned id) {
+	return &cpus[id];
+}
+
+void smp_kick(unsigned id) {
+	uint32_t eflags = irq_save();
+	lapic_send_ipi(cpus[id].apic_id, LAPIC_ICR_FIXED | APIC_CALL_VECTOR);
+	irq_restore(eflags);
+}
+
+bool smp_call(unsigned id, void (*func)(void* arg), void* arg) {
+	if (id == 0 || id >= cpu_count)
+		return false;
+
+	struct cpu* cpu = &cpus[id];
+	uint32_t eflags = irq_save();
+	bool idle = !cpu->call;
+	if (idle) {
+		cpu->call_arg = arg;
+		cpu->call = func;
+		smp_kick(id);
+	}
+	irq_restore(eflags);
+	return idle;
+}
+
+#if KERNEL_SELFTEST
+// Each CPU sums its share of 0 to SELFTEST_TERMS - 1; the shares have to
+// add up.
+#define SELFTEST_TERMS (UINT64_C(1) << 22)
+#define SELFTEST_TIMEOUT_NS UINT64_C(1000000000)
+
+struct selftest_share {
+	uint64_t first;
+	uint64_t end;
+	uint64_t sum;
+	volatile bool done;
+};
+
+static struct selftest_share selftest_shares[MAX_CPUS];
+
+static void selftest_share_run(void* arg) {
+	struct selftest_share* share = arg;
+	uint64_t sum = 0;
+
+	for (uint64_t i = share->first; i < share->end; i++)
+		sum += i;
+	share->sum = sum;
+	__atomic_store_n(&share->done, true, __ATOMIC_RELEASE);
+}
+
+void smp_selftest(void) {
+	uint64_t total = 0;
+
+	for (unsigned id = 0; id < cpu_count; id++) {
+		selftest_shares[id].first = SELFTEST_TERMS * id / cpu_count;
+		selftest_shares[id].end = SELFTEST_TERMS * (id + 1) / cpu_count;
+		if (id != 0 && !smp_call(id, selftest_share_run, &selftest_shares[id])) {
+			printf("smp: cpu %u would not take a call\n", id);
+			abort();
+		}
+	}
+	selftest_share_run(&selftest_shares[0]);
+
+	uint64_t deadline = ktime_get_ns() + SELFTEST_TIMEOUT_NS;
+	for (unsigned id = 0; id < cpu_count; id++) {
+		while (!__atomic_load_n(&selftest_shares[id].done, __ATOMIC_ACQUIRE)) {
+			if (ktime_get_ns() > deadline) {
+				printf("smp: cpu %u did not finish its call\n", id);
+				abort();
+			}
+			cpu_relax();
+		}
+		total += selftest_shares[id].sum;
+	}
+	if (total != SELFTEST_TERMS * (SELFTEST_TERMS - 1) / 2) {
+		printf("smp: %u CPUs summed to %llu, expected %llu\n", cpu_count, total,
+		       SELFTEST_TERMS * (SELFTEST_TERMS - 1) / 2);
+		abort();
+	}
+	printf("smp: %u CPUs ran their share of a sum\n", cpu_count);
+}
+#endif
@@ -1,32 +1,125 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <string.h>
 
+#include <kernel/console.h>
+#include <kernel/cpu.h>
 #include <kernel/tty.h>
+#include <kernel/vmm.h>
 
 #include "vga.h"
 
-static const size_t VGA_WIDTH = 80;
-static const size_t VGA_HEIGHT = 25;
-static uint16_t* const VGA_MEMORY = (uint16_t*) 0xB8000;
+#define VGA_WIDTH 80
+#define VGA_HEIGHT 25
+#define VGA_MEMORY_PHYS 0xB8000
+#define VGA_MEMORY ((uint16_t*) phys_to_virt(VGA_MEMORY_PHYS))
+
+// Rows of output kept, including the ones on screen.
+#ifndef TERMINAL_HISTORY
+#define TERMINAL_HISTORY 1000
+#endif
+
+#if TERMINAL_HISTORY <= VGA_HEIGHT
+#error "TERMINAL_HISTORY must be larger than the screen"
+#endif
+
+/*
+ * All drawing goes to a ring of TERMINAL_HISTORY rows in RAM; VGA memory is
+ * only ever written, by terminal_flush, and never read back. The live screen
+ * is the VGA_HEIGHT rows starting at terminal_first, so scrolling advances
+ * terminal_first and blanks one row, whatever the depth of the history.
+ *
+ * The display shows the live screen moved terminal_view rows back into the
+ * history. terminal_dirty has one bit per display row that differs from what
+ * VGA currently shows.
+ */
+static uint16_t terminal_history[TERMINAL_HISTORY * VGA_WIDTH];
+static size_t terminal_first;
+static size_t terminal_lines;
+static size_t terminal_view;
+static uint32_t terminal_dirty;
 
 static size_t terminal_row;
 static size_t terminal_column;
 static uint8_t terminal_color;
 static uint16_t* terminal_buffer;
 
+#define ALL_ROWS_DIRTY ((UINT32_C(1) << VGA_HEIGHT) - 1)
+
+// Ring row holding live screen row y. y may be negative down to
+// -(TERMINAL_HISTORY - VGA_HEIGHT), for rows that scrolled off.
+static inline uint16_t* history_row(long y) {
+	long row = (long) terminal_first + y;
+	if (row < 0)
+		row += TERMINAL_HISTORY;
+	else if (row >= TERMINAL_HISTORY)
+		row -= TERMINAL_HISTORY;
+	return &terminal_history[row * VGA_WIDTH];
+}
+
+static void clear_row(uint16_t* row) {
+	const uint16_t blank = vga_entry(' ', terminal_color);
+	for (size_t x = 0; x < VGA_WIDTH; x++)
+		row[x] = blank;
+}
+
+static struct console_sink terminal_sink = {
+	.name = "vga",
+	.write = terminal_write,
+	.flush = terminal_flush,
+};
+
 void terminal_initialize(void) {
 	terminal_row = 0;
 	terminal_column = 0;
 	terminal_color = vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK);
 	terminal_buffer = VGA_MEMORY;
-	for (size_t y = 0; y < VGA_HEIGHT; y++) {
-		for (size_t x = 0; x < VGA_WIDTH; x++) {
-			const size_t index = y * VGA_WIDTH + x;
-			terminal_buffer[index] = vga_entry(' ', terminal_color);
-		}
+	terminal_first = 0;
+	terminal_lines = VGA_HEIGHT;
+	terminal_view = 0;
+	for (size_t y = 0; y < VGA_HEIGHT; y++)
+		clear_row(history_row(y));
+	terminal_dirty = ALL_ROWS_DIRTY;
+	terminal_flush();
+	console_register(&terminal_sink);
+}
+
+#if KERNEL_SELFTEST
+#define SELFTEST_REDRAWS 64
+
+// Cycles per redraw of the whole screen through terminal_buffer.
+static uint64_t time_redraws(void) {
+	uint64_t start = cpu_timestamp();
+	for (unsigned i = 0; i < SELFTEST_REDRAWS; i++) {
+		terminal_dirty = ALL_ROWS_DIRTY;
+		terminal_flush();
 	}
+	return (cpu_timestamp() - start) / SELFTEST_REDRAWS;
+}
+#endif
+
+void terminal_enable_write_combining(void) {
+#if KERNEL_SELFTEST
+	// Through the direct map while it is still the only mapping.
+	uint64_t uncached = time_redraws();
+#endif
+	// The direct map reaches VGA memory as uncached, by the MTRRs. A
+	// write-combining alias lets a flush go out as a few bursts instead of
+	// one bus cycle per character. VGA memory is never read, and never
+	// written through the old mapping after this.
+	uint16_t* buffer = vmm_map_mmio(VGA_MEMORY_PHYS, VGA_WIDTH * VGA_HEIGHT * sizeof(uint16_t),
+	                                VMM_WRITE | VMM_WRITE_COMBINING);
+	if (buffer)
+		terminal_buffer = buffer;
+#if KERNEL_SELFTEST
+	if (buffer)
+		printf("tty: full-screen redraw %llu cycles uncached, %llu write-combining\n", uncached,
+		       time_redraws());
+	else
+		printf("tty: no write-combining mapping; redraw %llu cycles uncached\n", uncached);
+#endif
 }
 
 void terminal_setcolor(uint8_t color) {
@@ -34,37 +127,69 @@ void terminal_setcolor(uint8_t color) {
 }
 
 void terminal_putentryat(unsigned char c, uint8_t color, size_t x, size_t y) {
-	const size_t index = y * VGA_WIDTH + x;
-	terminal_buffer[index] = vga_entry(c, color);
+	history_row(y)[x] = vga_entry(c, color);
+	if (y + terminal_view < VGA_HEIGHT)
+		terminal_dirty |= UINT32_C(1) << (y + terminal_view);
 }
 
 void scroll_terminal(void) {
-    for (int y = 1; y < VGA_HEIGHT; y++) {
-        for (int x = 0; x < VGA_WIDTH; x++) {
-            terminal_buffer[(y - 1) * VGA_WIDTH + x] = terminal_buffer[y * VGA_WIDTH + x];
-        }
-    }
-    for (int x = 0; x < VGA_WIDTH; x++) {
-        terminal_buffer[(VGA_HEIGHT - 1) * VGA_WIDTH + x] = ' ';
-    }
+	// Reuse the oldest row of the ring as the new bottom row.
+	clear_row(history_row(VGA_HEIGHT));
+	if (++terminal_first == TERMINAL_HISTORY)
+		terminal_first = 0;
+	if (terminal_lines < TERMINAL_HISTORY)
+		terminal_lines++;
+
+	// Keep a scrolled-back view on the same rows, as long as they are kept.
+	if (terminal_view != 0 && terminal_view < terminal_lines - VGA_HEIGHT)
+		terminal_view++;
+	else
+		terminal_dirty = ALL_ROWS_DIRTY;
+}
+
+void terminal_view_scroll(long rows) {
+	long view = (long) terminal_view + rows;
+	long max = (long) (terminal_lines - VGA_HEIGHT);
+
+	if (view < 0)
+		view = 0;
+	else if (view > max)
+		view = max;
+	if ((size_t) view != terminal_view) {
+		terminal_view = (size_t) view;
+		terminal_dirty = ALL_ROWS_DIRTY;
+	}
+}
+
+void terminal_view_page_up(void) {
+	terminal_view_scroll(VGA_HEIGHT - 1);
+}
+
+void terminal_view_page_down(void) {
+	terminal_view_scroll(-(VGA_HEIGHT - 1));
+}
+
+void terminal_view_reset(void) {
+	terminal_view_scroll(-(long) terminal_view);
+}
+
+static void terminal_newline(void) {
+	terminal_column = 0;
+	if (++terminal_row == VGA_HEIGHT) {
+		scroll_terminal();
+		terminal_row--;
+	}
 }
 
 void terminal_putchar(char c)
 {
     if (c == '\n') {
-        terminal_column = 0;
-        terminal_row++;
-    }
-    if (terminal_row >= VGA_HEIGHT){
-        scroll_terminal();
-        terminal_row--;
+        terminal_newline();
+        return;
     }
     terminal_putentryat(c, terminal_color, terminal_column, terminal_row);
-    if (++terminal_column == VGA_WIDTH) {
-        terminal_column = 0;
-        if (++terminal_row == VGA_HEIGHT)
-            terminal_row = 0;
-    }
+    if (++terminal_column == VGA_WIDTH)
+        terminal_newline();
 }
 
 void terminal_write(const char* data, size_t size) {
@@ -75,3 +200,32 @@ void terminal_write(const char* data, size_t size) {
 void terminal_writestring(const char* data) {
 	terminal_write(data, strlen(data));
 }
+
+void terminal_flush(void) {
+	size_t y = 0;
+
+	if (terminal_dirty == 0)
+		return;
+	while (terminal_dirty != 0) {
+		// Find the next run of dirty rows.
+		while (!(terminal_dirty & (UINT32_C(1) << y)))
+			y++;
+		size_t end = y;
+		while (end < VGA_HEIGHT && (terminal_dirty & (UINT32_C(1) << end)))
+			end++;
+		terminal_dirty &= ~(((UINT32_C(1) << (end - y)) - 1) << y);
+
+		// Copy it in at most two pieces, split where the history ring wraps.
+		while (y < end) {
+			const uint16_t* src = history_row((long) y - (long) terminal_view);
+			size_t rows = (size_t) (&terminal_history[TERMINAL_HISTORY * VGA_WIDTH] - src) / VGA_WIDTH;
+			if (rows > end - y)
+				rows = end - y;
+			memcpy(&terminal_buffer[y * VGA_WIDTH], src, rows * VGA_WIDTH * sizeof(uint16_t));
+			y += rows;
+		}
+	}
+	// A locked instruction drains the write-combining buffers, so the rows
+	// reach the screen now rather than whenever the buffers are evicted.
+	__asm__ volatile ("lock; orl $0, (%%esp)" : : : "memory");
+}
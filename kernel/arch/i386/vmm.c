@@ -0,0 +1,143 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <kernel/cpu.h>
+#include <kernel/pmm.h>
+#include <kernel/smp.h>
+#include <kernel/vmm.h>
+
+#define PTE_PRESENT (1u << 0)
+#define PTE_USER    (1u << 2)
+#define PDE_4M      (1u << 7)
+#define PTE_GLOBAL  (1u << 8)
+#define PTE_FLAGS   (VMM_WRITE | VMM_USER | VMM_WRITE_THROUGH | VMM_NO_CACHE | VMM_WRITE_COMBINING)
+
+#define CR4_PGE (1u << 7)
+
+// A PTE with PAT=1, PCD=0, PWT=0 selects PAT entry 4. Out of reset it is
+// write-back, like entry 0, and nothing maps with the PAT bit before it is
+// changed, so reprogramming it needs no cache or TLB flush.
+#define MSR_PAT         0x277
+#define PAT_ENTRY_SHIFT 32
+#define PAT_TYPE_WC     UINT64_C(0x01)
+
+// Set up by boot.S: the direct map in 4 MiB pages and nothing else.
+extern uint32_t boot_page_directory[1024];
+
+static uint32_t global_bit;
+static bool have_pat;
+static uintptr_t mmio_next = VMM_DYNAMIC_BASE;
+
+static inline uint32_t read_cr4(void) {
+	uint32_t cr4;
+	__asm__ volatile ("movl %%cr4, %0" : "=r"(cr4));
+	return cr4;
+}
+
+static inline void write_cr4(uint32_t cr4) {
+	__asm__ volatile ("movl %0, %%cr4" : : "r"(cr4) : "memory");
+}
+
+static inline void invlpg(uintptr_t virt) {
+	__asm__ volatile ("invlpg (%0)" : : "r"(virt) : "memory");
+}
+
+// Drop a changed mapping from the TLB. Only this CPU's is flushed; there
+// is no shootdown, so the other CPUs must not be running yet.
+static void flush_page(uintptr_t virt) {
+	if (smp_cpu_count() > 1) {
+		printf("vmm: mapping at %#x changed with %u CPUs up\n", virt, smp_cpu_count());
+		abort();
+	}
+	invlpg(virt);
+}
+
+void vmm_initialize(void) {
+	if (cpu_has_feature(CPU_FEATURE_PAT)) {
+		uint64_t pat = cpu_read_msr(MSR_PAT);
+		pat &= ~(UINT64_C(0xff) << PAT_ENTRY_SHIFT);
+		pat |= PAT_TYPE_WC << PAT_ENTRY_SHIFT;
+		cpu_write_msr(MSR_PAT, pat);
+		have_pat = true;
+	}
+
+	// Turning PGE on flushes the whole TLB, so the global bits boot.S put
+	// on the direct map take effect from here.
+	if (cpu_has_feature(CPU_FEATURE_PGE)) {
+		write_cr4(read_cr4() | CR4_PGE);
+		global_bit = PTE_GLOBAL;
+	}
+}
+
+// The page table covering virt, or NULL when there is none and alloc is false
+// or no frame is left. Never returns a 4 MiB mapping.
+static uint32_t* page_table(uintptr_t virt, bool alloc, unsigned flags) {
+	uint32_t* pde = &boot_page_directory[virt >> 22];
+
+	if (*pde & PTE_PRESENT)
+		return *pde & PDE_4M ? NULL : phys_to_virt(*pde & ~(uint32_t) (PAGE_SIZE - 1));
+	if (!alloc)
+		return NULL;
+
+	uintptr_t table = pmm_alloc(0);
+	if (!table)
+		return NULL;
+	memset(phys_to_virt(table), 0, PAGE_SIZE);
+	// Access is checked against both levels, so the directory entry allows
+	// everything and the page table entries restrict it.
+	*pde = (uint32_t) table | PTE_PRESENT | VMM_WRITE | (flags & VMM_USER);
+	return phys_to_virt(table);
+}
+
+bool vmm_map(uintptr_t virt, uintptr_t phys, unsigned flags) {
+	uint32_t* table = page_table(virt, true, flags);
+	if (!table)
+		return false;
+
+	if ((flags & VMM_WRITE_COMBINING) && !have_pat)
+		flags = (flags & ~(unsigned) VMM_WRITE_COMBINING) | VMM_NO_CACHE | VMM_WRITE_THROUGH;
+
+	uint32_t* pte = &table[(virt >> PAGE_SHIFT) & 1023];
+	bool was_present = *pte & PTE_PRESENT;
+	*pte = (uint32_t) (phys & ~(uintptr_t) (PAGE_SIZE - 1)) | (flags & PTE_FLAGS) | PTE_PRESENT
+		| (virt >= KERNEL_VIRTUAL_BASE ? global_bit : 0);
+	// A page that was not present cannot be in the TLB.
+	if (was_present)
+		flush_page(virt);
+	return true;
+}
+
+void vmm_unmap(uintptr_t virt) {
+	uint32_t* table = page_table(virt, false, 0);
+	if (!table)
+		return;
+
+	uint32_t* pte = &table[(virt >> PAGE_SHIFT) & 1023];
+	if (*pte & PTE_PRESENT) {
+		*pte = 0;
+		flush_page(virt);
+	}
+}
+
+void* vmm_map_mmio(uintptr_t phys, size_t size, unsigned flags) {
+	uintptr_t offset = phys & (PAGE_SIZE - 1);
+	size_t pages = (offset + size + PAGE_SIZE - 1) >> PAGE_SHIFT;
+
+	if (pages == 0 || pages > (0 - mmio_next) >> PAGE_SHIFT)
+		return NULL;
+
+	uintptr_t virt = mmio_next;
+	for (size_t i = 0; i < pages; i++) {
+		if (!vmm_map(virt + (i << PAGE_SHIFT), phys - offset + (i << PAGE_SHIFT), flags)) {
+			while (i-- > 0)
+				vmm_unmap(virt + (i << PAGE_SHIFT));
+			return NULL;
+		}
+	}
+	mmio_next += pages << PAGE_SHIFT;
+	return (void*) (virt + offset);
+}
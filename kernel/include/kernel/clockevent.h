@@ -0,0 +1,28 @@
+#ifndef _KERNEL_CLOCKEVENT_H
+#define _KERNEL_CLOCKEVENT_H
+
+#include <stdint.h>
+
+// The one-shot timer interrupt. There is no periodic tick: whoever keeps time
+// programs the next event they need.
+
+// Pick the best timer the machine has: the TSC deadline, then the local APIC
+// timer, then the PIT. Calibrates the first two against the PIT. handler runs
+// in interrupt context, with the interrupt already acknowledged, each time a
+// programmed event fires. Needs irq_initialize.
+void clockevent_initialize(void (*handler)(void));
+
+// Fire once, delta_ns from now, replacing any pending event. A delay longer
+// than the hardware can count fires early, at its limit, so the handler must
+// check the time rather than trust that its deadline has come.
+void clockevent_program(uint64_t delta_ns);
+
+// Drop the pending event, if any.
+void clockevent_cancel(void);
+
+const char* clockevent_name(void);
+
+// TSC ticks per second as measured against the PIT, or 0 without a TSC.
+uint64_t clockevent_tsc_hz(void);
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef _KERNEL_CONSOLE_H
+#define _KERNEL_CONSOLE_H
+
+#include <stddef.h>
+
+// An output device the kernel console fans out to.
+struct console_sink {
+	const char* name;
+	void (*write)(const char* data, size_t size);
+	// Push buffered output to the device. May be NULL.
+	void (*flush)(void);
+	struct console_sink* next;
+};
+
+// Add a sink; output written from then on goes to it as well. Registering
+// the same sink twice has no effect.
+void console_register(struct console_sink* sink);
+void console_write(const char* data, size_t size);
+void console_writestring(const char* data);
+void console_flush(void);
+
+#endif
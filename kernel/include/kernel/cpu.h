@@ -0,0 +1,33 @@
+#ifndef _KERNEL_CPU_H
+#define _KERNEL_CPU_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+enum cpu_feature {
+	CPU_FEATURE_FPU  = 1 << 0,
+	CPU_FEATURE_TSC  = 1 << 1,
+	CPU_FEATURE_SSE  = 1 << 2,
+	CPU_FEATURE_SSE2 = 1 << 3,
+	CPU_FEATURE_PGE  = 1 << 4,
+	CPU_FEATURE_PAT  = 1 << 5,
+	CPU_FEATURE_APIC = 1 << 6,
+	CPU_FEATURE_TSC_DEADLINE = 1 << 7,
+	CPU_FEATURE_INVARIANT_TSC = 1 << 8,
+	CPU_FEATURE_XSAVE = 1 << 9,
+	CPU_FEATURE_XSAVEOPT = 1 << 10,
+};
+
+void cpu_initialize(void);
+bool cpu_has_feature(enum cpu_feature feature);
+size_t cpu_l2_cache_size(void);
+
+// Raw time stamp counter, or 0 on CPUs without one.
+uint64_t cpu_timestamp(void);
+
+// Model specific registers. The caller checks the MSR exists.
+uint64_t cpu_read_msr(uint32_t msr);
+void cpu_write_msr(uint32_t msr, uint64_t value);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef _KERNEL_FPU_H
+#define _KERNEL_FPU_H
+
+#include <stdbool.h>
+
+struct thread;
+
+// Save with XSAVEOPT where the CPU has it. It skips state that has not
+// changed since it was last loaded from the same area.
+#ifndef FPU_USE_XSAVEOPT
+#define FPU_USE_XSAVEOPT 1
+#endif
+
+// Start lazy FPU switching with boot, the running thread, owning the FPU
+// registers as they are. Needs kmalloc; returns false when out of memory.
+bool fpu_initialize(struct thread* boot);
+
+// Allocate the save area of a new thread. Returns false when out of memory.
+bool fpu_thread_init(struct thread* thread);
+
+// Free the save area of a thread that will not run again.
+void fpu_thread_free(struct thread* thread);
+
+// Called by the scheduler, interrupts off, before switching to next. The
+// registers stay where they are; the first FPU or SSE instruction next
+// executes traps and moves them.
+void fpu_switch(struct thread* next);
+
+#endif
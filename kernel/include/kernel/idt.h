@@ -0,0 +1,46 @@
+#ifndef _KERNEL_IDT_H
+#define _KERNEL_IDT_H
+
+#include <stdint.h>
+
+#define IDT_VECTORS 256
+
+// What the entry stubs leave on the stack for a full handler, lowest address
+// first. The CPU pushed eip, cs and eflags; the stub pushed the vector and,
+// where the CPU did not, a zero error code. Changes to the fields are loaded
+// back into the registers on return.
+struct interrupt_frame {
+	uint32_t edi, esi, ebp, ebx, edx, ecx, eax;
+	uint32_t vector;
+	uint32_t error;
+	uint32_t eip, cs, eflags;
+};
+
+// A full handler sees and may change every general purpose register.
+typedef void (*interrupt_handler)(struct interrupt_frame* frame);
+
+// A leaf handler only gets the vector. The entry stub saves just the
+// registers a C call clobbers, so it suits device interrupts that touch
+// nothing but their device.
+typedef void (*interrupt_leaf_handler)(unsigned vector);
+
+// Load the GDT and IDT and remap the PICs. CPU exceptions print the register
+// state and panic until a handler is installed; IRQs are masked.
+void idt_initialize(void);
+
+// Load the IDT on another CPU. All CPUs share it and its handlers.
+void idt_load(void);
+
+// Install the handler for a vector, replacing the previous one. Handlers run
+// with interrupts off and must not use the FPU or SSE; the string functions
+// see in_interrupt and keep to integer registers.
+void idt_set_handler(uint8_t vector, interrupt_handler handler);
+void idt_set_leaf_handler(uint8_t vector, interrupt_leaf_handler handler);
+
+#if KERNEL_SELFTEST
+// Print the cycles an int instruction takes into an empty leaf handler and
+// an empty full handler and back. Call after idt_initialize.
+void idt_selftest(void);
+#endif
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef _KERNEL_IRQ_H
+#define _KERNEL_IRQ_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Legacy (ISA) IRQ n arrives on vector IRQ_VECTOR_BASE + n, whichever
+// controller delivers it.
+#define IRQ_VECTOR_BASE 0x20
+#define IRQ_LEGACY 16
+
+#define EFLAGS_IF (1u << 9)
+
+static inline void irq_enable(void) {
+	__asm__ volatile ("sti" : : : "memory");
+}
+
+static inline void irq_disable(void) {
+	__asm__ volatile ("cli" : : : "memory");
+}
+
+// Disable interrupts and return the previous state for irq_restore.
+static inline uint32_t irq_save(void) {
+	uint32_t eflags;
+	__asm__ volatile ("pushfl; popl %0; cli" : "=r"(eflags) : : "memory");
+	return eflags;
+}
+
+static inline void irq_restore(uint32_t eflags) {
+	if (eflags & EFLAGS_IF)
+		irq_enable();
+}
+
+// Take the local APIC and IO-APICs when ACPI describes them, else stay on
+// the 8259 PICs. Every IRQ starts masked, with a handler that only
+// acknowledges it. Needs the page allocator.
+void irq_initialize(void);
+bool irq_uses_apic(void);
+
+void irq_mask(unsigned irq);
+void irq_unmask(unsigned irq);
+
+// Acknowledge irq. Handlers installed on an IRQ vector call this once they
+// are done with the device. On the APIC it is a single MMIO write.
+void irq_eoi(unsigned irq);
+
+#endif
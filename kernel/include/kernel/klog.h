@@ -0,0 +1,31 @@
+#ifndef _KERNEL_KLOG_H
+#define _KERNEL_KLOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum klog_level {
+	KLOG_ERROR,
+	KLOG_WARNING,
+	KLOG_INFO,
+	KLOG_DEBUG,
+};
+
+// Append a message to the calling CPU's ring. Never blocks: when the ring
+// is full the message is counted as dropped instead. Messages longer than
+// one record are split over several.
+void klog_write(enum klog_level level, const char* data, size_t size);
+
+// Render every committed record of every CPU to the console sinks, merged
+// oldest first by timestamp. Returns the number of records rendered.
+size_t klog_drain(void);
+
+// Number of records dropped because a ring was full, over all CPUs.
+uint32_t klog_dropped(void);
+
+// Replay every ring, drained or not, merged by timestamp straight to the
+// console sinks. Meant for after a panic, when the normal drain may never run
+// again.
+void klog_dump(void);
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef _KERNEL_KTIME_H
+#define _KERNEL_KTIME_H
+
+#include <stdint.h>
+
+#define NSEC_PER_SEC UINT64_C(1000000000)
+
+// Converts a count at one rate into a count at another as
+// (value * mult) >> shift, with mult kept to 32 bits.
+struct clock_scale {
+	uint32_t mult;
+	unsigned shift;
+};
+
+// The scale from from_hz to to_hz. mult is rounded up, so a converted
+// deadline is never early.
+struct clock_scale clock_scale(uint64_t from_hz, uint64_t to_hz);
+
+// (value * mult) >> shift, keeping the high bits of the 96-bit product.
+static inline uint64_t clock_scale_apply(uint64_t value, struct clock_scale scale) {
+	uint32_t hi = (uint32_t) (value >> 32);
+	uint64_t result = ((uint64_t) (uint32_t) value * scale.mult) >> scale.shift;
+	if (hi)
+		result += ((uint64_t) hi * scale.mult) << (32 - scale.shift);
+	return result;
+}
+
+// Start the clock at 0, counting the TSC at tsc_hz.
+void ktime_initialize(uint64_t tsc_hz);
+
+// Nanoseconds since ktime_initialize. Monotonic, and cheap enough to call on
+// every event: one rdtsc and two multiplies. Stands still on CPUs without a
+// TSC.
+uint64_t ktime_get_ns(void);
+
+#endif
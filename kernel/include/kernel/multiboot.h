@@ -0,0 +1,43 @@
+#ifndef _KERNEL_MULTIBOOT_H
+#define _KERNEL_MULTIBOOT_H
+
+#include <stdint.h>
+
+// Value of %eax when a multiboot loader jumps to _start.
+#define MULTIBOOT_BOOTLOADER_MAGIC 0x2BADB002
+
+// Bits of multiboot_info.flags saying which fields are valid.
+#define MULTIBOOT_INFO_MEMORY  (1u << 0)
+#define MULTIBOOT_INFO_MEM_MAP (1u << 6)
+
+#define MULTIBOOT_MEMORY_AVAILABLE 1
+
+// The information structure %ebx points to. Addresses are physical.
+struct multiboot_info {
+	uint32_t flags;
+	uint32_t mem_lower;     // KiB of memory below 1 MiB
+	uint32_t mem_upper;     // KiB of memory from 1 MiB to the first hole
+	uint32_t boot_device;
+	uint32_t cmdline;
+	uint32_t mods_count;
+	uint32_t mods_addr;
+	uint32_t syms[4];
+	uint32_t mmap_length;
+	uint32_t mmap_addr;
+	uint32_t drives_length;
+	uint32_t drives_addr;
+	uint32_t config_table;
+	uint32_t boot_loader_name;
+	uint32_t apm_table;
+};
+
+// One memory map entry. `size` does not count itself, so the next entry
+// starts size + 4 bytes further on.
+struct multiboot_mmap_entry {
+	uint32_t size;
+	uint64_t addr;
+	uint64_t len;
+	uint32_t type;
+} __attribute__((packed));
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef _KERNEL_PMM_H
+#define _KERNEL_PMM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <kernel/multiboot.h>
+
+#define PAGE_SHIFT 12
+#define PAGE_SIZE (1u << PAGE_SHIFT)
+
+// Largest block the allocator hands out: 2^10 frames, 4 MiB.
+#define PMM_MAX_ORDER 10
+
+// Build the free lists from the multiboot memory map, as reached through the
+// direct map. The first MiB, the kernel image, the multiboot structures and
+// the allocator's own frame table stay reserved. Memory above
+// KERNEL_DIRECT_MAP_SIZE is not managed.
+void pmm_initialize(const struct multiboot_info* mbi);
+
+// Allocate 2^order physically contiguous frames, aligned to their size.
+// Returns the physical address of the first one, or 0 when no block that
+// large is free. Frame 0 is never handed out, so 0 is not a valid block.
+uintptr_t pmm_alloc(unsigned order);
+
+// Return a block from pmm_alloc, with the same order, merging it with its
+// free buddies.
+void pmm_free(uintptr_t addr, unsigned order);
+
+// Number of frames currently free.
+size_t pmm_free_frames(void);
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef _KERNEL_SCHED_H
+#define _KERNEL_SCHED_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <kernel/timer.h>
+
+// Priority 0 runs first. Threads of equal priority share the CPU in
+// SCHED_SLICE_NS turns.
+#define THREAD_PRIORITIES 32
+#define THREAD_PRIORITY_DEFAULT 16
+#define THREAD_STACK_ORDER 2 // 16 KiB
+#define SCHED_SLICE_NS UINT64_C(10000000)
+
+enum thread_state {
+	THREAD_READY,
+	THREAD_RUNNING,
+	THREAD_BLOCKED,
+	THREAD_DEAD,
+};
+
+struct thread {
+	uint32_t esp;        // saved by context_switch; keep first
+	struct thread* next; // in its run queue
+	enum thread_state state;
+	unsigned priority;
+	const char* name;
+	void (*entry)(void* arg);
+	void* arg;
+	void* stack;         // NULL for the boot thread
+	struct timer sleep_timer;
+	void* fpu_state;     // x87 and SSE registers, see kernel/fpu.h
+};
+
+// Make the caller the first thread, "main", and start the idle thread.
+// Needs timer_initialize and kmalloc.
+void sched_initialize(void);
+
+// Start entry(arg) in a new thread. It runs before the caller when its
+// priority is higher. Returns NULL when out of memory.
+struct thread* thread_create(const char* name, void (*entry)(void* arg), void* arg, unsigned priority);
+
+struct thread* thread_current(void);
+
+// Let the other ready threads of the same or a higher priority run first.
+void thread_yield(void);
+
+// Also what returning from entry does. The stack is freed by the next thread.
+__attribute__((__noreturn__))
+void thread_exit(void);
+
+void thread_sleep(uint64_t ns);
+
+// Stop running until thread_wake. Call with interrupts off, after making
+// sure someone will wake the thread, so the wakeup cannot be lost.
+void thread_block(void);
+
+// Make a blocked thread ready. Safe from interrupt handlers.
+void thread_wake(struct thread* thread);
+
+// Keep the current thread on the CPU across interrupts. Nests.
+void preempt_disable(void);
+void preempt_enable(void);
+
+#if KERNEL_SELFTEST
+// Print the time thread_yield takes to switch to another thread, and check
+// that threads of equal priority that never yield get equal shares of the
+// CPU. Call from main with interrupts on.
+void sched_selftest(void);
+#endif
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef _KERNEL_SERIAL_H
+#define _KERNEL_SERIAL_H
+
+#include <stdbool.h>
+
+// Set up COM1 at 115200 8N1 and add it as a console sink. Returns false,
+// and registers nothing, if no working UART answers at COM1.
+bool serial_initialize(void);
+
+#endif
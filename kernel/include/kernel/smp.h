@@ -0,0 +1,74 @@
+#ifndef _KERNEL_SMP_H
+#define _KERNEL_SMP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define MAX_CPUS 16
+
+// Per-CPU data. Each CPU's %gs segment covers its own struct cpu, so a CPU
+// reaches its fields with one %gs-relative access and data that only its
+// own CPU writes needs no lock, just interrupts off where a handler
+// shares it.
+struct cpu {
+	struct cpu* self;              // this_cpu reads %gs:0; keep first
+	volatile uint8_t need_resched; // read by isr_common; keep at offset 4
+	uint8_t irq_nesting;           // kept by isr_common; keep at offset 5
+	unsigned id;                   // 0 is the boot CPU
+	uint8_t apic_id;
+	volatile bool online;
+	void* stack;                   // NULL for the boot CPU
+	// smp_call's request. The caller sets call last; the CPU clears it
+	// when it starts the call.
+	void* volatile call_arg;
+	void (*volatile call)(void* arg);
+	volatile unsigned preempt_count;
+	// Read-side state of RCU, see kernel/sync.h.
+	unsigned rcu_nesting;
+	uint32_t rcu_seq;
+};
+
+// The struct cpu of the CPU running the caller. Threads stay on the CPU
+// they started on, so the result may be kept.
+static inline struct cpu* this_cpu(void) {
+	struct cpu* cpu;
+	__asm__ ("movl %%gs:0, %0" : "=r"(cpu));
+	return cpu;
+}
+
+// Whether this CPU is running an interrupt or exception handler. The
+// FPU and SSE registers then belong to whichever thread was interrupted.
+static inline bool in_interrupt(void) {
+	uint8_t nesting;
+	__asm__ ("movb %%gs:%c1, %0" : "=q"(nesting) : "i"(offsetof(struct cpu, irq_nesting)));
+	return nesting != 0;
+}
+
+// Start every other processor in the ACPI MADT and wait for each to report
+// in. Needs irq_initialize, on the local APIC, and the page allocator;
+// without the APIC only the boot CPU runs.
+void smp_initialize(void);
+
+// CPUs online, the boot CPU included. Their ids are 0 to count - 1.
+unsigned smp_cpu_count(void);
+struct cpu* smp_cpu(unsigned id);
+
+// Interrupt CPU id, which ends a hlt there.
+void smp_kick(unsigned id);
+
+// Run func(arg) on CPU id, from the boot CPU. The scheduler only runs on
+// the boot CPU, so the others idle until asked to run something; func runs
+// there with interrupts on and must not block, sleep or touch any thread.
+// Returns false when id is the boot CPU or offline, or when its previous
+// call has not started yet.
+bool smp_call(unsigned id, void (*func)(void* arg), void* arg);
+
+#if KERNEL_SELFTEST
+// Have every CPU sum its share of a series through smp_call and check the
+// total. Call from the boot CPU after smp_initialize and before
+// workqueue_initialize keeps the others.
+void smp_selftest(void);
+#endif
+
+#endif
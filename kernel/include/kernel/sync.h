@@ -0,0 +1,213 @@
+#ifndef _KERNEL_SYNC_H
+#define _KERNEL_SYNC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <kernel/irq.h>
+#include <kernel/sched.h>
+#include <kernel/smp.h>
+
+static inline void cpu_relax(void) {
+	__asm__ volatile ("pause" : : : "memory");
+}
+
+// Ticket spinlock: waiters take a ticket and are served in order, so no CPU
+// starves, and each one only reads the lock while it waits. Holders must not
+// sleep. The plain variants keep the holder on its CPU; the _irqsave ones
+// also shut out interrupt handlers on it, and are the ones to use for data a
+// handler touches.
+struct spinlock {
+	uint16_t owner;
+	uint16_t next;
+};
+
+#define SPINLOCK_INIT { 0, 0 }
+
+static inline void spin_lock_raw(struct spinlock* lock) {
+	uint16_t ticket = __atomic_fetch_add(&lock->next, 1, __ATOMIC_RELAXED);
+	while (__atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE) != ticket)
+		cpu_relax();
+}
+
+static inline void spin_unlock_raw(struct spinlock* lock) {
+	__atomic_store_n(&lock->owner, (uint16_t) (lock->owner + 1), __ATOMIC_RELEASE);
+}
+
+static inline void spin_lock(struct spinlock* lock) {
+	preempt_disable();
+	spin_lock_raw(lock);
+}
+
+static inline void spin_unlock(struct spinlock* lock) {
+	spin_unlock_raw(lock);
+	preempt_enable();
+}
+
+static inline uint32_t spin_lock_irqsave(struct spinlock* lock) {
+	uint32_t eflags = irq_save();
+	spin_lock_raw(lock);
+	return eflags;
+}
+
+static inline void spin_unlock_irqrestore(struct spinlock* lock, uint32_t eflags) {
+	spin_unlock_raw(lock);
+	irq_restore(eflags);
+}
+
+// MCS queue lock, for locks that see real contention. Each waiter spins on
+// its own node, which the caller provides, typically on its stack, and
+// keeps until the unlock, so a release only touches the next waiter's
+// cache line instead of every waiter's.
+struct mcs_node {
+	struct mcs_node* next;
+	bool locked;
+};
+
+struct mcs_lock {
+	struct mcs_node* tail;
+};
+
+#define MCS_LOCK_INIT { NULL }
+
+void mcs_lock_raw(struct mcs_lock* lock, struct mcs_node* node);
+void mcs_unlock_raw(struct mcs_lock* lock, struct mcs_node* node);
+
+static inline void mcs_lock(struct mcs_lock* lock, struct mcs_node* node) {
+	preempt_disable();
+	mcs_lock_raw(lock, node);
+}
+
+static inline void mcs_unlock(struct mcs_lock* lock, struct mcs_node* node) {
+	mcs_unlock_raw(lock, node);
+	preempt_enable();
+}
+
+static inline uint32_t mcs_lock_irqsave(struct mcs_lock* lock, struct mcs_node* node) {
+	uint32_t eflags = irq_save();
+	mcs_lock_raw(lock, node);
+	return eflags;
+}
+
+static inline void mcs_unlock_irqrestore(struct mcs_lock* lock, struct mcs_node* node, uint32_t eflags) {
+	mcs_unlock_raw(lock, node);
+	irq_restore(eflags);
+}
+
+// Sequence lock, for small read-mostly data. Writers serialize on the lock
+// and make the count odd while they change the data; readers take no lock
+// and retry when the count was odd or moved:
+//
+//	do {
+//		seq = read_seqbegin(&sl);
+//		copy = data;
+//	} while (read_seqretry(&sl, seq));
+//
+// A reader may see a torn copy before it retries, so it must not follow
+// pointers out of it.
+struct seqlock {
+	uint32_t seq;
+	struct spinlock lock;
+};
+
+#define SEQLOCK_INIT { 0, SPINLOCK_INIT }
+
+static inline uint32_t read_seqbegin(const struct seqlock* sl) {
+	uint32_t seq;
+	while ((seq = __atomic_load_n(&sl->seq, __ATOMIC_ACQUIRE)) & 1)
+		cpu_relax();
+	return seq;
+}
+
+static inline bool read_seqretry(const struct seqlock* sl, uint32_t seq) {
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(&sl->seq, __ATOMIC_RELAXED) != seq;
+}
+
+static inline void write_seqcount_begin(struct seqlock* sl) {
+	__atomic_store_n(&sl->seq, sl->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void write_seqcount_end(struct seqlock* sl) {
+	__atomic_store_n(&sl->seq, sl->seq + 1, __ATOMIC_RELEASE);
+}
+
+// A writer in an interrupt handler on a CPU whose reader it interrupted
+// would have that reader spin forever, so handlers use the _irqsave pair
+// or stay readers.
+static inline void write_seqlock(struct seqlock* sl) {
+	spin_lock(&sl->lock);
+	write_seqcount_begin(sl);
+}
+
+static inline void write_sequnlock(struct seqlock* sl) {
+	write_seqcount_end(sl);
+	spin_unlock(&sl->lock);
+}
+
+static inline uint32_t write_seqlock_irqsave(struct seqlock* sl) {
+	uint32_t eflags = spin_lock_irqsave(&sl->lock);
+	write_seqcount_begin(sl);
+	return eflags;
+}
+
+static inline void write_sequnlock_irqrestore(struct seqlock* sl, uint32_t eflags) {
+	write_seqcount_end(sl);
+	spin_unlock_irqrestore(&sl->lock, eflags);
+}
+
+// RCU-lite. Readers bracket their use of RCU-protected pointers with
+// rcu_read_lock and rcu_read_unlock, which take no lock and may nest but
+// must not sleep. An updater publishes a new version with
+// rcu_assign_pointer, then synchronize_rcu waits for every reader that
+// might still see the old one, which can then be freed.
+//
+// Each CPU counts its outermost read sections in struct cpu: odd while it
+// is inside one. synchronize_rcu waits, for each CPU it finds odd, until
+// that section has ended. Sections started after the new pointer was
+// published cannot see the old one, so they are not waited for.
+//
+// Interrupt handlers may be readers too. The nesting count and the
+// sequence change together with interrupts off, so a handler never finds
+// the nesting taken but the count still even, or the other way round.
+static inline void rcu_read_lock(void) {
+	struct cpu* cpu;
+	uint32_t eflags;
+
+	preempt_disable();
+	eflags = irq_save();
+	cpu = this_cpu();
+	// The count must be visible before the pointers are loaded, which on
+	// x86 takes a locked instruction; xchg is one.
+	if (cpu->rcu_nesting++ == 0)
+		__atomic_store_n(&cpu->rcu_seq, cpu->rcu_seq + 1, __ATOMIC_SEQ_CST);
+	irq_restore(eflags);
+}
+
+static inline void rcu_read_unlock(void) {
+	struct cpu* cpu = this_cpu();
+	uint32_t eflags = irq_save();
+
+	if (--cpu->rcu_nesting == 0)
+		__atomic_store_n(&cpu->rcu_seq, cpu->rcu_seq + 1, __ATOMIC_RELEASE);
+	irq_restore(eflags);
+	preempt_enable();
+}
+
+#define rcu_dereference(p) __atomic_load_n(&(p), __ATOMIC_CONSUME)
+#define rcu_assign_pointer(p, v) __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+
+// Wait until no read section that began before the call is still running.
+// May spin for as long as the longest one; not from inside one.
+void synchronize_rcu(void);
+
+#if KERNEL_SELFTEST
+// Print how many times a millisecond the ticket and the MCS lock change
+// hands with 1 to all CPUs taking them in a tight loop, and check that no
+// increment under them is lost. Runs through smp_call, so call from the
+// boot CPU before workqueue_initialize keeps the others.
+void sync_selftest(void);
+#endif
+
+#endif
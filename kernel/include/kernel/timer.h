@@ -0,0 +1,40 @@
+#ifndef _KERNEL_TIMER_H
+#define _KERNEL_TIMER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A one-shot software timer. The owner keeps the storage; the wheel links it
+// in while it is pending.
+struct timer {
+	struct timer* next;
+	struct timer** pprev; // NULL while not pending
+	uint64_t expires;     // ktime_get_ns() value
+	void (*func)(void* data);
+	void* data;
+	uint16_t slot;
+};
+
+// Take over the clockevent and start ktime. Needs irq_initialize.
+void timer_initialize(void);
+
+void timer_init(struct timer* timer, void (*func)(void* data), void* data);
+
+// Arm the timer to call func(data) once ktime_get_ns() reaches expires,
+// moving it if it is already pending. func runs in interrupt context and may
+// add or cancel timers, itself included. Timers are kept at a granularity
+// of TIMER_TICK_NS and never fire early.
+void timer_add(struct timer* timer, uint64_t expires);
+
+// Returns whether the timer was pending.
+bool timer_cancel(struct timer* timer);
+
+static inline bool timer_pending(const struct timer* timer) {
+	return timer->pprev != NULL;
+}
+
+#define TIMER_TICK_SHIFT 12
+#define TIMER_TICK_NS (UINT64_C(1) << TIMER_TICK_SHIFT)
+
+#endif
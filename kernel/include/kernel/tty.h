@@ -4,8 +4,23 @@
 #include <stddef.h>
 
 void terminal_initialize(void);
+// Switch to a write-combining mapping of VGA memory. Needs the page allocator.
+// With KERNEL_SELFTEST it prints the cycles a full-screen redraw takes
+// through the uncached direct map before the switch and through the new
+// mapping after it, so call it with one CPU up and interrupts off.
+void terminal_enable_write_combining(void);
 void terminal_putchar(char c);
 void terminal_write(const char* data, size_t size);
 void terminal_writestring(const char* data);
+// The functions above only update an in-memory copy of the screen; this
+// pushes the rows that changed since the last flush to the display.
+void terminal_flush(void);
+
+// Scrollback. Positive rows move the view back into older output; the view
+// stays on the same rows while new output arrives until it is reset.
+void terminal_view_scroll(long rows);
+void terminal_view_page_up(void);
+void terminal_view_page_down(void);
+void terminal_view_reset(void);
 
 #endif
@@ -0,0 +1,61 @@
+#ifndef _KERNEL_VMM_H
+#define _KERNEL_VMM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// The kernel is linked here, and physical memory from 0 up to
+// KERNEL_DIRECT_MAP_SIZE is mapped here with 4 MiB pages.
+#define KERNEL_VIRTUAL_BASE 0xC0000000u
+#define KERNEL_DIRECT_MAP_SIZE 0x38000000u
+
+// Kernel virtual addresses above the direct map, free for vmm_map.
+#define VMM_DYNAMIC_BASE (KERNEL_VIRTUAL_BASE + KERNEL_DIRECT_MAP_SIZE)
+
+// Mapping attributes. These are the i386 page table bits, passed through as
+// is. VMM_WRITE_COMBINING is the PTE's PAT bit, which vmm_initialize points at
+// a write-combining PAT entry; without PAT it falls back to uncached.
+enum vmm_flags {
+	VMM_WRITE           = 1 << 1,
+	VMM_USER            = 1 << 2,
+	VMM_WRITE_THROUGH   = 1 << 3,
+	VMM_NO_CACHE        = 1 << 4,
+	VMM_WRITE_COMBINING = 1 << 7,
+};
+
+// Address of physical memory in the direct map. Only valid below
+// KERNEL_DIRECT_MAP_SIZE.
+static inline void* phys_to_virt(uintptr_t phys) {
+	return (void*) (phys + KERNEL_VIRTUAL_BASE);
+}
+
+static inline uintptr_t virt_to_phys(const void* virt) {
+	return (uintptr_t) virt - KERNEL_VIRTUAL_BASE;
+}
+
+// Turn on global pages when the CPU has them, so kernel TLB entries survive
+// CR3 reloads, and program the PAT for VMM_WRITE_COMBINING. Every CPU runs
+// this as it starts.
+void vmm_initialize(void);
+
+// All CPUs share one page directory, and there is no TLB shootdown: a
+// mapping that was present may only be changed or removed before
+// smp_initialize starts the other CPUs, and vmm_map and vmm_unmap abort
+// when asked to later. New mappings of pages that were not present are
+// fine at any time, from one CPU at a time.
+
+// Map the 4 KiB page at virt to phys, allocating a page table if needed.
+// Returns false when out of memory or when virt is inside the direct map.
+// Kernel mappings are global.
+bool vmm_map(uintptr_t virt, uintptr_t phys, unsigned flags);
+
+// Remove the mapping of the page at virt, if any, and flush it from the TLB.
+void vmm_unmap(uintptr_t virt);
+
+// Map size bytes of device memory at phys into fresh kernel address space
+// and return the address of phys there, or NULL when out of memory or address
+// space. The mapping is never taken down.
+void* vmm_map_mmio(uintptr_t phys, size_t size, unsigned flags);
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef _KERNEL_WORKQUEUE_H
+#define _KERNEL_WORKQUEUE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Deferred work, run in a worker outside interrupt context. The owner keeps
+// the storage. A work item is pending from queue_work until a worker starts
+// it, and may be queued again from then on, from its own func as well.
+struct work {
+	void (*func)(void* data);
+	void* data;
+	uint32_t state;    // WORK_PENDING plus WORK_RUNNING per running call
+	struct work* next; // on an overflow list
+};
+
+#define WORK_PENDING 1u
+#define WORK_RUNNING 2u
+
+// Deque slots per CPU. Work queued past that waits on a locked list.
+#define WORK_DEQUE_SIZE 1024
+
+#define WORK_THREAD_PRIORITY 4
+
+// Start a worker on every CPU: a thread on the boot CPU and, through
+// smp_call, a loop that keeps each other CPU for good. Needs
+// sched_initialize and smp_initialize.
+void workqueue_initialize(void);
+
+void work_init(struct work* work, void (*func)(void* data), void* data);
+
+// Queue work on the calling CPU, for its worker or any idle one that steals
+// it. Returns false, doing nothing, when it is already pending. Safe from
+// interrupt handlers.
+bool queue_work(struct work* work);
+
+// Wait until work is neither pending nor running. Call from a thread.
+void flush_work(struct work* work);
+
+#if KERNEL_SELFTEST
+// Print how many work items a millisecond 1 to all CPUs get through when
+// millions of tiny ones start on the boot CPU and the rest steal. Runs the
+// workers through smp_call, so call from the boot CPU before
+// workqueue_initialize.
+void workqueue_selftest(void);
+
+// Queue a series split in work items on the boot CPU, flush them and check
+// the sum, printing how many CPUs' workers took part. Call from a thread
+// with interrupts on, after workqueue_initialize.
+void workqueue_selftest_workers(void);
+#endif
+
+#endif
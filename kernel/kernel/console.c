@@ -0,0 +1,70 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <kernel/console.h>
+#include <kernel/smp.h>
+#include <kernel/sync.h>
+
+#define NO_CPU (~0u)
+
+static struct console_sink* console_sinks;
+// The sinks keep their position in plain globals, so one CPU at a time.
+static struct spinlock console_lock = SPINLOCK_INIT;
+static volatile unsigned console_owner = NO_CPU;
+
+// A fault inside a sink prints its report through the console again, on
+// the CPU that holds the lock; that nested use goes ahead unlocked rather
+// than deadlock.
+static bool console_lock_acquire(uint32_t* eflags) {
+	unsigned id = this_cpu()->id;
+
+	if (console_owner == id)
+		return false;
+	*eflags = spin_lock_irqsave(&console_lock);
+	console_owner = id;
+	return true;
+}
+
+static void console_lock_release(uint32_t eflags) {
+	console_owner = NO_CPU;
+	spin_unlock_irqrestore(&console_lock, eflags);
+}
+
+void console_register(struct console_sink* sink) {
+	struct console_sink** link = &console_sinks;
+
+	for (; *link != NULL; link = &(*link)->next) {
+		if (*link == sink)
+			return;
+	}
+	sink->next = NULL;
+	*link = sink;
+}
+
+void console_write(const char* data, size_t size) {
+	uint32_t eflags;
+	bool locked = console_lock_acquire(&eflags);
+
+	for (struct console_sink* sink = console_sinks; sink != NULL; sink = sink->next)
+		sink->write(data, size);
+	if (locked)
+		console_lock_release(eflags);
+}
+
+void console_writestring(const char* data) {
+	console_write(data, strlen(data));
+}
+
+void console_flush(void) {
+	uint32_t eflags;
+	bool locked = console_lock_acquire(&eflags);
+
+	for (struct console_sink* sink = console_sinks; sink != NULL; sink = sink->next) {
+		if (sink->flush != NULL)
+			sink->flush();
+	}
+	if (locked)
+		console_lock_release(eflags);
+}
@@ -1,14 +1,68 @@
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 
+#include <kernel/clockevent.h>
+#include <kernel/cpu.h>
+#include <kernel/idt.h>
+#include <kernel/irq.h>
+#include <kernel/klog.h>
+#include <kernel/multiboot.h>
+#include <kernel/pmm.h>
+#include <kernel/sched.h>
+#include <kernel/serial.h>
+#include <kernel/smp.h>
+#include <kernel/sync.h>
+#include <kernel/timer.h>
 #include <kernel/tty.h>
+#include <kernel/vmm.h>
+#include <kernel/workqueue.h>
 
-void kernel_main(void) {
+void kernel_main(uint32_t magic, uint32_t mbi_addr) {
+	// First, as it points %gs at the boot CPU's struct cpu, which every
+	// lock uses.
+	idt_initialize();
+	cpu_initialize();
 	terminal_initialize();
+	serial_initialize();
+
+	if (magic != MULTIBOOT_BOOTLOADER_MAGIC) {
+		printf("kernel: not booted by a multiboot loader (magic %#x)\n", magic);
+		abort();
+	}
+	vmm_initialize();
+	// The loader passes the physical address of its info structure.
+	pmm_initialize(phys_to_virt(mbi_addr));
+	terminal_enable_write_combining();
+#if KERNEL_SELFTEST
+	idt_selftest();
+#endif
+	printf("pmm: %zu KiB free\n", pmm_free_frames() * (PAGE_SIZE / 1024));
+
+	irq_initialize();
+	timer_initialize();
+	printf("time: %s clockevent, TSC %llu kHz\n", clockevent_name(), clockevent_tsc_hz() / 1000);
+	smp_initialize();
+	printf("smp: %u CPUs online\n", smp_cpu_count());
+#if KERNEL_SELFTEST
+	smp_selftest();
+	sync_selftest();
+	workqueue_selftest();
+#endif
+	sched_initialize();
+	workqueue_initialize();
+	irq_enable();
+#if KERNEL_SELFTEST
+	workqueue_selftest_workers();
+	sched_selftest();
+#endif
+
     for (int i = 0; ; i++)
     {
         if (i%2==0)
 	        printf("Hello, kernel World!\n");
         else
             printf("HELLO AGAIN! %d\n", i);
+        klog_drain();
     }
 }
@@ -0,0 +1,222 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <kernel/console.h>
+#include <kernel/cpu.h>
+#include <kernel/klog.h>
+#include <kernel/smp.h>
+
+// Records per CPU. Must be a power of two.
+#define KLOG_RECORDS 256
+#define KLOG_TEXT_MAX 112
+
+/*
+ * Every CPU appends to a ring of its own, so CPUs logging at once never
+ * touch the same cache lines. On one CPU an interrupt handler can still log
+ * in the middle of a thread's append, so each ring is a bounded
+ * multi-producer queue in the style of Vyukov's: each record carries a
+ * sequence number that says whether it is free for a given position
+ * (seq == pos), committed (seq == pos + 1) or drained and free for the next
+ * lap (seq == pos + KLOG_RECORDS). Producers claim a position with a CAS on
+ * the ring's head and publish the record with a release store of seq.
+ *
+ * The drain merges the rings by timestamp. A claimed record that is not
+ * committed yet may be older than everything committed on the other CPUs,
+ * so the merge stops there until it is.
+ *
+ * The stored value is seq minus the record index, so the all-zero .bss image
+ * is already a set of valid empty rings and printf works as soon as
+ * idt_initialize has pointed %gs at the boot CPU.
+ */
+struct klog_record {
+	uint32_t seq;
+	uint8_t level;
+	uint8_t len;
+	uint64_t timestamp;
+	char text[KLOG_TEXT_MAX];
+};
+
+struct klog_ring {
+	uint32_t head;
+	uint32_t tail;
+	uint32_t drops;
+	struct klog_record records[KLOG_RECORDS];
+} __attribute__((aligned(64)));
+
+static struct klog_ring klog_rings[MAX_CPUS];
+static uint32_t klog_drops_reported;
+static bool klog_draining;
+
+static inline uint32_t record_seq(const struct klog_record* rec, uint32_t pos) {
+	return __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) + (pos & (KLOG_RECORDS - 1));
+}
+
+static inline void set_record_seq(struct klog_record* rec, uint32_t pos, uint32_t seq) {
+	__atomic_store_n(&rec->seq, seq - (pos & (KLOG_RECORDS - 1)), __ATOMIC_RELEASE);
+}
+
+static void klog_push(enum klog_level level, const char* data, size_t size) {
+	struct klog_ring* ring = &klog_rings[this_cpu()->id];
+	uint32_t pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+	struct klog_record* rec;
+
+	for (;;) {
+		rec = &ring->records[pos & (KLOG_RECORDS - 1)];
+		int32_t dif = (int32_t) (record_seq(rec, pos) - pos);
+		if (dif == 0) {
+			if (__atomic_compare_exchange_n(&ring->head, &pos, pos + 1, true,
+			                                __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if (dif < 0) {
+			// The drain has not caught up with the previous lap.
+			__atomic_fetch_add(&ring->drops, 1, __ATOMIC_RELAXED);
+			return;
+		} else {
+			pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+		}
+	}
+
+	rec->level = (uint8_t) level;
+	rec->len = (uint8_t) size;
+	rec->timestamp = cpu_timestamp();
+	memcpy(rec->text, data, size);
+	set_record_seq(rec, pos, pos + 1);
+}
+
+void klog_write(enum klog_level level, const char* data, size_t size) {
+	while (size > KLOG_TEXT_MAX) {
+		klog_push(level, data, KLOG_TEXT_MAX);
+		data += KLOG_TEXT_MAX;
+		size -= KLOG_TEXT_MAX;
+	}
+	if (size != 0)
+		klog_push(level, data, size);
+}
+
+static void write_hex(uint64_t value) {
+	char buf[18];
+	size_t i = sizeof(buf);
+
+	do {
+		buf[--i] = "0123456789abcdef"[value & 0xF];
+		value >>= 4;
+	} while (value != 0);
+	buf[--i] = 'x';
+	buf[--i] = '0';
+	console_write(&buf[i], sizeof(buf) - i);
+}
+
+static void write_dec(uint32_t value) {
+	char buf[10];
+	size_t i = sizeof(buf);
+
+	do {
+		buf[--i] = '0' + value % 10;
+		value /= 10;
+	} while (value != 0);
+	console_write(&buf[i], sizeof(buf) - i);
+}
+
+// The ring whose next record is the oldest committed one, or NULL when
+// there is none or a ring's next record is still being written.
+static struct klog_ring* oldest_ring(void) {
+	struct klog_ring* oldest = NULL;
+	uint64_t timestamp = 0;
+
+	for (unsigned id = 0; id < MAX_CPUS; id++) {
+		struct klog_ring* ring = &klog_rings[id];
+		uint32_t pos = ring->tail;
+		struct klog_record* rec = &ring->records[pos & (KLOG_RECORDS - 1)];
+		if (record_seq(rec, pos) != pos + 1) {
+			if (__atomic_load_n(&ring->head, __ATOMIC_RELAXED) != pos)
+				return NULL;
+			continue;
+		}
+		if (!oldest || rec->timestamp < timestamp) {
+			oldest = ring;
+			timestamp = rec->timestamp;
+		}
+	}
+	return oldest;
+}
+
+size_t klog_drain(void) {
+	struct klog_ring* ring;
+	size_t drained = 0;
+
+	// Only one drain at a time; a nested or concurrent caller just returns.
+	if (__atomic_exchange_n(&klog_draining, true, __ATOMIC_ACQUIRE))
+		return 0;
+
+	while ((ring = oldest_ring())) {
+		uint32_t pos = ring->tail;
+		struct klog_record* rec = &ring->records[pos & (KLOG_RECORDS - 1)];
+		console_write(rec->text, rec->len);
+		set_record_seq(rec, pos, pos + KLOG_RECORDS);
+		ring->tail = pos + 1;
+		drained++;
+	}
+
+	uint32_t drops = klog_dropped();
+	if (drops != klog_drops_reported) {
+		console_writestring("klog: ");
+		write_dec(drops - klog_drops_reported);
+		console_writestring(" records dropped\n");
+		klog_drops_reported = drops;
+	}
+	console_flush();
+
+	__atomic_store_n(&klog_draining, false, __ATOMIC_RELEASE);
+	return drained;
+}
+
+uint32_t klog_dropped(void) {
+	uint32_t drops = 0;
+
+	for (unsigned id = 0; id < MAX_CPUS; id++)
+		drops += __atomic_load_n(&klog_rings[id].drops, __ATOMIC_RELAXED);
+	return drops;
+}
+
+void klog_dump(void) {
+	uint32_t head[MAX_CPUS];
+	uint32_t pos[MAX_CPUS];
+
+	for (unsigned id = 0; id < MAX_CPUS; id++) {
+		head[id] = __atomic_load_n(&klog_rings[id].head, __ATOMIC_ACQUIRE);
+		pos[id] = head[id] > KLOG_RECORDS ? head[id] - KLOG_RECORDS : 0;
+	}
+
+	console_writestring("---- klog dump ----\n");
+	for (;;) {
+		struct klog_record* oldest = NULL;
+		unsigned oldest_id = 0;
+		for (unsigned id = 0; id < MAX_CPUS; id++) {
+			for (; pos[id] != head[id]; pos[id]++) {
+				struct klog_record* rec = &klog_rings[id].records[pos[id] & (KLOG_RECORDS - 1)];
+				uint32_t seq = record_seq(rec, pos[id]);
+				// Skip records that are still being written or already reused.
+				if (seq != pos[id] + 1 && seq != pos[id] + KLOG_RECORDS)
+					continue;
+				if (!oldest || rec->timestamp < oldest->timestamp) {
+					oldest = rec;
+					oldest_id = id;
+				}
+				break;
+			}
+		}
+		if (!oldest)
+			break;
+		console_writestring("[");
+		write_hex(oldest->timestamp);
+		console_writestring("] ");
+		console_write(oldest->text, oldest->len);
+		pos[oldest_id]++;
+	}
+	console_writestring("---- ");
+	write_dec(klog_dropped());
+	console_writestring(" dropped ----\n");
+	console_flush();
+}
@@ -0,0 +1,35 @@
+#include <stdint.h>
+#include <stdio.h>
+
+#include <kernel/cpu.h>
+#include <kernel/ktime.h>
+
+static uint64_t tsc_base;
+static struct clock_scale tsc_to_ns;
+
+struct clock_scale clock_scale(uint64_t from_hz, uint64_t to_hz) {
+	// The largest shift up to 32 that keeps mult within 32 bits.
+	for (unsigned shift = 32; shift > 0; shift--) {
+		if (to_hz > (UINT64_MAX - from_hz) >> shift)
+			continue;
+		uint64_t mult = ((to_hz << shift) + from_hz - 1) / from_hz;
+		if (mult <= UINT32_MAX)
+			return (struct clock_scale) { (uint32_t) mult, shift };
+	}
+	return (struct clock_scale) { UINT32_MAX, 0 };
+}
+
+void ktime_initialize(uint64_t tsc_hz) {
+	if (tsc_hz == 0) {
+		printf("ktime: no TSC, the clock stands still\n");
+		return;
+	}
+	if (!cpu_has_feature(CPU_FEATURE_INVARIANT_TSC))
+		printf("ktime: TSC is not invariant, time drifts with the CPU clock\n");
+	tsc_to_ns = clock_scale(tsc_hz, NSEC_PER_SEC);
+	tsc_base = cpu_timestamp();
+}
+
+uint64_t ktime_get_ns(void) {
+	return clock_scale_apply(cpu_timestamp() - tsc_base, tsc_to_ns);
+}
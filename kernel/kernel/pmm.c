@@ -0,0 +1,264 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <kernel/multiboot.h>
+#include <kernel/pmm.h>
+#include <kernel/sync.h>
+#include <kernel/vmm.h>
+
+#define FRAME_NONE UINT32_MAX
+// Order of a frame that does not start a free block.
+#define FRAME_USED 0xff
+
+// Frames are reached through the kernel's direct map, so memory past it is
+// left alone.
+#define PHYS_LIMIT ((uint64_t) KERNEL_DIRECT_MAP_SIZE)
+#define LOW_MEMORY_END 0x100000
+
+#define MAX_RESERVED 5
+
+/*
+ * A binary buddy allocator over every frame below the highest usable address.
+ * Each free block of 2^order frames is on free_lists[order], linked through
+ * its first frame's entry in the frame table. The buddy of block f is
+ * f ^ (1 << order), so freeing merges upwards in at most PMM_MAX_ORDER steps.
+ * Allocation finds the smallest non-empty list with one bit scan of
+ * free_orders and splits down from it.
+ *
+ * Every CPU allocates from the same lists, under an MCS lock so that CPUs
+ * queueing for it do not all hammer one cache line.
+ */
+struct frame {
+	uint32_t next;
+	uint32_t prev;
+	uint8_t order;
+};
+
+struct range {
+	uint64_t start;
+	uint64_t end;
+};
+
+// Linker script symbols bounding the kernel image.
+extern char _kernel_start[];
+extern char _kernel_end[];
+
+static struct frame* frames;
+static uint32_t frame_count;
+static uint32_t free_lists[PMM_MAX_ORDER + 1];
+static uint32_t free_orders;
+static size_t free_count;
+static struct mcs_lock pmm_lock = MCS_LOCK_INIT;
+
+static struct range reserved[MAX_RESERVED];
+static size_t reserved_count;
+
+static void list_push(uint32_t f, unsigned order) {
+	uint32_t next = free_lists[order];
+
+	frames[f].order = (uint8_t) order;
+	frames[f].prev = FRAME_NONE;
+	frames[f].next = next;
+	if (next != FRAME_NONE)
+		frames[next].prev = f;
+	free_lists[order] = f;
+	free_orders |= 1u << order;
+}
+
+static void list_remove(uint32_t f) {
+	struct frame* frame = &frames[f];
+	unsigned order = frame->order;
+
+	if (frame->prev != FRAME_NONE)
+		frames[frame->prev].next = frame->next;
+	else
+		free_lists[order] = frame->next;
+	if (frame->next != FRAME_NONE)
+		frames[frame->next].prev = frame->prev;
+	if (free_lists[order] == FRAME_NONE)
+		free_orders &= ~(1u << order);
+	frame->order = FRAME_USED;
+}
+
+static void free_block(uint32_t f, unsigned order) {
+	free_count += (size_t) 1 << order;
+	while (order < PMM_MAX_ORDER) {
+		uint32_t buddy = f ^ (1u << order);
+		if (buddy >= frame_count || frames[buddy].order != order)
+			break;
+		list_remove(buddy);
+		f &= ~(1u << order);
+		order++;
+	}
+	list_push(f, order);
+}
+
+uintptr_t pmm_alloc(unsigned order) {
+	if (order > PMM_MAX_ORDER)
+		return 0;
+
+	struct mcs_node node;
+	uint32_t eflags = mcs_lock_irqsave(&pmm_lock, &node);
+	uint32_t candidates = free_orders & ~((1u << order) - 1);
+	if (candidates == 0) {
+		mcs_unlock_irqrestore(&pmm_lock, &node, eflags);
+		return 0;
+	}
+
+	unsigned found = (unsigned) __builtin_ctz(candidates);
+	uint32_t f = free_lists[found];
+	list_remove(f);
+	while (found > order) {
+		found--;
+		list_push(f + (1u << found), found);
+	}
+	free_count -= (size_t) 1 << order;
+	mcs_unlock_irqrestore(&pmm_lock, &node, eflags);
+	return (uintptr_t) f << PAGE_SHIFT;
+}
+
+void pmm_free(uintptr_t addr, unsigned order) {
+	struct mcs_node node;
+	uint32_t eflags = mcs_lock_irqsave(&pmm_lock, &node);
+	free_block((uint32_t) (addr >> PAGE_SHIFT), order);
+	mcs_unlock_irqrestore(&pmm_lock, &node, eflags);
+}
+
+size_t pmm_free_frames(void) {
+	return free_count;
+}
+
+static uint64_t page_round_up(uint64_t addr) {
+	return (addr + PAGE_SIZE - 1) & ~(uint64_t) (PAGE_SIZE - 1);
+}
+
+static void reserve(uint64_t start, uint64_t end) {
+	if (reserved_count < MAX_RESERVED)
+		reserved[reserved_count++] = (struct range) { start, end };
+}
+
+// Release [start, end) as the largest aligned blocks that fit.
+static void release_frames(uint32_t first, uint32_t end) {
+	while (first < end) {
+		unsigned order = first != 0 ? (unsigned) __builtin_ctz(first) : PMM_MAX_ORDER;
+		if (order > PMM_MAX_ORDER)
+			order = PMM_MAX_ORDER;
+		while (end - first < (1u << order))
+			order--;
+		free_block(first, order);
+		first += 1u << order;
+	}
+}
+
+// Release the whole frames of [start, end) that miss reserved[from...].
+static void release_range(uint64_t start, uint64_t end, size_t from) {
+	for (size_t i = from; i < reserved_count && start < end; i++) {
+		if (reserved[i].start < end && start < reserved[i].end) {
+			if (start < reserved[i].start)
+				release_range(start, reserved[i].start, i + 1);
+			start = reserved[i].end;
+		}
+	}
+	start = page_round_up(start);
+	end &= ~(uint64_t) (PAGE_SIZE - 1);
+	if (start < end)
+		release_frames((uint32_t) (start >> PAGE_SHIFT), (uint32_t) (end >> PAGE_SHIFT));
+}
+
+// Walks the available regions, clipped to the direct map.
+struct region_iter {
+	const struct multiboot_info* mbi;
+	uintptr_t entry;
+	bool done;
+};
+
+static struct region_iter regions(const struct multiboot_info* mbi) {
+	return (struct region_iter) { mbi, mbi->mmap_addr, false };
+}
+
+static bool next_region(struct region_iter* it, uint64_t* start, uint64_t* end) {
+	const struct multiboot_info* mbi = it->mbi;
+
+	if (!(mbi->flags & MULTIBOOT_INFO_MEM_MAP)) {
+		if (it->done || !(mbi->flags & MULTIBOOT_INFO_MEMORY))
+			return false;
+		it->done = true;
+		*start = LOW_MEMORY_END;
+		*end = LOW_MEMORY_END + (uint64_t) mbi->mem_upper * 1024;
+		return true;
+	}
+
+	while (it->entry < mbi->mmap_addr + mbi->mmap_length) {
+		const struct multiboot_mmap_entry* e = phys_to_virt(it->entry);
+		it->entry += e->size + sizeof(e->size);
+		if (e->type == MULTIBOOT_MEMORY_AVAILABLE && e->addr < PHYS_LIMIT) {
+			*start = e->addr;
+			*end = e->addr + e->len < PHYS_LIMIT ? e->addr + e->len : PHYS_LIMIT;
+			return true;
+		}
+	}
+	return false;
+}
+
+// First fit for the frame table, stepping over the reserved ranges.
+static uint64_t place_table(const struct multiboot_info* mbi, uint64_t size) {
+	struct region_iter it = regions(mbi);
+	uint64_t start, end;
+
+	while (next_region(&it, &start, &end)) {
+		bool moved;
+		start = page_round_up(start);
+		do {
+			moved = false;
+			for (size_t i = 0; i < reserved_count; i++) {
+				if (reserved[i].start < start + size && start < reserved[i].end) {
+					start = page_round_up(reserved[i].end);
+					moved = true;
+				}
+			}
+		} while (moved);
+		if (start + size <= end)
+			return start;
+	}
+	return 0;
+}
+
+void pmm_initialize(const struct multiboot_info* mbi) {
+	struct region_iter it;
+	uint64_t start, end, highest = 0;
+
+	reserved_count = 0;
+	reserve(0, LOW_MEMORY_END);
+	reserve(virt_to_phys(_kernel_start), page_round_up(virt_to_phys(_kernel_end)));
+	reserve(virt_to_phys(mbi), virt_to_phys(mbi) + sizeof(*mbi));
+	if (mbi->flags & MULTIBOOT_INFO_MEM_MAP)
+		reserve(mbi->mmap_addr, (uint64_t) mbi->mmap_addr + mbi->mmap_length);
+
+	for (unsigned order = 0; order <= PMM_MAX_ORDER; order++)
+		free_lists[order] = FRAME_NONE;
+	free_orders = 0;
+	free_count = 0;
+
+	it = regions(mbi);
+	while (next_region(&it, &start, &end))
+		if (end > highest)
+			highest = end;
+	frame_count = (uint32_t) (highest >> PAGE_SHIFT);
+
+	uint64_t table_size = page_round_up((uint64_t) frame_count * sizeof(struct frame));
+	uint64_t table = place_table(mbi, table_size);
+	if (table == 0) {
+		frame_count = 0;
+		return;
+	}
+	reserve(table, table + table_size);
+
+	frames = phys_to_virt((uintptr_t) table);
+	for (uint32_t f = 0; f < frame_count; f++)
+		frames[f].order = FRAME_USED;
+
+	it = regions(mbi);
+	while (next_region(&it, &start, &end))
+		release_range(start, end, 0);
+}
@@ -0,0 +1,347 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <kernel/fpu.h>
+#include <kernel/irq.h>
+#include <kernel/ktime.h>
+#include <kernel/pmm.h>
+#include <kernel/sched.h>
+#include <kernel/smp.h>
+#include <kernel/timer.h>
+#include <kernel/vmm.h>
+
+/*
+ * An O(1) scheduler: one FIFO run queue per priority and a bitmap of the
+ * non-empty ones, so picking the next thread is a bit scan and a dequeue.
+ * The running thread is on no queue. The idle thread is on none either; it
+ * runs when the bitmap is empty.
+ *
+ * Preemption happens on the way out of an interrupt: handlers only set the
+ * CPU's need_resched, and isr_common calls sched_preempt when it is set.
+ * The time slice is a timer that is only armed while another thread of the
+ * running one's priority is waiting, so a lone thread or an idle CPU takes
+ * no scheduling interrupts.
+ *
+ * Everything here runs with interrupts off.
+ */
+struct run_queue {
+	struct thread* head;
+	struct thread* tail;
+};
+
+extern void context_switch(uint32_t* prev_esp, uint32_t next_esp);
+
+static struct run_queue run_queues[THREAD_PRIORITIES];
+static uint32_t ready_map;
+static struct thread* current;
+static struct thread* idle_thread;
+// The thread switched away from, until the next one has finished switching.
+static struct thread* switch_prev;
+static struct timer slice_timer;
+
+static void enqueue(struct thread* thread) {
+	struct run_queue* queue = &run_queues[thread->priority];
+
+	thread->state = THREAD_READY;
+	thread->next = NULL;
+	if (queue->tail)
+		queue->tail->next = thread;
+	else
+		queue->head = thread;
+	queue->tail = thread;
+	ready_map |= 1u << thread->priority;
+}
+
+static struct thread* dequeue(unsigned priority) {
+	struct run_queue* queue = &run_queues[priority];
+	struct thread* thread = queue->head;
+
+	queue->head = thread->next;
+	if (!queue->head) {
+		queue->tail = NULL;
+		ready_map &= ~(1u << priority);
+	}
+	return thread;
+}
+
+static bool others_ready_at(unsigned priority) {
+	return ready_map & ((2u << priority) - 1);
+}
+
+static void slice_expired(void* data) {
+	(void) data;
+	this_cpu()->need_resched = 1;
+}
+
+// Arm the slice for current if anyone is waiting for its turn, otherwise
+// make sure no slice interrupt comes.
+static void update_slice(void) {
+	if (current != idle_thread && others_ready_at(current->priority)) {
+		if (!timer_pending(&slice_timer))
+			timer_add(&slice_timer, ktime_get_ns() + SCHED_SLICE_NS);
+	} else {
+		timer_cancel(&slice_timer);
+	}
+}
+
+// Runs on the new thread's stack right after a switch.
+static void finish_switch(void) {
+	struct thread* prev = switch_prev;
+
+	switch_prev = NULL;
+	if (prev && prev->state == THREAD_DEAD && prev->stack) {
+		fpu_thread_free(prev);
+		pmm_free(virt_to_phys(prev->stack), THREAD_STACK_ORDER);
+		kfree(prev);
+	}
+}
+
+// Put current back on its queue if it can still run and switch to the
+// best ready thread.
+static void schedule(void) {
+	struct thread* prev = current;
+	struct thread* next;
+
+	this_cpu()->need_resched = 0;
+	if (prev->state == THREAD_RUNNING && prev != idle_thread)
+		enqueue(prev);
+	next = ready_map ? dequeue((unsigned) __builtin_ctz(ready_map)) : idle_thread;
+	next->state = THREAD_RUNNING;
+	current = next;
+	// The slice starts afresh for whoever runs now.
+	timer_cancel(&slice_timer);
+	update_slice();
+	if (next == prev)
+		return;
+
+	switch_prev = prev;
+	fpu_switch(next);
+	context_switch(&prev->esp, next->esp);
+	finish_switch();
+}
+
+// Called by isr_common, interrupts off, once the handler asked for it.
+void sched_preempt(void) {
+	if (current && this_cpu()->preempt_count == 0)
+		schedule();
+}
+
+__attribute__((__noreturn__))
+static void thread_start(void) {
+	finish_switch();
+	irq_enable();
+	current->entry(current->arg);
+	thread_exit();
+}
+
+static void idle(void* arg) {
+	(void) arg;
+	// sti only takes effect after the next instruction, so no interrupt
+	// can slip in between and leave hlt waiting for the one after.
+	for (;;)
+		__asm__ volatile ("sti; hlt; cli" : : : "memory");
+}
+
+static void sleep_expired(void* data) {
+	thread_wake(data);
+}
+
+static struct thread* thread_alloc(const char* name, unsigned priority) {
+	struct thread* thread = kmalloc(sizeof(*thread));
+	if (!thread)
+		return NULL;
+	thread->name = name;
+	thread->priority = priority < THREAD_PRIORITIES ? priority : THREAD_PRIORITIES - 1;
+	thread->stack = NULL;
+	thread->next = NULL;
+	timer_init(&thread->sleep_timer, sleep_expired, thread);
+	return thread;
+}
+
+static struct thread* thread_new(const char* name, void (*entry)(void* arg), void* arg, unsigned priority) {
+	struct thread* thread = thread_alloc(name, priority);
+	if (!thread)
+		return NULL;
+	uintptr_t stack = pmm_alloc(THREAD_STACK_ORDER);
+	if (!stack) {
+		kfree(thread);
+		return NULL;
+	}
+	thread->stack = phys_to_virt(stack);
+	if (!fpu_thread_init(thread)) {
+		pmm_free(stack, THREAD_STACK_ORDER);
+		kfree(thread);
+		return NULL;
+	}
+	thread->entry = entry;
+	thread->arg = arg;
+
+	// What context_switch pops: edi, esi, ebx, ebp and the return address,
+	// here thread_start, which finds a null return address of its own
+	// above it with the stack aligned as after a call.
+	uint32_t* sp = (uint32_t*) ((char*) thread->stack + (PAGE_SIZE << THREAD_STACK_ORDER));
+	*--sp = 0;
+	*--sp = (uint32_t) thread_start;
+	for (int i = 0; i < 4; i++)
+		*--sp = 0;
+	thread->esp = (uint32_t) sp;
+	return thread;
+}
+
+void sched_initialize(void) {
+	struct thread* main = thread_alloc("main", THREAD_PRIORITY_DEFAULT);
+	if (!main || !fpu_initialize(main))
+		abort();
+	idle_thread = thread_new("idle", idle, NULL, THREAD_PRIORITIES - 1);
+	if (!idle_thread)
+		abort();
+
+	timer_init(&slice_timer, slice_expired, NULL);
+	main->state = THREAD_RUNNING;
+	idle_thread->state = THREAD_READY;
+	current = main;
+}
+
+struct thread* thread_create(const char* name, void (*entry)(void* arg), void* arg, unsigned priority) {
+	struct thread* thread = thread_new(name, entry, arg, priority);
+	if (!thread)
+		return NULL;
+
+	thread->state = THREAD_BLOCKED;
+	thread_wake(thread);
+	return thread;
+}
+
+struct thread* thread_current(void) {
+	return current;
+}
+
+void thread_yield(void) {
+	uint32_t eflags = irq_save();
+	schedule();
+	irq_restore(eflags);
+}
+
+void thread_exit(void) {
+	irq_disable();
+	timer_cancel(&current->sleep_timer);
+	current->state = THREAD_DEAD;
+	schedule();
+	__builtin_unreachable();
+}
+
+void thread_sleep(uint64_t ns) {
+	uint32_t eflags = irq_save();
+	timer_add(&current->sleep_timer, ktime_get_ns() + ns);
+	thread_block();
+	irq_restore(eflags);
+}
+
+void thread_block(void) {
+	current->state = THREAD_BLOCKED;
+	schedule();
+}
+
+void thread_wake(struct thread* thread) {
+	uint32_t eflags = irq_save();
+
+	if (thread->state == THREAD_BLOCKED) {
+		enqueue(thread);
+		if (current == idle_thread || thread->priority < current->priority)
+			this_cpu()->need_resched = 1;
+		else
+			update_slice();
+	}
+	// Interrupts were on, so this is a thread, not a handler, and the
+	// switch need not wait for the next interrupt.
+	if (this_cpu()->need_resched && (eflags & EFLAGS_IF) && this_cpu()->preempt_count == 0)
+		schedule();
+	irq_restore(eflags);
+}
+
+void preempt_disable(void) {
+	// Interrupts leave the count as they found it, so no need to block them.
+	this_cpu()->preempt_count++;
+	__asm__ volatile ("" : : : "memory");
+}
+
+void preempt_enable(void) {
+	struct cpu* cpu = this_cpu();
+	uint32_t eflags = irq_save();
+	if (--cpu->preempt_count == 0 && cpu->need_resched && (eflags & EFLAGS_IF))
+		schedule();
+	irq_restore(eflags);
+}
+
+#if KERNEL_SELFTEST
+// Above main's priority, so main only runs again once they have all exited.
+#define SELFTEST_PRIORITY (THREAD_PRIORITY_DEFAULT - 1)
+#define SELFTEST_YIELDS 10000
+#define SELFTEST_SPINNERS 4
+#define SELFTEST_SPIN_NS (50 * SCHED_SLICE_NS)
+
+static uint64_t spinner_deadline;
+static uint64_t spinner_counts[SELFTEST_SPINNERS];
+
+static void yielder(void* arg) {
+	(void) arg;
+	for (unsigned i = 0; i < SELFTEST_YIELDS; i++)
+		thread_yield();
+}
+
+// Never yields; only the slice timer takes the CPU away.
+static void spinner(void* arg) {
+	uint64_t* count = arg;
+	while (ktime_get_ns() < spinner_deadline)
+		(*count)++;
+}
+
+// Starts count threads of entry, all ready before the first one runs, and
+// returns once they have exited.
+static void run_threads(const char* name, void (*entry)(void* arg), void** args, unsigned count) {
+	preempt_disable();
+	for (unsigned i = 0; i < count; i++) {
+		if (!thread_create(name, entry, args ? args[i] : NULL, SELFTEST_PRIORITY)) {
+			printf("sched: out of memory for the self-test threads\n");
+			abort();
+		}
+	}
+	preempt_enable();
+}
+
+void sched_selftest(void) {
+	uint64_t start = ktime_get_ns();
+	run_threads("yielder", yielder, NULL, 2);
+	uint64_t yield_ns = (ktime_get_ns() - start) / (2 * SELFTEST_YIELDS);
+
+	void* args[SELFTEST_SPINNERS];
+	uint64_t total = 0, min = UINT64_MAX, max = 0;
+	for (unsigned i = 0; i < SELFTEST_SPINNERS; i++) {
+		spinner_counts[i] = 0;
+		args[i] = &spinner_counts[i];
+	}
+	spinner_deadline = ktime_get_ns() + SELFTEST_SPIN_NS;
+	run_threads("spinner", spinner, args, SELFTEST_SPINNERS);
+	for (unsigned i = 0; i < SELFTEST_SPINNERS; i++) {
+		total += spinner_counts[i];
+		if (spinner_counts[i] < min)
+			min = spinner_counts[i];
+		if (spinner_counts[i] > max)
+			max = spinner_counts[i];
+	}
+
+	printf("sched: thread_yield to another thread %llu ns\n", yield_ns);
+	// Round-robin gives each spinner an equal share of the slices, give or
+	// take one.
+	uint64_t mean = total / SELFTEST_SPINNERS;
+	uint64_t slack = mean * SELFTEST_SPINNERS * SCHED_SLICE_NS / SELFTEST_SPIN_NS;
+	printf("sched: %u spinners counted %llu to %llu, mean %llu\n", SELFTEST_SPINNERS, min, max, mean);
+	if (max - mean > slack || mean - min > slack) {
+		printf("sched: spinners more than a slice apart\n");
+		abort();
+	}
+}
+#endif
@@ -0,0 +1,149 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <kernel/ktime.h>
+#include <kernel/smp.h>
+#include <kernel/sync.h>
+
+void mcs_lock_raw(struct mcs_lock* lock, struct mcs_node* node) {
+	node->next = NULL;
+	node->locked = true;
+
+	struct mcs_node* prev = __atomic_exchange_n(&lock->tail, node, __ATOMIC_ACQ_REL);
+	if (!prev)
+		return;
+	__atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+	while (__atomic_load_n(&node->locked, __ATOMIC_ACQUIRE))
+		cpu_relax();
+}
+
+void mcs_unlock_raw(struct mcs_lock* lock, struct mcs_node* node) {
+	struct mcs_node* next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+
+	if (!next) {
+		// No one queued behind us, unless one is between its exchange and
+		// linking itself in; then wait for the link.
+		struct mcs_node* expected = node;
+		if (__atomic_compare_exchange_n(&lock->tail, &expected, NULL, false,
+		                                __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+			return;
+		while (!(next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE)))
+			cpu_relax();
+	}
+	__atomic_store_n(&next->locked, false, __ATOMIC_RELEASE);
+}
+
+void synchronize_rcu(void) {
+	// Order the caller's rcu_assign_pointer before the counts are read. A
+	// reader whose count is even here will load the pointer after it.
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	for (unsigned id = 0; id < smp_cpu_count(); id++) {
+		struct cpu* cpu = smp_cpu(id);
+		uint32_t seq = __atomic_load_n(&cpu->rcu_seq, __ATOMIC_ACQUIRE);
+		if (!(seq & 1))
+			continue;
+		while (__atomic_load_n(&cpu->rcu_seq, __ATOMIC_ACQUIRE) == seq)
+			cpu_relax();
+	}
+}
+
+#if KERNEL_SELFTEST
+#define SELFTEST_RUN_NS UINT64_C(100000000)
+#define SELFTEST_TIMEOUT_NS UINT64_C(1000000000)
+// Acquisitions between looks at the clock.
+#define SELFTEST_BATCH 64
+
+enum selftest_lock { SELFTEST_TICKET, SELFTEST_MCS };
+
+// One per CPU, each on its own cache line so the counts do not contend.
+struct hammer {
+	uint64_t acquired;
+	volatile bool done;
+} __attribute__((aligned(64)));
+
+static struct hammer hammers[MAX_CPUS];
+static enum selftest_lock hammer_kind;
+static volatile bool hammer_go;
+static uint64_t hammer_stop;
+static struct spinlock ticket_lock = SPINLOCK_INIT;
+static struct mcs_lock queue_lock = MCS_LOCK_INIT;
+// Only changed with the lock held, so it has to end up at the sum of the
+// acquisitions.
+static uint64_t guarded;
+
+// Takes and drops the lock until hammer_stop, from every CPU at once.
+static void hammer_run(void* arg) {
+	struct hammer* hammer = arg;
+	struct mcs_node node;
+	uint64_t acquired = 0;
+
+	while (!hammer_go)
+		cpu_relax();
+	do {
+		for (unsigned i = 0; i < SELFTEST_BATCH; i++) {
+			if (hammer_kind == SELFTEST_TICKET) {
+				spin_lock_raw(&ticket_lock);
+				guarded++;
+				spin_unlock_raw(&ticket_lock);
+			} else {
+				mcs_lock_raw(&queue_lock, &node);
+				guarded++;
+				mcs_unlock_raw(&queue_lock, &node);
+			}
+		}
+		acquired += SELFTEST_BATCH;
+	} while (ktime_get_ns() < hammer_stop);
+	hammer->acquired = acquired;
+	__atomic_store_n(&hammer->done, true, __ATOMIC_RELEASE);
+}
+
+// Acquisitions per millisecond over all of CPUs 0 to cpus - 1.
+static uint64_t hammer_lock(enum selftest_lock kind, unsigned cpus) {
+	uint64_t total = 0;
+
+	hammer_kind = kind;
+	hammer_go = false;
+	guarded = 0;
+	for (unsigned id = 0; id < cpus; id++) {
+		hammers[id].done = false;
+		if (id != 0 && !smp_call(id, hammer_run, &hammers[id])) {
+			printf("sync: cpu %u would not take a call\n", id);
+			abort();
+		}
+	}
+	hammer_stop = ktime_get_ns() + SELFTEST_RUN_NS;
+	__atomic_store_n(&hammer_go, true, __ATOMIC_RELEASE);
+	hammer_run(&hammers[0]);
+
+	uint64_t deadline = hammer_stop + SELFTEST_TIMEOUT_NS;
+	for (unsigned id = 0; id < cpus; id++) {
+		while (!__atomic_load_n(&hammers[id].done, __ATOMIC_ACQUIRE)) {
+			if (ktime_get_ns() > deadline) {
+				printf("sync: cpu %u did not finish\n", id);
+				abort();
+			}
+			cpu_relax();
+		}
+		total += hammers[id].acquired;
+	}
+	if (guarded != total) {
+		printf("sync: %s lock let %llu of %llu increments through unguarded\n",
+		       kind == SELFTEST_TICKET ? "ticket" : "MCS", total - guarded, total);
+		abort();
+	}
+	return total / (SELFTEST_RUN_NS / 1000000);
+}
+
+void sync_selftest(void) {
+	printf("sync: lock acquisitions per ms, all CPUs together\n");
+	for (unsigned cpus = 1; cpus <= smp_cpu_count(); cpus++) {
+		uint64_t ticket = hammer_lock(SELFTEST_TICKET, cpus);
+		uint64_t mcs = hammer_lock(SELFTEST_MCS, cpus);
+		printf("sync: %2u CPUs: ticket %8llu, MCS %8llu\n", cpus, ticket, mcs);
+	}
+}
+#endif
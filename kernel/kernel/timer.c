@@ -0,0 +1,259 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <kernel/clockevent.h>
+#include <kernel/irq.h>
+#include <kernel/ktime.h>
+#include <kernel/timer.h>
+
+/*
+ * A hierarchical timer wheel in the style of Varghese and Lauck, counting
+ * in ticks of TIMER_TICK_NS. Level 0 has one slot per tick for the next 256
+ * ticks; each level above has 64 slots, each as wide as the whole level
+ * below. A timer goes in the lowest level whose span reaches its expiry, so
+ * adding and cancelling are a list insert and unlink.
+ *
+ * Nothing ticks. Each time the clock passes a multiple of a level's slot
+ * width, that level's slot for the window now starting is cascaded: its
+ * timers are placed again, in lower levels. One bitmap of non-empty slots
+ * yields the next tick that has work, expiring or cascading, and the
+ * clockevent is programmed for exactly that tick. Ticks with nothing to do
+ * are skipped over.
+ *
+ * clk is the first tick not yet processed. Everything runs with interrupts
+ * off.
+ */
+#define LEVEL0_BITS 8
+#define LEVEL_BITS 6
+#define LEVELS 5
+#define LEVEL0_SIZE (1u << LEVEL0_BITS)
+#define LEVEL_SIZE (1u << LEVEL_BITS)
+#define WHEEL_SLOTS (LEVEL0_SIZE + (LEVELS - 1) * LEVEL_SIZE)
+
+// Expiries further out are parked in the top level and cascaded around it
+// until they come in range.
+#define MAX_DELTA ((UINT64_C(1) << (LEVEL0_BITS + (LEVELS - 1) * LEVEL_BITS)) - 1)
+
+#define NO_TICK UINT64_MAX
+
+static struct timer* wheel[WHEEL_SLOTS];
+static uint32_t pending_map[WHEEL_SLOTS / 32];
+static uint64_t clk;
+static uint64_t programmed = NO_TICK;
+static bool running;
+
+static inline unsigned level_shift(unsigned level) {
+	return LEVEL0_BITS + (level - 1) * LEVEL_BITS;
+}
+
+static inline unsigned level_base(unsigned level) {
+	return LEVEL0_SIZE + (level - 1) * LEVEL_SIZE;
+}
+
+// The first tick at or after expires, so a timer never fires early.
+static uint64_t expiry_tick(uint64_t expires) {
+	if (expires > UINT64_MAX - (TIMER_TICK_NS - 1))
+		return UINT64_MAX >> TIMER_TICK_SHIFT;
+	return (expires + TIMER_TICK_NS - 1) >> TIMER_TICK_SHIFT;
+}
+
+static void slot_push(unsigned slot, struct timer* timer) {
+	timer->slot = (uint16_t) slot;
+	timer->next = wheel[slot];
+	timer->pprev = &wheel[slot];
+	if (timer->next)
+		timer->next->pprev = &timer->next;
+	wheel[slot] = timer;
+	pending_map[slot / 32] |= 1u << (slot % 32);
+}
+
+static void unlink(struct timer* timer) {
+	*timer->pprev = timer->next;
+	if (timer->next)
+		timer->next->pprev = timer->pprev;
+	timer->pprev = NULL;
+	if (!wheel[timer->slot])
+		pending_map[timer->slot / 32] &= ~(1u << (timer->slot % 32));
+}
+
+static void place(struct timer* timer) {
+	uint64_t tick = expiry_tick(timer->expires);
+
+	if (tick <= clk) {
+		slot_push(clk & (LEVEL0_SIZE - 1), timer);
+		return;
+	}
+	uint64_t delta = tick - clk;
+	if (delta < LEVEL0_SIZE) {
+		slot_push(tick & (LEVEL0_SIZE - 1), timer);
+		return;
+	}
+	if (delta > MAX_DELTA) {
+		delta = MAX_DELTA;
+		tick = clk + MAX_DELTA;
+	}
+	unsigned level = 1;
+	while (delta >> (level_shift(level) + LEVEL_BITS))
+		level++;
+	slot_push(level_base(level) + ((tick >> level_shift(level)) & (LEVEL_SIZE - 1)), timer);
+}
+
+// Distance from bit start of an n-bit map to the next set bit at or after
+// it, wrapping around, or n when the map is empty. n is a multiple of 32.
+static unsigned next_set(const uint32_t* map, unsigned n, unsigned start) {
+	for (unsigned dist = 0; dist < n; ) {
+		unsigned bit = (start + dist) & (n - 1);
+		uint32_t word = map[bit / 32] >> (bit % 32);
+		if (word)
+			return dist + (unsigned) __builtin_ctz(word);
+		dist += 32 - bit % 32;
+	}
+	return n;
+}
+
+// The first tick at or after clk with a timer to run or a slot to cascade.
+static uint64_t next_tick(void) {
+	uint64_t next = NO_TICK;
+
+	unsigned dist = next_set(pending_map, LEVEL0_SIZE, clk & (LEVEL0_SIZE - 1));
+	if (dist < LEVEL0_SIZE)
+		next = clk + dist;
+
+	for (unsigned level = 1; level < LEVELS; level++) {
+		unsigned shift = level_shift(level);
+		// The first slot boundary at or after clk.
+		uint64_t window = (clk + (UINT64_C(1) << shift) - 1) >> shift;
+		dist = next_set(&pending_map[level_base(level) / 32], LEVEL_SIZE, window & (LEVEL_SIZE - 1));
+		if (dist < LEVEL_SIZE && ((window + dist) << shift) < next)
+			next = (window + dist) << shift;
+	}
+	return next;
+}
+
+// Clk just reached a multiple of the level 1 slot width. Move the timers of
+// each level whose window starts here down, lowest level first.
+static void cascade(void) {
+	for (unsigned level = 1; level < LEVELS; level++) {
+		unsigned shift = level_shift(level);
+		if (clk & ((UINT64_C(1) << shift) - 1))
+			break;
+		unsigned slot = level_base(level) + ((clk >> shift) & (LEVEL_SIZE - 1));
+		struct timer* timer = wheel[slot];
+		wheel[slot] = NULL;
+		pending_map[slot / 32] &= ~(1u << (slot % 32));
+		while (timer) {
+			struct timer* next = timer->next;
+			place(timer);
+			timer = next;
+		}
+	}
+}
+
+// Run everything due by tick now and leave clk just past it.
+static void run_timers(uint64_t now) {
+	for (;;) {
+		uint64_t next = next_tick();
+		if (next > now)
+			break;
+		clk = next;
+		cascade();
+
+		// Take the slot's list over, so a callback cancelling a timer that
+		// has yet to run unlinks it from here.
+		unsigned slot = clk & (LEVEL0_SIZE - 1);
+		struct timer* expired = wheel[slot];
+		wheel[slot] = NULL;
+		pending_map[slot / 32] &= ~(1u << (slot % 32));
+		if (expired)
+			expired->pprev = &expired;
+		// Past this tick before any callback runs, so a timer re-added
+		// for now lands on the next tick rather than a full lap later.
+		clk++;
+		while (expired) {
+			struct timer* timer = expired;
+			expired = timer->next;
+			if (expired)
+				expired->pprev = &expired;
+			timer->pprev = NULL;
+			timer->func(timer->data);
+		}
+	}
+	if (clk <= now)
+		clk = now + 1;
+}
+
+static void program(uint64_t now_ns) {
+	uint64_t next = next_tick();
+
+	programmed = next;
+	if (next == NO_TICK) {
+		clockevent_cancel();
+		return;
+	}
+	uint64_t deadline = next << TIMER_TICK_SHIFT;
+	clockevent_program(deadline > now_ns ? deadline - now_ns : 0);
+}
+
+static void timer_interrupt(void) {
+	uint64_t now = ktime_get_ns();
+
+	running = true;
+	run_timers(now >> TIMER_TICK_SHIFT);
+	running = false;
+	program(now);
+}
+
+void timer_initialize(void) {
+	clockevent_initialize(timer_interrupt);
+	ktime_initialize(clockevent_tsc_hz());
+	clk = 0;
+}
+
+void timer_init(struct timer* timer, void (*func)(void* data), void* data) {
+	timer->next = NULL;
+	timer->pprev = NULL;
+	timer->expires = 0;
+	timer->func = func;
+	timer->data = data;
+	timer->slot = 0;
+}
+
+void timer_add(struct timer* timer, uint64_t expires) {
+	uint32_t eflags = irq_save();
+
+	if (timer->pprev)
+		unlink(timer);
+	timer->expires = expires;
+
+	if (running) {
+		place(timer);
+	} else {
+		// Catch clk up with the clock, as far as nothing is due, so the
+		// timer is placed as low in the wheel as it can be.
+		uint64_t now = ktime_get_ns();
+		uint64_t target = now >> TIMER_TICK_SHIFT;
+		uint64_t next = next_tick();
+		if (next < target)
+			target = next;
+		if (target > clk)
+			clk = target;
+
+		// The timer may have brought the next expiry or cascade forward.
+		place(timer);
+		if (next_tick() < programmed)
+			program(now);
+	}
+	irq_restore(eflags);
+}
+
+bool timer_cancel(struct timer* timer) {
+	uint32_t eflags = irq_save();
+	bool was_pending = timer->pprev != NULL;
+
+	// The clockevent stays programmed; it finds nothing to do and moves on.
+	if (was_pending)
+		unlink(timer);
+	irq_restore(eflags);
+	return was_pending;
+}
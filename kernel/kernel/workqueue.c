@@ -0,0 +1,417 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <kernel/irq.h>
+#include <kernel/ktime.h>
+#include <kernel/sched.h>
+#include <kernel/smp.h>
+#include <kernel/sync.h>
+#include <kernel/workqueue.h>
+
+/*
+ * Every CPU has a Chase-Lev deque of pending work. Its own CPU pushes and
+ * takes at the bottom, with interrupts off so a handler's queue_work cannot
+ * land in the middle of a take; other CPUs steal from the top with a CAS.
+ * A worker runs its own newest work first, which is the likeliest to be in
+ * its cache, and an idle one steals the oldest work of the others.
+ *
+ * A worker with nothing to do marks its CPU idle and sleeps: the boot CPU's
+ * worker thread blocks, the others halt. queue_work wakes the local worker
+ * and one idle CPU to steal. Both sides set their flag, fence, then look at
+ * the other's, so one of them always sees the other and no wakeup is lost.
+ * An idle boot CPU is only woken by work queued on it; it can still steal
+ * whenever its worker runs.
+ */
+
+#define WORK_FLUSH_POLL_NS UINT64_C(100000)
+
+// The indices only grow and may wrap; what counts is bottom - top, read as
+// signed, which a take briefly makes -1.
+struct work_deque {
+	uint32_t top;
+	uint32_t bottom;
+	struct work* slots[WORK_DEQUE_SIZE];
+};
+
+struct work_cpu {
+	struct work_deque deque;
+	// Work that did not fit in the deque, oldest first.
+	struct spinlock overflow_lock;
+	struct work* overflow_head;
+	struct work* overflow_tail;
+	bool idle;
+};
+
+_Static_assert((WORK_DEQUE_SIZE & (WORK_DEQUE_SIZE - 1)) == 0, "WORK_DEQUE_SIZE must be a power of two");
+
+static struct work_cpu work_cpus[MAX_CPUS];
+static struct thread* boot_worker;
+
+// Owner only, interrupts off.
+static bool deque_push(struct work_deque* dq, struct work* work) {
+	uint32_t bottom = __atomic_load_n(&dq->bottom, __ATOMIC_RELAXED);
+	uint32_t top = __atomic_load_n(&dq->top, __ATOMIC_ACQUIRE);
+
+	if ((int32_t) (bottom - top) >= WORK_DEQUE_SIZE)
+		return false;
+	__atomic_store_n(&dq->slots[bottom & (WORK_DEQUE_SIZE - 1)], work, __ATOMIC_RELAXED);
+	__atomic_store_n(&dq->bottom, bottom + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+// Owner only, interrupts off.
+static struct work* deque_take(struct work_deque* dq) {
+	uint32_t bottom = __atomic_load_n(&dq->bottom, __ATOMIC_RELAXED) - 1;
+	__atomic_store_n(&dq->bottom, bottom, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	uint32_t top = __atomic_load_n(&dq->top, __ATOMIC_RELAXED);
+
+	if ((int32_t) (bottom - top) < 0) {
+		__atomic_store_n(&dq->bottom, bottom + 1, __ATOMIC_RELAXED);
+		return NULL;
+	}
+	struct work* work = __atomic_load_n(&dq->slots[bottom & (WORK_DEQUE_SIZE - 1)], __ATOMIC_RELAXED);
+	if (top == bottom) {
+		// The last one: race the thieves for it.
+		if (!__atomic_compare_exchange_n(&dq->top, &top, top + 1, false,
+		                                 __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+			work = NULL;
+		__atomic_store_n(&dq->bottom, bottom + 1, __ATOMIC_RELAXED);
+	}
+	return work;
+}
+
+// Any CPU. Returns NULL when empty or when another thief won the race.
+static struct work* deque_steal(struct work_deque* dq) {
+	uint32_t top = __atomic_load_n(&dq->top, __ATOMIC_ACQUIRE);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	uint32_t bottom = __atomic_load_n(&dq->bottom, __ATOMIC_ACQUIRE);
+
+	if ((int32_t) (bottom - top) <= 0)
+		return NULL;
+	struct work* work = __atomic_load_n(&dq->slots[top & (WORK_DEQUE_SIZE - 1)], __ATOMIC_RELAXED);
+	if (!__atomic_compare_exchange_n(&dq->top, &top, top + 1, false,
+	                                 __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+		return NULL;
+	return work;
+}
+
+static bool deque_empty(struct work_deque* dq) {
+	uint32_t top = __atomic_load_n(&dq->top, __ATOMIC_ACQUIRE);
+	return (int32_t) (__atomic_load_n(&dq->bottom, __ATOMIC_ACQUIRE) - top) <= 0;
+}
+
+static void overflow_push(struct work_cpu* wc, struct work* work) {
+	uint32_t eflags = spin_lock_irqsave(&wc->overflow_lock);
+	work->next = NULL;
+	if (wc->overflow_tail)
+		wc->overflow_tail->next = work;
+	else
+		wc->overflow_head = work;
+	wc->overflow_tail = work;
+	spin_unlock_irqrestore(&wc->overflow_lock, eflags);
+}
+
+static struct work* overflow_pop(struct work_cpu* wc) {
+	if (!__atomic_load_n(&wc->overflow_head, __ATOMIC_RELAXED))
+		return NULL;
+
+	uint32_t eflags = spin_lock_irqsave(&wc->overflow_lock);
+	struct work* work = wc->overflow_head;
+	if (work) {
+		wc->overflow_head = work->next;
+		if (!wc->overflow_head)
+			wc->overflow_tail = NULL;
+	}
+	spin_unlock_irqrestore(&wc->overflow_lock, eflags);
+	return work;
+}
+
+static bool work_available(void) {
+	unsigned count = smp_cpu_count();
+
+	for (unsigned id = 0; id < count; id++) {
+		struct work_cpu* wc = &work_cpus[id];
+		if (!deque_empty(&wc->deque) || __atomic_load_n(&wc->overflow_head, __ATOMIC_RELAXED))
+			return true;
+	}
+	return false;
+}
+
+static struct work* find_work(unsigned self) {
+	struct work_cpu* wc = &work_cpus[self];
+	unsigned count = smp_cpu_count();
+	struct work* work;
+
+	uint32_t eflags = irq_save();
+	work = deque_take(&wc->deque);
+	irq_restore(eflags);
+	if (work || (work = overflow_pop(wc)))
+		return work;
+
+	for (unsigned i = 1; i < count; i++) {
+		struct work_cpu* victim = &work_cpus[(self + i) % count];
+		if ((work = deque_steal(&victim->deque)) || (work = overflow_pop(victim)))
+			return work;
+	}
+	return NULL;
+}
+
+static void run_work(struct work* work) {
+	// Pending becomes one more running call in a single step, so flush_work
+	// never sees the work as idle in between.
+	__atomic_fetch_add(&work->state, WORK_RUNNING - WORK_PENDING, __ATOMIC_ACQ_REL);
+	work->func(work->data);
+	__atomic_fetch_sub(&work->state, WORK_RUNNING, __ATOMIC_RELEASE);
+}
+
+static void wake_workers(unsigned self) {
+	unsigned count = smp_cpu_count();
+
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (self == 0 && __atomic_load_n(&work_cpus[0].idle, __ATOMIC_RELAXED))
+		thread_wake(boot_worker);
+	for (unsigned id = 1; id < count; id++) {
+		if (id != self && __atomic_load_n(&work_cpus[id].idle, __ATOMIC_RELAXED)) {
+			smp_kick(id);
+			break;
+		}
+	}
+}
+
+// Mark the CPU idle and sleep, unless work turns up in the meantime.
+// Returns with interrupts off; sleep is entered and left with them off.
+static void worker_idle(struct work_cpu* wc, void (*sleep)(void)) {
+	irq_disable();
+	__atomic_store_n(&wc->idle, true, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (!work_available())
+		sleep();
+	__atomic_store_n(&wc->idle, false, __ATOMIC_RELAXED);
+}
+
+static void halt(void) {
+	__asm__ volatile ("sti; hlt; cli" : : : "memory");
+}
+
+__attribute__((__noreturn__))
+static void worker_loop(void (*sleep)(void)) {
+	unsigned self = this_cpu()->id;
+	struct work_cpu* wc = &work_cpus[self];
+
+	for (;;) {
+		struct work* work = find_work(self);
+		if (work) {
+			run_work(work);
+			continue;
+		}
+		worker_idle(wc, sleep);
+		irq_enable();
+	}
+}
+
+static void boot_worker_main(void* arg) {
+	(void) arg;
+	worker_loop(thread_block);
+}
+
+static void cpu_worker_main(void* arg) {
+	(void) arg;
+	worker_loop(halt);
+}
+
+void workqueue_initialize(void) {
+	boot_worker = thread_create("worker", boot_worker_main, NULL, WORK_THREAD_PRIORITY);
+	if (!boot_worker)
+		abort();
+	for (unsigned id = 1; id < smp_cpu_count(); id++)
+		smp_call(id, cpu_worker_main, NULL);
+}
+
+void work_init(struct work* work, void (*func)(void* data), void* data) {
+	work->func = func;
+	work->data = data;
+	work->state = 0;
+	work->next = NULL;
+}
+
+bool queue_work(struct work* work) {
+	if (__atomic_fetch_or(&work->state, WORK_PENDING, __ATOMIC_ACQ_REL) & WORK_PENDING)
+		return false;
+
+	uint32_t eflags = irq_save();
+	unsigned self = this_cpu()->id;
+	struct work_cpu* wc = &work_cpus[self];
+	if (!deque_push(&wc->deque, work))
+		overflow_push(wc, work);
+	irq_restore(eflags);
+	// With interrupts back on, a woken worker thread of higher priority
+	// runs right away.
+	wake_workers(self);
+	return true;
+}
+
+void flush_work(struct work* work) {
+	while (__atomic_load_n(&work->state, __ATOMIC_ACQUIRE) != 0) {
+		if (this_cpu()->id == 0)
+			thread_sleep(WORK_FLUSH_POLL_NS);
+		else
+			cpu_relax();
+	}
+}
+
+#if KERNEL_SELFTEST
+// SELFTEST_ITEMS work items that each queue themselves again until they
+// have run SELFTEST_RUNS times: four million tiny items in all.
+#define SELFTEST_ITEMS 512
+#define SELFTEST_RUNS 8192
+#define SELFTEST_TIMEOUT_NS UINT64_C(1000000000)
+
+struct selftest_item {
+	struct work work;
+	unsigned left;
+};
+
+static struct selftest_item selftest_items[SELFTEST_ITEMS];
+static unsigned selftest_finished;
+static unsigned selftest_stopped;
+
+static void selftest_item_run(void* data) {
+	struct selftest_item* item = data;
+
+	if (--item->left > 0)
+		queue_work(&item->work);
+	else
+		__atomic_fetch_add(&selftest_finished, 1, __ATOMIC_RELEASE);
+}
+
+// worker_loop, but spinning instead of sleeping and returning once every
+// item has finished.
+static void selftest_worker(void* arg) {
+	unsigned self = this_cpu()->id;
+
+	(void) arg;
+	while (__atomic_load_n(&selftest_finished, __ATOMIC_ACQUIRE) < SELFTEST_ITEMS) {
+		struct work* work = find_work(self);
+		if (work)
+			run_work(work);
+		else
+			cpu_relax();
+	}
+	if (self != 0)
+		__atomic_fetch_add(&selftest_stopped, 1, __ATOMIC_RELEASE);
+}
+
+// Items run per millisecond with workers on CPUs 0 to cpus - 1. All items
+// start on the boot CPU's deque and the others steal them.
+static uint64_t selftest_throughput(unsigned cpus) {
+	selftest_finished = 0;
+	selftest_stopped = 0;
+	for (unsigned i = 0; i < SELFTEST_ITEMS; i++) {
+		selftest_items[i].left = SELFTEST_RUNS;
+		work_init(&selftest_items[i].work, selftest_item_run, &selftest_items[i]);
+		queue_work(&selftest_items[i].work);
+	}
+
+	uint64_t start = ktime_get_ns();
+	for (unsigned id = 1; id < cpus; id++) {
+		if (!smp_call(id, selftest_worker, NULL)) {
+			printf("workqueue: cpu %u would not take a call\n", id);
+			abort();
+		}
+	}
+	selftest_worker(NULL);
+	uint64_t elapsed = ktime_get_ns() - start;
+
+	uint64_t deadline = ktime_get_ns() + SELFTEST_TIMEOUT_NS;
+	while (__atomic_load_n(&selftest_stopped, __ATOMIC_ACQUIRE) < cpus - 1) {
+		if (ktime_get_ns() > deadline) {
+			printf("workqueue: a worker did not stop\n");
+			abort();
+		}
+		cpu_relax();
+	}
+	for (unsigned i = 0; i < SELFTEST_ITEMS; i++) {
+		if (selftest_items[i].left != 0 || selftest_items[i].work.state != 0) {
+			printf("workqueue: item %u left with %u runs to go, state %u\n", i, selftest_items[i].left,
+			       selftest_items[i].work.state);
+			abort();
+		}
+	}
+	return (uint64_t) SELFTEST_ITEMS * SELFTEST_RUNS * 1000000 / (elapsed ? elapsed : 1);
+}
+
+// Work items summing shares of a series, for the check of the real workers.
+#define SELFTEST_SHARES 64
+#define SELFTEST_TERMS (UINT64_C(1) << 22)
+
+struct selftest_share {
+	struct work work;
+	uint64_t first;
+	uint64_t end;
+	uint64_t sum;
+	unsigned cpu;
+};
+
+static struct selftest_share selftest_shares[SELFTEST_SHARES];
+
+static void selftest_share_run(void* data) {
+	struct selftest_share* share = data;
+	uint64_t sum = 0;
+
+	for (uint64_t i = share->first; i < share->end; i++)
+		sum += i;
+	share->sum = sum;
+	share->cpu = this_cpu()->id;
+}
+
+void workqueue_selftest_workers(void) {
+	uint64_t total = 0;
+	bool ran_on[MAX_CPUS] = { false };
+	unsigned cpus_used = 0;
+
+	// All queued before the boot CPU's worker can take any, so idle CPUs
+	// get the chance to steal.
+	preempt_disable();
+	for (unsigned i = 0; i < SELFTEST_SHARES; i++) {
+		struct selftest_share* share = &selftest_shares[i];
+		share->first = SELFTEST_TERMS * i / SELFTEST_SHARES;
+		share->end = SELFTEST_TERMS * (i + 1) / SELFTEST_SHARES;
+		work_init(&share->work, selftest_share_run, share);
+		queue_work(&share->work);
+	}
+	preempt_enable();
+
+	for (unsigned i = 0; i < SELFTEST_SHARES; i++) {
+		flush_work(&selftest_shares[i].work);
+		total += selftest_shares[i].sum;
+		if (!ran_on[selftest_shares[i].cpu]) {
+			ran_on[selftest_shares[i].cpu] = true;
+			cpus_used++;
+		}
+	}
+	if (total != SELFTEST_TERMS * (SELFTEST_TERMS - 1) / 2) {
+		printf("workqueue: %u items summed to %llu, expected %llu\n", SELFTEST_SHARES, total,
+		       SELFTEST_TERMS * (SELFTEST_TERMS - 1) / 2);
+		abort();
+	}
+	printf("workqueue: %u items ran on %u of %u CPUs\n", SELFTEST_SHARES, cpus_used, smp_cpu_count());
+}
+
+void workqueue_selftest(void) {
+	uint64_t one = 0;
+
+	printf("workqueue: %u tiny items, all queued on cpu 0\n", SELFTEST_ITEMS * SELFTEST_RUNS);
+	for (unsigned cpus = 1; cpus <= smp_cpu_count(); cpus++) {
+		uint64_t rate = selftest_throughput(cpus);
+		if (cpus == 1)
+			one = rate ? rate : 1;
+		uint64_t speedup = rate * 100 / one;
+		printf("workqueue: %2u CPUs: %8llu items per ms, %llu.%02llux one CPU\n", cpus, rate,
+		       speedup / 100, speedup % 100);
+	}
+}
+#endif
@@ -0,0 +1,76 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+void* __memcpy_word(void* __restrict, const void* __restrict, size_t);
+void* __memmove_word(void*, const void*, size_t);
+void* __memset_word(void*, int, size_t);
+int __memcmp_word(const void*, const void*, size_t);
+size_t __strlen_word(const char*);
+void* __memcpy_sse2(void* __restrict, const void* __restrict, size_t);
+void* __memmove_sse2(void*, const void*, size_t);
+void* __memset_sse2(void*, int, size_t);
+int __memcmp_sse2(const void*, const void*, size_t);
+size_t __strlen_sse2(const char*);
+
+#if defined(__is_libk)
+#include <kernel/smp.h>
+#endif
+
+// Until the kernel has checked the CPU, only the word versions are safe.
+static bool string_sse2;
+
+// Fills of at least this many bytes bypass the cache. Read by __memset_sse2.
+size_t __memset_nt_threshold = 256 * 1024;
+
+void __string_enable_sse2(size_t l2_cache_size) {
+	if (l2_cache_size != 0)
+		__memset_nt_threshold = l2_cache_size;
+	string_sse2 = true;
+}
+
+// A handler must not touch the xmm registers: they hold the interrupted
+// thread's values, or another thread's if that one has not used them yet,
+// and a #NM there would hand them to the wrong thread. Handlers get the
+// word versions.
+static inline bool use_sse2(void) {
+#if defined(__is_libk)
+	return string_sse2 && !in_interrupt();
+#else
+	return string_sse2;
+#endif
+}
+
+void* memcpy(void* restrict dstptr, const void* restrict srcptr, size_t size) {
+	if (use_sse2())
+		return __memcpy_sse2(dstptr, srcptr, size);
+	return __memcpy_word(dstptr, srcptr, size);
+}
+
+void* mempcpy(void* dstptr, const void* srcptr, size_t size) {
+	return (unsigned char*) memcpy(dstptr, srcptr, size) + size;
+}
+
+void* memmove(void* dstptr, const void* srcptr, size_t size) {
+	if (use_sse2())
+		return __memmove_sse2(dstptr, srcptr, size);
+	return __memmove_word(dstptr, srcptr, size);
+}
+
+void* memset(void* bufptr, int value, size_t size) {
+	if (use_sse2())
+		return __memset_sse2(bufptr, value, size);
+	return __memset_word(bufptr, value, size);
+}
+
+int memcmp(const void* aptr, const void* bptr, size_t size) {
+	if (use_sse2())
+		return __memcmp_sse2(aptr, bptr, size);
+	return __memcmp_word(aptr, bptr, size);
+}
+
+size_t strlen(const char* str) {
+	if (use_sse2())
+		return __strlen_sse2(str);
+	return __strlen_word(str);
+}
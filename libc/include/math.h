@@ -0,0 +1,71 @@
+#ifndef _MATH_H
+#define _MATH_H 1
+
+#include <sys/cdefs.h>
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HUGE_VAL (__builtin_huge_val())
+#define INFINITY (__builtin_inff())
+#define NAN (__builtin_nanf(""))
+
+#define M_E 2.71828182845904523536
+#define M_LN2 0.69314718055994530942
+#define M_LN10 2.30258509299404568402
+#define M_PI 3.14159265358979323846
+#define M_PI_2 1.57079632679489661923
+#define M_PI_4 0.78539816339744830962
+
+#define isnan(x) __builtin_isnan(x)
+#define isinf(x) __builtin_isinf(x)
+#define isfinite(x) __builtin_isfinite(x)
+#define signbit(x) __builtin_signbit(x)
+
+double acos(double);
+double asin(double);
+double atan(double);
+double atan2(double, double);
+double ceil(double);
+double cos(double);
+double exp(double);
+double fabs(double);
+float fabsf(float);
+long double fabsl(long double);
+double floor(double);
+double fmod(double, double);
+double log(double);
+double log10(double);
+double pow(double, double);
+double sin(double);
+double sqrt(double);
+double tan(double);
+
+/*
+ * y[i] = f(x[i]) for i < n. y may be x itself, but must not overlap it
+ * otherwise. Results may differ from the scalar functions' by an ulp or so.
+ */
+void vsin(double* y, const double* x, size_t n);
+void vcos(double* y, const double* x, size_t n);
+void vexp(double* y, const double* x, size_t n);
+void vlog(double* y, const double* x, size_t n);
+void vsqrt(double* y, const double* x, size_t n);
+void vsinf(float* y, const float* x, size_t n);
+void vcosf(float* y, const float* x, size_t n);
+void vexpf(float* y, const float* x, size_t n);
+void vlogf(float* y, const float* x, size_t n);
+void vsqrtf(float* y, const float* x, size_t n);
+
+#if defined(__is_libk) || defined(__is_kernel)
+/* Switch the array functions to their SSE2 versions. Only call once SSE has been enabled. */
+void __math_enable_sse2(void);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -3,18 +3,104 @@
 
 #include <sys/cdefs.h>
 #include <stdarg.h>
+#include <stddef.h>
 
 #define EOF (-1)
 
+#define BUFSIZ 256
+
+#define _IOFBF 0
+#define _IOLBF 1
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+typedef int (*pfnStreamWriteBuf)(const char*, size_t);
+
+/**
+ * @brief A structure representing a stream for writing data.
+ *
+ * This structure is used to manage a buffer for writing data to an output stream.
+ * It includes a buffer length, buffer index, buffer pointer, and a function pointer
+ * to a function that writes all data in the buffer to the output stream.
+ */
+struct Stream {
+    /**
+     * @brief The length of the buffer.
+     *
+     * This value represents the total size of the buffer in bytes.
+     */
+    size_t buf_len;
+
+    /**
+     * @brief The current index in the buffer.
+     *
+     * This value represents the position in the buffer where the next character
+     * will be written.
+     */
+    size_t buf_i;
+
+    /**
+     * @brief A pointer to the buffer.
+     *
+     * This pointer points to the beginning of the buffer where data will be stored.
+     */
+    char *buf;
+
+    /**
+     * @brief The buffering mode of the stream, _IOFBF or _IOLBF.
+     *
+     * A fully buffered stream is only written out when the buffer fills up or on
+     * fflush. A line buffered stream is additionally written out after every write
+     * that contains a newline.
+     */
+    int buf_mode;
+
+    /**
+     * @brief A function pointer to a function that writes all data in the buffer.
+     *
+     * This function pointer points to a function that takes a pointer to a character
+     * array (the buffer) and a length, and writes that many bytes to the output stream.
+     * The buffer is not null-terminated.
+     *
+     * @param buf A pointer to the buffer to be written.
+     * @param len The number of bytes to write.
+     * @return The number of bytes written to the output stream.
+     */
+    pfnStreamWriteBuf pfn_write_all;
+};
+
+
+extern struct Stream* stdout;
+
+int fflush(struct Stream*);
+int fputc(int, struct Stream*);
+size_t fwrite(const void* __restrict, size_t, size_t, struct Stream* __restrict);
 int printf(const char* __restrict, ...);
 int putchar(int);
 int puts(const char*);
+int vprintf(const char* __restrict, va_list);
 int vfprintf(struct Stream *, const char *, va_list);
 
+/**
+ * @brief Takes the lock that serializes every stream operation.
+ *
+ * In the kernel this is a spinlock taken with interrupts off, so a handler on the same
+ * CPU can never find it held; elsewhere it does nothing. A fault or abort() on the CPU
+ * that holds it, whose report goes through stdio again, gets through without the lock
+ * instead of deadlocking. The functions above take it for the length of the call, and
+ * the `_unlocked` versions below are for callers that already hold it.
+ *
+ * @return The state to pass to __stream_unlock.
+ */
+unsigned long __stream_lock(struct Stream *);
+void __stream_unlock(struct Stream *, unsigned long);
+
+int __fflush_unlocked(struct Stream *);
+int __fputc_unlocked(int, struct Stream *);
+size_t __fwrite_unlocked(const void* __restrict, size_t, size_t, struct Stream* __restrict);
+
 #ifdef __cplusplus
 }
 #endif
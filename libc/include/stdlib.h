@@ -3,6 +3,8 @@
 
 #include <sys/cdefs.h>
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -11,6 +13,54 @@ __attribute__((__noreturn__))
 void abort(void);
 char* itoa(int value, char*, int);
 
+#if defined(__is_libk) || defined(__is_kernel)
+// Kernel heap. kmalloc memory is 16-byte aligned, or 8-byte for requests of
+// 8 bytes or less. Blocks too big for the size-class slabs come straight from
+// the page frame allocator.
+void* kmalloc(size_t size);
+void kfree(void* ptr);
+
+// Caches of same-sized objects. The constructor, if any, runs once per object
+// when its slab is created, and objects must be freed in their constructed state.
+struct kmem_cache;
+struct kmem_cache* kmem_cache_create(const char* name, size_t size, size_t align,
+                                     void (*ctor)(void*));
+void kmem_cache_destroy(struct kmem_cache* cache);
+void* kmem_cache_alloc(struct kmem_cache* cache);
+void kmem_cache_free(struct kmem_cache* cache, void* obj);
+
+// Bump allocator for scratch memory that is all thrown away together. An
+// allocation moves a pointer; there is no per-object free, only a reset back
+// to a mark. A growing arena chains page blocks from the frame allocator once
+// its buffer is used up.
+struct arena_chunk;
+
+struct arena {
+	char* cur;
+	char* end;
+	char* buf;
+	char* buf_end;
+	struct arena_chunk* chunk; // most recent page block, or NULL
+	int grow;
+};
+
+struct arena_mark {
+	struct arena_chunk* chunk;
+	char* cur;
+};
+
+void arena_init(struct arena* arena, void* buf, size_t size);
+// Like arena_init, but the arena grows instead of failing. buf may be NULL.
+void arena_init_growing(struct arena* arena, void* buf, size_t size);
+// align must be a power of two. Returns NULL when the arena is full.
+void* arena_alloc(struct arena* arena, size_t size, size_t align);
+struct arena_mark arena_mark(const struct arena* arena);
+// Free everything allocated since the mark, including page blocks.
+void arena_reset(struct arena* arena, struct arena_mark mark);
+// Free everything, returning all page blocks.
+void arena_release(struct arena* arena);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
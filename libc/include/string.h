@@ -19,6 +19,11 @@ char *strcat(char *restrict, const char *restrict);
 char *strcpy(char *restrict, const char *restrict);
 size_t strlen(const char*);
 
+#if defined(__is_libk) || defined(__is_kernel)
+/* Switch mem* and strlen to their SSE2 versions. Only call once SSE has been enabled. */
+void __string_enable_sse2(size_t l2_cache_size);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
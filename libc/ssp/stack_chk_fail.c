@@ -1,4 +1,5 @@
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 
 #if UINT32_MAX == UINTPTR_MAX
@@ -12,9 +13,8 @@ uintptr_t __stack_chk_guard = STACK_CHK_GUARD;
 __attribute__((noreturn))
 void __stack_chk_fail(void)
 {
-#if __STDC_HOSTED__
-    abort();
-#elif __is_barebones_kernel
-    panic("Stack smashing detected");
+#if defined(__is_libk)
+    printf("kernel: panic: stack smashing detected\n");
 #endif
-}
\ No newline at end of file
+    abort();
+}
@@ -0,0 +1,36 @@
+#include <stdio.h>
+
+/**
+ * @brief Writes the content of the buffer to the output stream.
+ *
+ * This function writes exactly `stream->buf_i` bytes through `stream->pfn_write_all` and
+ * resets the buffer index. The buffer contents are left as they are; only the index matters.
+ * Passing NULL flushes stdout, the only stream there is.
+ *
+ * @param stream A pointer to the Stream structure containing the buffer and the function to write to the output stream.
+ * @return 0 on success, EOF if the stream did not take every byte.
+ */
+int __fflush_unlocked(struct Stream *stream) {
+    size_t len = stream->buf_i;
+
+    stream->buf_i = 0;
+    if (len == 0)
+        return 0;
+
+    if ((size_t)stream->pfn_write_all(stream->buf, len) != len) {
+        // We didn't write the entire usable portion of the buffer, for some reason.
+        return EOF;
+    }
+
+    return 0;
+}
+
+int fflush(struct Stream *stream) {
+    if (stream == NULL)
+        stream = stdout;
+
+    unsigned long state = __stream_lock(stream);
+    int ret = __fflush_unlocked(stream);
+    __stream_unlock(stream, state);
+    return ret;
+}
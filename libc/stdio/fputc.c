@@ -0,0 +1,31 @@
+#include <stdio.h>
+
+/**
+ * @brief Pushes a character to the buffer and flushes it if necessary.
+ *
+ * This function appends a character to the buffer. The buffer is flushed when that
+ * fills it, or when the character is a newline and the stream is line buffered.
+ *
+ * @param ic The character to be pushed to the buffer.
+ * @param stream A pointer to the Stream structure containing the buffer and the function to write to the output stream.
+ * @return The character written, or EOF on failure.
+ */
+int __fputc_unlocked(int ic, struct Stream *stream) {
+    unsigned char c = (unsigned char) ic;
+
+    stream->buf[stream->buf_i++] = (char) c;
+
+    if (stream->buf_i == stream->buf_len || (c == '\n' && stream->buf_mode == _IOLBF)) {
+        if (__fflush_unlocked(stream) != 0)
+            return EOF;
+    }
+
+    return c;
+}
+
+int fputc(int ic, struct Stream *stream) {
+    unsigned long state = __stream_lock(stream);
+    int ret = __fputc_unlocked(ic, stream);
+    __stream_unlock(stream, state);
+    return ret;
+}
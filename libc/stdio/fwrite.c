@@ -0,0 +1,57 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * @brief Pushes `size * count` bytes to the buffer, flushing it as often as necessary.
+ *
+ * The bytes are copied with `memcpy` in chunks as large as the free space in the buffer,
+ * so a long run costs one copy per buffer fill rather than one call per character. On a
+ * line buffered stream, a write that contains a newline is flushed before returning.
+ *
+ * @param ptr A pointer to the bytes to be pushed to the buffer. They do not need to be null-terminated.
+ * @param size The size of each item.
+ * @param count The number of items.
+ * @param stream A pointer to the Stream structure containing the buffer and the function to write to the output stream.
+ * @return The number of whole items written, which is less than `count` only on failure.
+ */
+size_t __fwrite_unlocked(const void* restrict ptr, size_t size, size_t count, struct Stream* restrict stream) {
+    const char *str = (const char *) ptr;
+    size_t total = size * count;
+    size_t len = total;
+    bool newline = false;
+
+    if (total == 0)
+        return count;
+
+    while (len != 0) {
+        size_t room = stream->buf_len - stream->buf_i;
+        size_t chunk = len < room ? len : room;
+        char *dst = stream->buf + stream->buf_i;
+
+        memcpy(dst, str, chunk);
+        stream->buf_i += chunk;
+        str += chunk;
+        len -= chunk;
+
+        if (stream->buf_mode == _IOLBF) {
+            for (size_t i = 0; i < chunk && !newline; i++)
+                newline = dst[i] == '\n';
+        }
+
+        if (stream->buf_i == stream->buf_len && __fflush_unlocked(stream) != 0)
+            return (total - len - chunk) / size;
+    }
+
+    if (newline && __fflush_unlocked(stream) != 0)
+        return 0;
+
+    return count;
+}
+
+size_t fwrite(const void* restrict ptr, size_t size, size_t count, struct Stream* restrict stream) {
+    unsigned long state = __stream_lock(stream);
+    size_t ret = __fwrite_unlocked(ptr, size, count, stream);
+    __stream_unlock(stream, state);
+    return ret;
+}
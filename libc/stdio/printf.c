@@ -1,304 +1,795 @@
 #include <limits.h>
 #include <stdbool.h>
 #include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
-double pow10(int n) {
-    double result = 1.0;
-    if (n >= 0) {
-        for (int i = 0; i < n; i++) {
-            result *= 10.0;
-        }
+#define FLAG_LEFT  (1u << 0) /* '-' */
+#define FLAG_PLUS  (1u << 1) /* '+' */
+#define FLAG_SPACE (1u << 2) /* ' ' */
+#define FLAG_ALT   (1u << 3) /* '#' */
+#define FLAG_ZERO  (1u << 4) /* '0' */
+#define FLAG_UPPER (1u << 5) /* set by the conversion, not by the format */
+
+enum length_modifier {
+    LEN_NONE,
+    LEN_HH,
+    LEN_H,
+    LEN_L,
+    LEN_LL,
+    LEN_J,
+    LEN_Z,
+    LEN_T,
+    LEN_BIG_L,
+};
+
+/**
+ * @brief One conversion specification, parsed once from the format string.
+ */
+struct format_spec {
+    unsigned flags;
+    int width;
+    int precision; /* -1 when the format does not give one */
+    enum length_modifier length;
+    char conversion;
+    unsigned base; /* integer conversions only */
+};
+
+struct output {
+    struct Stream* stream;
+    size_t written;
+    bool error;
+};
+
+typedef void (*convert_fn)(struct output*, struct format_spec*, va_list*);
+
+struct conversion {
+    convert_fn convert;
+    unsigned char base;
+    bool upper;
+};
+
+static void output_write(struct output* out, const char* data, size_t length) {
+    if (length != 0 && __fwrite_unlocked(data, 1, length, out->stream) != length)
+        out->error = true;
+    out->written += length;
+}
+
+static void output_pad(struct output* out, char c, size_t count) {
+    static const char spaces[32] = "                                ";
+    static const char zeros[32] = "00000000000000000000000000000000";
+    const char* fill = c == '0' ? zeros : spaces;
+
+    while (count != 0) {
+        size_t chunk = count < sizeof(spaces) ? count : sizeof(spaces);
+        output_write(out, fill, chunk);
+        count -= chunk;
+    }
+}
+
+static size_t field_fill(const struct format_spec* spec, size_t length) {
+    return (size_t) spec->width > length ? (size_t) spec->width - length : 0;
+}
+
+/**
+ * @brief Writes the padding that goes before a field, and the field's prefix.
+ *
+ * The prefix (a sign, "0x", ...) goes before zero padding but after space padding,
+ * so "%+05d" gives "+0042" and "%+5d" gives "  +42".
+ *
+ * @param length The length of the whole field, prefix included.
+ */
+static void field_begin(struct output* out, const struct format_spec* spec, size_t length,
+                        const char* prefix, size_t prefix_length) {
+    size_t fill = field_fill(spec, length);
+
+    if (!(spec->flags & (FLAG_LEFT | FLAG_ZERO)))
+        output_pad(out, ' ', fill);
+    output_write(out, prefix, prefix_length);
+    if (spec->flags & FLAG_ZERO)
+        output_pad(out, '0', fill);
+}
+
+static void field_end(struct output* out, const struct format_spec* spec, size_t length) {
+    if (spec->flags & FLAG_LEFT)
+        output_pad(out, ' ', field_fill(spec, length));
+}
+
+static void emit_field(struct output* out, struct format_spec* spec, const char* data, size_t length) {
+    spec->flags &= ~FLAG_ZERO;
+    field_begin(out, spec, length, NULL, 0);
+    output_write(out, data, length);
+    field_end(out, spec, length);
+}
+
+/* "00" "01" ... "99": two decimal digits per division. */
+static const char digit_pairs[200] =
+    "00010203040506070809" "10111213141516171819" "20212223242526272829"
+    "30313233343536373839" "40414243444546474849" "50515253545556575859"
+    "60616263646566676869" "70717273747576777879" "80818283848586878889"
+    "90919293949596979899";
+
+/**
+ * @brief Formats `value` in decimal into the bytes just before `end`.
+ *
+ * @return A pointer to the first digit.
+ */
+static char* format_dec32(uint32_t value, char* end) {
+    while (value >= 100) {
+        uint32_t quotient = value / 100;
+        const char* pair = &digit_pairs[(value - quotient * 100) * 2];
+        *--end = pair[1];
+        *--end = pair[0];
+        value = quotient;
+    }
+    if (value >= 10) {
+        *--end = digit_pairs[value * 2 + 1];
+        *--end = digit_pairs[value * 2];
     } else {
-        for (int i = 0; i < -n; i++) {
-            result /= 10.0;
-        }
+        *--end = (char) ('0' + value);
     }
-    return result;
+    return end;
 }
 
-double log10(double x) {
-    double lower = 0, upper = x, mid = 0;
-    while (upper - lower > 1e-6) { // Continue until the desired precision is reached
-        mid = (lower + upper) / 2;
-        if (pow10(mid) > x) {
-            upper = mid;
-        } else {
-            lower = mid;
+/**
+ * @brief Formats `value` in base 8, 10 or 16 into the bytes just before `end`.
+ *
+ * Decimal values wider than 32 bits are split into 9-digit chunks, so the
+ * 64-bit division only runs once per chunk instead of once per digit.
+ *
+ * @return A pointer to the first digit.
+ */
+static char* format_unsigned(uintmax_t value, unsigned base, bool upper, char* end) {
+    if (base == 10) {
+        while (value > UINT32_MAX) {
+            uintmax_t quotient = value / 1000000000u;
+            char* chunk = end - 9;
+
+            end = format_dec32((uint32_t) (value - quotient * 1000000000u), end);
+            while (end > chunk)
+                *--end = '0';
+            value = quotient;
         }
+        return format_dec32((uint32_t) value, end);
     }
-    return mid;
+
+    const char* digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    unsigned shift = base == 16 ? 4 : 3;
+
+    do {
+        *--end = digits[value & (base - 1)];
+        value >>= shift;
+    } while (value != 0);
+    return end;
 }
 
-double fabs(double x) {
-    if (x < 0) {
-        return -x;
-    } else {
-        return x;
+/* Enough for a 64-bit value in octal. */
+#define INT_BUF_SIZE 24
+
+/**
+ * @brief Writes an integer field: padding, prefix, precision zeros, then the digits.
+ *
+ * @param leading_zero Forces at least one leading zero, for "%#o".
+ */
+static void emit_integer(struct output* out, struct format_spec* spec, const char* prefix,
+                         size_t prefix_length, const char* digits, size_t length, bool leading_zero) {
+    size_t zeros = 0;
+
+    if (spec->precision >= 0) {
+        spec->flags &= ~FLAG_ZERO;
+        if (spec->precision == 0 && length == 1 && digits[0] == '0')
+            length = 0;
+        if ((size_t) spec->precision > length)
+            zeros = (size_t) spec->precision - length;
     }
+    if (leading_zero && zeros == 0 && (length == 0 || digits[0] != '0'))
+        zeros = 1;
+
+    size_t total = prefix_length + zeros + length;
+    field_begin(out, spec, total, prefix, prefix_length);
+    output_pad(out, '0', zeros);
+    output_write(out, digits, length);
+    field_end(out, spec, total);
 }
 
-char* itoa(int value, char* str, int base) {
-    char* ptr = str, *ptr1 = str, tmp_char;
-    int tmp_value;
+static uintmax_t fetch_unsigned(enum length_modifier length, va_list* ap) {
+    switch (length) {
+    case LEN_HH: return (unsigned char) va_arg(*ap, unsigned int);
+    case LEN_H: return (unsigned short) va_arg(*ap, unsigned int);
+    case LEN_L: return va_arg(*ap, unsigned long);
+    case LEN_LL: return va_arg(*ap, unsigned long long);
+    case LEN_J: return va_arg(*ap, uintmax_t);
+    case LEN_Z: return va_arg(*ap, size_t);
+    case LEN_T: return (size_t) va_arg(*ap, ptrdiff_t);
+    default: return va_arg(*ap, unsigned int);
+    }
+}
 
-    do {
-        tmp_value = value;
-        value /= base;
-        *ptr++ = "fedcba9876543210123456789abcdef"[15 + (tmp_value - value * base)];
-    } while (value);
-
-    // Apply negative sign
-    if (tmp_value < 0) *ptr++ = '-';
-    *ptr-- = '\0';
-    while (ptr1 < ptr) {
-        tmp_char = *ptr;
-        *ptr-- = *ptr1;
-        *ptr1++ = tmp_char;
+static intmax_t fetch_signed(enum length_modifier length, va_list* ap) {
+    switch (length) {
+    case LEN_HH: return (signed char) va_arg(*ap, int);
+    case LEN_H: return (short) va_arg(*ap, int);
+    case LEN_L: return va_arg(*ap, long);
+    case LEN_LL: return va_arg(*ap, long long);
+    case LEN_J: return va_arg(*ap, intmax_t);
+    case LEN_Z: return (ptrdiff_t) va_arg(*ap, size_t);
+    case LEN_T: return va_arg(*ap, ptrdiff_t);
+    default: return va_arg(*ap, int);
     }
-    return str;
 }
 
+static void convert_signed(struct output* out, struct format_spec* spec, va_list* ap) {
+    intmax_t value = fetch_signed(spec->length, ap);
+    uintmax_t magnitude = value < 0 ? -(uintmax_t) value : (uintmax_t) value;
+    char buf[INT_BUF_SIZE];
+    char* digits = format_unsigned(magnitude, 10, false, buf + sizeof(buf));
+    char sign = value < 0 ? '-' : spec->flags & FLAG_PLUS ? '+' : ' ';
+    bool has_sign = value < 0 || spec->flags & (FLAG_PLUS | FLAG_SPACE);
 
+    emit_integer(out, spec, &sign, has_sign, digits, buf + sizeof(buf) - digits, false);
+}
+
+static void convert_unsigned(struct output* out, struct format_spec* spec, va_list* ap) {
+    uintmax_t value = fetch_unsigned(spec->length, ap);
+    bool upper = spec->flags & FLAG_UPPER;
+    char buf[INT_BUF_SIZE];
+    char* digits = format_unsigned(value, spec->base, upper, buf + sizeof(buf));
+    bool alt = spec->flags & FLAG_ALT;
+    size_t prefix_length = alt && spec->base == 16 && value != 0 ? 2 : 0;
 
+    emit_integer(out, spec, upper ? "0X" : "0x", prefix_length, digits, buf + sizeof(buf) - digits,
+                 alt && spec->base == 8);
+}
 
+static void convert_pointer(struct output* out, struct format_spec* spec, va_list* ap) {
+    uintptr_t value = (uintptr_t) va_arg(*ap, void*);
+    char buf[INT_BUF_SIZE];
+    char* digits;
 
-static bool print(const char* data, size_t length) {
-	const unsigned char* bytes = (const unsigned char*) data;
-	for (size_t i = 0; i < length; i++)
-		if (putchar(bytes[i]) == EOF)
-			return false;
-	return true;
+    if (value == 0) {
+        emit_field(out, spec, "(nil)", 5);
+        return;
+    }
+    digits = format_unsigned(value, 16, false, buf + sizeof(buf));
+    emit_integer(out, spec, "0x", 2, digits, buf + sizeof(buf) - digits, false);
 }
 
-int print_char(va_list parameters) {
-    char c = (char) va_arg(parameters, int);
-    return print(&c, sizeof(c));
+static void convert_char(struct output* out, struct format_spec* spec, va_list* ap) {
+    char c = (char) va_arg(*ap, int);
+    emit_field(out, spec, &c, 1);
 }
 
-int print_string(va_list parameters) {
-    const char* str = va_arg(parameters, const char*);
-    return print(str, strlen(str));
+static void convert_string(struct output* out, struct format_spec* spec, va_list* ap) {
+    const char* str = va_arg(*ap, const char*);
+    size_t length = 0;
+
+    if (str == NULL)
+        str = spec->precision < 0 || spec->precision >= 6 ? "(null)" : "";
+    if (spec->precision < 0) {
+        length = strlen(str);
+    } else {
+        while (length < (size_t) spec->precision && str[length] != '\0')
+            length++;
+    }
+    emit_field(out, spec, str, length);
 }
 
-int print_int(va_list parameters) {
-    int i = va_arg(parameters, int);
-    char str[12]; // Buffer big enough for an integer
-    itoa(i, str, 10);
-    return print(str, strlen(str));
+static void convert_count(struct output* out, struct format_spec* spec, va_list* ap) {
+    size_t n = out->written;
+
+    switch (spec->length) {
+    case LEN_HH: *va_arg(*ap, signed char*) = (signed char) n; break;
+    case LEN_H: *va_arg(*ap, short*) = (short) n; break;
+    case LEN_L: *va_arg(*ap, long*) = (long) n; break;
+    case LEN_LL: *va_arg(*ap, long long*) = (long long) n; break;
+    case LEN_J: *va_arg(*ap, intmax_t*) = (intmax_t) n; break;
+    case LEN_Z: *va_arg(*ap, size_t*) = n; break;
+    case LEN_T: *va_arg(*ap, ptrdiff_t*) = (ptrdiff_t) n; break;
+    default: *va_arg(*ap, int*) = (int) n; break;
+    }
 }
 
-int print_unsigned_int(va_list parameters) {
-    unsigned int u = va_arg(parameters, unsigned int);
-    char str[12]; // Buffer big enough for an unsigned integer
-    itoa(u, str, 10);
-    return print(str, strlen(str));
+static void convert_percent(struct output* out, struct format_spec* spec, va_list* ap) {
+    (void) spec;
+    (void) ap;
+    output_write(out, "%", 1);
 }
 
-int print_hex(va_list parameters) {
-    int x = va_arg(parameters, int);
-    char str[12]; // Buffer big enough for an integer in hexadecimal
-    itoa(x, str, 16);
-    return print(str, strlen(str));
+/*
+ * Floating point conversions.
+ *
+ * A finite double is mantissa * 2^e2 with a 53-bit integer mantissa, so its exact
+ * decimal expansion is finite: at most 309 integer digits and 1074 fractional ones.
+ * It is built in base 10^9 limbs by shifting the mantissa left or right a few bits
+ * at a time, using only integer arithmetic, and then rounded half-to-even at the
+ * requested digit. The output is therefore exact for every precision, the same as
+ * glibc's, without any floating point multiplications.
+ */
+
+#define LIMB_BASE 1000000000u
+#define LIMB_DIGITS 9
+/* 309 integer digits, plus one limb of rounding carry and one of slack. */
+#define INT_LIMBS 37
+/* 1074 fractional digits, plus one limb of slack. */
+#define FRAC_LIMBS 121
+/* Digits past the exact expansion are all zeros, so rounding never looks further. */
+#define EXACT_DIGITS (FRAC_LIMBS * LIMB_DIGITS)
+
+static const uint32_t pow10_u32[10] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000,
+};
+
+/**
+ * @brief The decimal expansion of a double, in base 10^9 limbs, most significant first.
+ *
+ * Limbs before `r` hold the integer part and limbs from `r` on the fraction. Only
+ * [a, z) may be non-zero; everything outside of it reads as zero.
+ */
+struct decimal {
+    uint32_t limb[INT_LIMBS + FRAC_LIMBS];
+    uint32_t* a;
+    uint32_t* z;
+    uint32_t* r;
+    bool sticky; /* non-zero digits were dropped past z */
+};
+
+/**
+ * @brief Divides `x` by 10^9, storing the remainder in `*rem`.
+ *
+ * The quotient must fit in 32 bits, which lets i386 use a single divl instead of
+ * a libgcc 64-bit division.
+ */
+static inline uint32_t divmod_limb(uint64_t x, uint32_t* rem) {
+#if defined(__i386__)
+    uint32_t quotient, remainder;
+    __asm__ ("divl %4"
+             : "=a"(quotient), "=d"(remainder)
+             : "a"((uint32_t) x), "d"((uint32_t) (x >> 32)), "rm"(LIMB_BASE));
+    *rem = remainder;
+    return quotient;
+#else
+    *rem = (uint32_t) (x % LIMB_BASE);
+    return (uint32_t) (x / LIMB_BASE);
+#endif
 }
 
-int print_oct(va_list parameters) {
-    int o = va_arg(parameters, int);
-    char str[12]; // Buffer big enough for an integer in octal
-    itoa(o, str, 8);
-    return print(str, strlen(str));
+static int limb_digits(uint32_t limb) {
+    int n = 1;
+    while (n < LIMB_DIGITS && limb >= pow10_u32[n])
+        n++;
+    return n;
 }
 
-int print_ptr(va_list parameters) {
-    void* p = va_arg(parameters, void*);
-    char str[20]; // Buffer big enough for a pointer
-    itoa(*(int *)p, str, 16);
-    return print(str, strlen(str));
+/**
+ * @brief Builds the expansion of mantissa * 2^e2.
+ *
+ * Fraction limbs past `keep` are dropped as they appear, and only `sticky` remembers
+ * them. That bounds the work for tiny values printed with a small precision. The
+ * cut is at a fixed place, so the limbs that are kept stay exact: bits only ever
+ * move from a limb into the ones after it.
+ */
+static void decimal_set(struct decimal* dec, uint64_t mantissa, int e2, long keep) {
+    memset(dec->limb, 0, sizeof(dec->limb));
+    dec->r = dec->limb + INT_LIMBS;
+    dec->z = dec->r;
+    dec->a = dec->r;
+    dec->sticky = false;
+    if (mantissa == 0)
+        return;
+
+    dec->r[-2] = divmod_limb(mantissa, &dec->r[-1]);
+    dec->a = dec->r[-2] != 0 ? dec->r - 2 : dec->r - 1;
+
+    while (e2 > 0) {
+        int shift = e2 < 29 ? e2 : 29;
+        uint32_t carry = 0;
+
+        for (uint32_t* d = dec->z; d-- > dec->a;)
+            carry = divmod_limb(((uint64_t) *d << shift) + carry, d);
+        if (carry != 0)
+            *--dec->a = carry;
+        e2 -= shift;
+    }
+
+    while (e2 < 0) {
+        int shift = -e2 < LIMB_DIGITS ? -e2 : LIMB_DIGITS;
+        uint32_t mask = (1u << shift) - 1;
+        uint32_t scale = LIMB_BASE >> shift;
+        uint32_t carry = 0;
+
+        for (uint32_t* d = dec->a; d < dec->z; d++) {
+            uint32_t rem = *d & mask;
+            *d = (*d >> shift) + carry;
+            carry = scale * rem;
+        }
+        if (*dec->a == 0)
+            dec->a++;
+        if (carry != 0)
+            *dec->z++ = carry;
+        e2 += shift;
+
+        if (dec->z - dec->r > keep) {
+            for (uint32_t* d = dec->r + keep; d < dec->z; d++)
+                dec->sticky |= *d != 0;
+            dec->z = dec->r + keep;
+            if (dec->z <= dec->a) {
+                /* Everything left is below the requested precision. */
+                dec->a = dec->z;
+                return;
+            }
+        }
+    }
 }
 
-int print_percent(va_list parameters) {
-    (void ) parameters;
-    return print("%", 1);
+/* Splits digit position k (0 is the first digit after the point) into limb and offset. */
+static long digit_limb(long k, unsigned* pos) {
+    long i = k >= 0 ? k / LIMB_DIGITS : -((LIMB_DIGITS - 1 - k) / LIMB_DIGITS);
+    *pos = (unsigned) (k - i * LIMB_DIGITS);
+    return i;
 }
 
-int print_float(va_list parameters) {
-    double f = va_arg(parameters, double);
-    int integer_part = (int)f;
-    double fractional_part = f - integer_part;
-
-    char str[64]; // Buffer big enough for a floating point number
-    itoa(integer_part, str, 10);
-
-    // Add decimal point
-    int len = strlen(str);
-    str[len] = '.';
-    str[len + 1] = '\0';
-
-    // Convert fractional part to string
-    for (int i = 0; i < 6; i++) { // Print up to 6 decimal places
-        fractional_part *= 10;
-        int digit = (int)fractional_part;
-        str[len + 1 + i] = '0' + digit;
-        fractional_part -= digit;
+/**
+ * @brief Rounds half-to-even so that only the digits before position k remain.
+ */
+static void decimal_round(struct decimal* dec, long k) {
+    unsigned pos;
+    long i = digit_limb(k, &pos);
+
+    if (dec->a == dec->z || i >= dec->z - dec->r)
+        return;
+
+    uint32_t* limb = dec->r + i;
+    uint32_t value = limb >= dec->a ? *limb : 0;
+    uint32_t unit = pow10_u32[LIMB_DIGITS - pos];
+    uint32_t dropped = value % unit;
+    bool round_up = dropped > unit / 2;
+
+    if (dropped == unit / 2) {
+        bool tail = dec->sticky;
+        for (uint32_t* d = limb + 1; !tail && d < dec->z; d++)
+            tail = *d != 0;
+        if (tail)
+            round_up = true;
+        else if (pos != 0)
+            round_up = (value / unit) & 1;
+        else
+            round_up = limb - 1 >= dec->a && (limb[-1] & 1);
     }
 
-    return print(str, strlen(str));
-}
+    dec->sticky = false;
+    if (pos == 0) {
+        dec->z = limb;
+    } else {
+        if (limb >= dec->a)
+            *limb = value - dropped;
+        dec->z = limb + 1;
+    }
 
-int print_exp(va_list parameters) {
-    double e = va_arg(parameters, double);
-    int exponent = (int)log10(fabs(e));
-    double mantissa = e / pow10(exponent);
-
-    char str[64]; // Buffer big enough for a floating point number
-    itoa((int)mantissa, str, 10);
-
-    // Add decimal point
-    int len = strlen(str);
-    str[len] = '.';
-    str[len + 1] = '\0';
-
-    // Convert fractional part to string
-    double fractional_part = mantissa - (int)mantissa;
-    for (int i = 0; i < 6; i++) { // Print up to 6 decimal places
-        fractional_part *= 10;
-        int digit = (int)fractional_part;
-        str[len + 1 + i] = '0' + digit;
-        fractional_part -= digit;
+    if (round_up) {
+        /* Limbs before a are zero, so the carry can run into them freely. */
+        uint32_t* d = pos != 0 ? limb : limb - 1;
+        *d += pos != 0 ? unit : 1;
+        if (d < dec->a)
+            dec->a = d;
+        while (*d >= LIMB_BASE) {
+            *d -= LIMB_BASE;
+            d--;
+            (*d)++;
+            if (d < dec->a)
+                dec->a = d;
+        }
     }
 
-    // Add exponent part
-    len = strlen(str);
-    str[len] = 'e';
-    str[len + 1] = '+';
-    itoa(exponent, str + len + 2, 10);
+    while (dec->z > dec->a && dec->z[-1] == 0)
+        dec->z--;
+    while (dec->a < dec->z && *dec->a == 0)
+        dec->a++;
+    if (dec->z < dec->a)
+        dec->a = dec->z;
+}
 
-    return print(str, strlen(str));
+/* The decimal exponent of the first significant digit. The value must not be zero. */
+static long decimal_exponent(const struct decimal* dec) {
+    return LIMB_DIGITS * (dec->r - dec->a - 1) + limb_digits(*dec->a) - 1;
 }
 
-int print_g(va_list parameters) {
-    double g = va_arg(parameters, double);
-    int exponent = (int)log10(fabs(g));
+/* The position of the last non-zero digit. The value must not be zero. */
+static long decimal_last_digit(const struct decimal* dec) {
+    const uint32_t* limb = dec->z - 1;
 
-    if (exponent < -4 || exponent >= 6) {
-        // Use exponential notation
-        return print_exp(parameters);
-    } else {
-        // Use fixed-point notation
-        return print_float(parameters);
+    while (*limb == 0)
+        limb--;
+
+    uint32_t last = *limb;
+    long k = LIMB_DIGITS * (limb - dec->r) + LIMB_DIGITS - 1;
+
+    while (last % 10 == 0) {
+        last /= 10;
+        k--;
     }
+    return k;
 }
 
-int print_E(va_list parameters) {
-    double e = va_arg(parameters, double);
-    int integer_part = (int)e;
-    double fractional_part = e - integer_part;
-
-    char str[64]; // Buffer big enough for a floating point number
-    itoa(integer_part, str, 10);
-
-    // Add decimal point
-    int len = strlen(str);
-    str[len] = '.';
-    str[len + 1] = '\0';
-
-    // Convert fractional part to string
-    for (int i = 0; i < 6; i++) { // Print up to 6 decimal places
-        fractional_part *= 10;
-        int digit = (int)fractional_part;
-        str[len + 1 + i] = '0' + digit;
-        fractional_part -= digit;
-    }
+/* Writes the digits at positions [from, to). */
+static void emit_digits(struct output* out, const struct decimal* dec, long from, long to) {
+    char buf[LIMB_DIGITS];
 
-    // Add exponent part
-    len = strlen(str);
-    str[len] = 'E';
-    str[len + 1] = '+';
-    itoa(0, str + len + 2, 10); // Assuming the exponent is 0 for simplicity
+    while (from < to) {
+        unsigned pos;
+        long i = digit_limb(from, &pos);
+        size_t n = LIMB_DIGITS - pos;
 
-    return print(str, strlen(str));
+        if (i >= dec->z - dec->r) {
+            output_pad(out, '0', (size_t) (to - from));
+            return;
+        }
+        if ((long) n > to - from)
+            n = (size_t) (to - from);
+        if (dec->r + i < dec->a) {
+            output_pad(out, '0', n);
+        } else {
+            char* p = format_dec32(dec->r[i], buf + LIMB_DIGITS);
+            while (p > buf)
+                *--p = '0';
+            output_write(out, buf + pos, n);
+        }
+        from += (long) n;
+    }
 }
 
-int print_G(va_list parameters) {
-    double g = va_arg(parameters, double);
-    int exponent = (int)log10(fabs(g));
+static void convert_float(struct output* out, struct format_spec* spec, va_list* ap) {
+    double value = spec->length == LEN_BIG_L ? (double) va_arg(*ap, long double) : va_arg(*ap, double);
+    union {
+        double d;
+        uint64_t u;
+    } bits = { .d = value };
+    bool upper = spec->flags & FLAG_UPPER;
+    char conversion = spec->conversion | 0x20;
+    unsigned biased = (unsigned) (bits.u >> 52) & 0x7ff;
+    uint64_t mantissa = bits.u & ((UINT64_C(1) << 52) - 1);
+    char sign = bits.u >> 63 ? '-' : spec->flags & FLAG_PLUS ? '+' : ' ';
+    size_t sign_length = bits.u >> 63 || spec->flags & (FLAG_PLUS | FLAG_SPACE) ? 1 : 0;
+
+    if (biased == 0x7ff) {
+        const char* text = mantissa != 0 ? (upper ? "NAN" : "nan") : (upper ? "INF" : "inf");
+        spec->flags &= ~FLAG_ZERO;
+        field_begin(out, spec, sign_length + 3, &sign, sign_length);
+        output_write(out, text, 3);
+        field_end(out, spec, sign_length + 3);
+        return;
+    }
 
-    if (exponent < -4 || exponent >= 6) {
-        // Use exponential notation
-        return print_E(parameters);
+    int e2 = biased != 0 ? (int) biased - 1075 : -1074;
+    if (biased != 0)
+        mantissa |= UINT64_C(1) << 52;
+
+    long precision = spec->precision < 0 ? 6 : spec->precision;
+    if (conversion == 'g' && precision == 0)
+        precision = 1;
+    long exact = precision < EXACT_DIGITS ? precision : EXACT_DIGITS;
+
+    /*
+     * The last digit rounding looks at is exact + 1 places after the point for "%f",
+     * and exact + 1 - e places for "%e", where e >= e_low is at most one less than
+     * log10(2) * (e2 + the mantissa's bit length - 1).
+     */
+    long last = exact + 1;
+    if (conversion != 'f' && mantissa != 0) {
+        long log2 = e2 + 63 - __builtin_clzll(mantissa);
+        long e_low = (log2 >= 0 ? log2 * 78913 / 262144 : -((-log2 * 78913 + 262143) / 262144)) - 1;
+        last -= e_low;
+    }
+
+    struct decimal dec;
+    decimal_set(&dec, mantissa, e2, last > 0 ? last / LIMB_DIGITS + 1 : 1);
+
+    long e = dec.a != dec.z ? decimal_exponent(&dec) : 0;
+    if (conversion == 'f')
+        decimal_round(&dec, exact);
+    else if (conversion == 'e')
+        decimal_round(&dec, exact - e);
+    else
+        decimal_round(&dec, exact - 1 - e);
+    bool zero = dec.a == dec.z;
+    e = zero ? 0 : decimal_exponent(&dec);
+
+    if (conversion == 'g') {
+        if (precision > e && e >= -4) {
+            conversion = 'f';
+            precision -= e + 1;
+        } else {
+            conversion = 'e';
+            precision -= 1;
+        }
+        if (!(spec->flags & FLAG_ALT)) {
+            long significant = zero ? 0 : decimal_last_digit(&dec) + (conversion == 'f' ? 1 : e + 1);
+            if (significant < precision)
+                precision = significant > 0 ? significant : 0;
+        }
+    }
+
+    bool point = precision != 0 || spec->flags & FLAG_ALT;
+    char exp_buf[8];
+    char* exp_digits = exp_buf + sizeof(exp_buf);
+    long int_digits = 1;
+    size_t length;
+
+    if (conversion == 'f') {
+        if (!zero && dec.a < dec.r)
+            int_digits = LIMB_DIGITS * (dec.r - dec.a - 1) + limb_digits(*dec.a);
+        length = (size_t) int_digits;
     } else {
-        // Use fixed-point notation
-        return print_float(parameters);
+        exp_digits = format_dec32((uint32_t) (e < 0 ? -e : e), exp_digits);
+        if (exp_digits > exp_buf + sizeof(exp_buf) - 2)
+            *--exp_digits = '0';
+        *--exp_digits = e < 0 ? '-' : '+';
+        *--exp_digits = upper ? 'E' : 'e';
+        length = 1 + (size_t) (exp_buf + sizeof(exp_buf) - exp_digits);
     }
+    length += sign_length + point + (size_t) precision;
+
+    field_begin(out, spec, length, &sign, sign_length);
+    if (conversion == 'f') {
+        if (!zero && dec.a < dec.r)
+            emit_digits(out, &dec, -int_digits, 0);
+        else
+            output_write(out, "0", 1);
+        if (point)
+            output_write(out, ".", 1);
+        emit_digits(out, &dec, 0, precision);
+    } else {
+        long first = -e - 1;
+        emit_digits(out, &dec, first, first + 1);
+        if (point)
+            output_write(out, ".", 1);
+        emit_digits(out, &dec, first + 1, first + 1 + precision);
+        output_write(out, exp_digits, (size_t) (exp_buf + sizeof(exp_buf) - exp_digits));
+    }
+    field_end(out, spec, length);
 }
 
-int printf(const char* restrict format, ...) {
-    va_list parameters;
-    va_start(parameters, format);
+/* Conversion characters outside of this table are copied to the output as they are. */
+static const struct conversion conversions[128] = {
+    ['d'] = { convert_signed, 10, false },
+    ['i'] = { convert_signed, 10, false },
+    ['u'] = { convert_unsigned, 10, false },
+    ['o'] = { convert_unsigned, 8, false },
+    ['x'] = { convert_unsigned, 16, false },
+    ['X'] = { convert_unsigned, 16, true },
+    ['p'] = { convert_pointer, 16, false },
+    ['c'] = { convert_char, 0, false },
+    ['s'] = { convert_string, 0, false },
+    ['f'] = { convert_float, 0, false },
+    ['F'] = { convert_float, 0, true },
+    ['e'] = { convert_float, 0, false },
+    ['E'] = { convert_float, 0, true },
+    ['g'] = { convert_float, 0, false },
+    ['G'] = { convert_float, 0, true },
+    ['n'] = { convert_count, 0, false },
+    ['%'] = { convert_percent, 0, false },
+};
+
+static int parse_number(const char** format) {
+    int n = 0;
+
+    while (**format >= '0' && **format <= '9') {
+        int digit = *(*format)++ - '0';
+        n = n > (INT_MAX - digit) / 10 ? INT_MAX : n * 10 + digit;
+    }
+    return n;
+}
 
-    int written = 0;
+/**
+ * @brief Parses the specification that follows a '%'.
+ *
+ * @return A pointer just past the conversion character.
+ */
+static const char* parse_spec(const char* format, struct format_spec* spec, va_list* ap) {
+    spec->flags = 0;
+    spec->width = 0;
+    spec->precision = -1;
+    spec->length = LEN_NONE;
+
+    for (;; format++) {
+        if (*format == '-') spec->flags |= FLAG_LEFT;
+        else if (*format == '+') spec->flags |= FLAG_PLUS;
+        else if (*format == ' ') spec->flags |= FLAG_SPACE;
+        else if (*format == '#') spec->flags |= FLAG_ALT;
+        else if (*format == '0') spec->flags |= FLAG_ZERO;
+        else break;
+    }
 
-    while (*format != '\0') {
-        size_t maxrem = INT_MAX - written;
-
-        if (format[0] != '%' || format[1] == '%') {
-            if (format[0] == '%')
-                format++;
-            size_t amount = 1;
-            while (format[amount] && format[amount] != '%')
-                amount++;
-            if (maxrem < amount) {
-                // TODO: Set errno to EOVERFLOW.
-                return -1;
-            }
-            if (!print(format, amount))
-                return -1;
-            format += amount;
-            written += amount;
-            continue;
+    if (*format == '*') {
+        format++;
+        spec->width = va_arg(*ap, int);
+        if (spec->width < 0) {
+            spec->flags |= FLAG_LEFT;
+            spec->width = spec->width == INT_MIN ? INT_MAX : -spec->width;
+        }
+    } else {
+        spec->width = parse_number(&format);
+    }
+
+    if (*format == '.') {
+        format++;
+        if (*format == '*') {
+            format++;
+            spec->precision = va_arg(*ap, int);
+            if (spec->precision < 0)
+                spec->precision = -1;
+        } else {
+            spec->precision = parse_number(&format);
         }
+    }
 
-        format++; // skip the '%'
+    switch (*format) {
+    case 'h':
+        spec->length = format[1] == 'h' ? LEN_HH : LEN_H;
+        format += spec->length == LEN_HH ? 2 : 1;
+        break;
+    case 'l':
+        spec->length = format[1] == 'l' ? LEN_LL : LEN_L;
+        format += spec->length == LEN_LL ? 2 : 1;
+        break;
+    case 'j': spec->length = LEN_J; format++; break;
+    case 'z': spec->length = LEN_Z; format++; break;
+    case 't': spec->length = LEN_T; format++; break;
+    case 'L': spec->length = LEN_BIG_L; format++; break;
+    }
 
-        switch (*format) {
-            case 'c': {
-                written += print_char(parameters);
-                break;
-            }
-            case 's': {
-                written += print_string(parameters);
-                break;
-            }
-            case 'd': {
-                written += print_int(parameters);
-                break;
-            }
-            case 'f': {
-                    written += print_float(parameters);
-                    break;
-                }
-            case 'g': {
-                written += print_g(parameters);
-                break;
-            }
-            case 'E': {
-                written += print_E(parameters);
-                break;
-            }
-            case 'G': {
-                written += print_G(parameters);
-                break;
-            }
-            default: {
-                // TODO: Handle other types.
-                break;
-            }
+    if (spec->flags & FLAG_LEFT)
+        spec->flags &= ~FLAG_ZERO;
+
+    spec->conversion = *format;
+    return *format != '\0' ? format + 1 : format;
+}
+
+int vprintf(const char* restrict format, va_list parameters) {
+    struct output out = { stdout, 0, false };
+    va_list ap;
+    // Held for the whole call, so concurrent messages do not interleave.
+    unsigned long state = __stream_lock(stdout);
+
+    va_copy(ap, parameters);
+    while (*format != '\0') {
+        const char* text = format;
+        while (*format != '\0' && *format != '%')
+            format++;
+        output_write(&out, text, (size_t) (format - text));
+        if (*format == '\0')
+            break;
+
+        struct format_spec spec;
+        const char* next = parse_spec(format + 1, &spec, &ap);
+        unsigned char c = (unsigned char) spec.conversion;
+        const struct conversion* conversion = c < 128 ? &conversions[c] : NULL;
+
+        if (conversion == NULL || conversion->convert == NULL) {
+            output_write(&out, format, (size_t) (next - format));
+        } else {
+            spec.base = conversion->base;
+            if (conversion->upper)
+                spec.flags |= FLAG_UPPER;
+            conversion->convert(&out, &spec, &ap);
         }
+        format = next;
+    }
+    va_end(ap);
+    __stream_unlock(stdout, state);
 
-        format++;
+    if (out.error || out.written > INT_MAX) {
+        // TODO: Set errno to EOVERFLOW.
+        return -1;
     }
+    return (int) out.written;
+}
 
+int printf(const char* restrict format, ...) {
+    va_list parameters;
+    va_start(parameters, format);
+    int written = vprintf(format, parameters);
     va_end(parameters);
     return written;
 }
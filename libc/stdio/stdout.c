@@ -0,0 +1,71 @@
+#include <stdio.h>
+
+#if defined(__is_libk)
+#include <kernel/klog.h>
+#include <kernel/sync.h>
+#endif
+
+static int console_write(const char* buf, size_t len) {
+#if defined(__is_libk)
+	// The log ring is drained to the terminal outside the caller.
+	klog_write(KLOG_INFO, buf, len);
+#else
+	// TODO: Implement stdio and the write system call.
+	(void) buf;
+#endif
+	return (int) len;
+}
+
+static char stdout_buf[BUFSIZ];
+
+static struct Stream stdout_stream = {
+	.buf_len = BUFSIZ,
+	.buf_i = 0,
+	.buf = stdout_buf,
+	.buf_mode = _IOLBF,
+	.pfn_write_all = console_write,
+};
+
+struct Stream* stdout = &stdout_stream;
+
+#if defined(__is_libk)
+#define NO_CPU (~0u)
+// What __stream_lock returns to a nested caller. No EFLAGS value has every
+// bit set.
+#define STREAM_NESTED (~0ul)
+
+// stdout is the only stream, so one lock covers them all.
+static struct spinlock stream_lock = SPINLOCK_INIT;
+static volatile unsigned stream_owner = NO_CPU;
+#endif
+
+// A fault in the middle of a stream call, or an abort() under the lock,
+// prints its report through stdio again on the CPU that holds the lock;
+// that nested use goes ahead unlocked rather than deadlock, as the console
+// does.
+unsigned long __stream_lock(struct Stream* stream) {
+	(void) stream;
+#if defined(__is_libk)
+	unsigned id = this_cpu()->id;
+
+	if (stream_owner == id)
+		return STREAM_NESTED;
+	uint32_t eflags = spin_lock_irqsave(&stream_lock);
+	stream_owner = id;
+	return eflags;
+#else
+	return 0;
+#endif
+}
+
+void __stream_unlock(struct Stream* stream, unsigned long state) {
+	(void) stream;
+#if defined(__is_libk)
+	if (state == STREAM_NESTED)
+		return;
+	stream_owner = NO_CPU;
+	spin_unlock_irqrestore(&stream_lock, (uint32_t) state);
+#else
+	(void) state;
+#endif
+}
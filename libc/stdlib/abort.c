@@ -1,11 +1,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#if defined(__is_libk)
+#include <kernel/klog.h>
+#endif
+
 __attribute__((__noreturn__))
 void abort(void) {
 #if defined(__is_libk)
 	// TODO: Add proper kernel panic.
 	printf("kernel: panic: abort()\n");
+	klog_dump();
 #else
 	// TODO: Abnormally terminate the process as if by SIGABRT.
 	printf("abort()\n");
@@ -0,0 +1,98 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#if defined(__is_libk)
+#include <kernel/pmm.h>
+#include <kernel/vmm.h>
+
+/*
+ * A page block chained onto a growing arena. The header sits at the start of
+ * the block and the rest is handed out. Blocks form a stack, newest first, so
+ * resetting to a mark pops and frees the ones allocated after it.
+ */
+struct arena_chunk {
+	struct arena_chunk* prev;
+	unsigned order;
+};
+
+#define CHUNK_HEADER_SIZE ((sizeof(struct arena_chunk) + 15) & ~(size_t) 15)
+
+static inline char* chunk_end(struct arena_chunk* chunk) {
+	return (char*) chunk + ((size_t) PAGE_SIZE << chunk->order);
+}
+
+void arena_init(struct arena* arena, void* buf, size_t size) {
+	arena->buf = buf;
+	arena->buf_end = (char*) buf + size;
+	arena->cur = arena->buf;
+	arena->end = arena->buf_end;
+	arena->chunk = NULL;
+	arena->grow = 0;
+}
+
+void arena_init_growing(struct arena* arena, void* buf, size_t size) {
+	arena_init(arena, buf, size);
+	arena->grow = 1;
+}
+
+// Chain a page block big enough for size bytes at the given alignment.
+static int arena_grow(struct arena* arena, size_t size, size_t align) {
+	size_t need = CHUNK_HEADER_SIZE + align + size;
+	unsigned order = 0;
+
+	if (size > ((size_t) PAGE_SIZE << PMM_MAX_ORDER))
+		return 0;
+	while (((size_t) PAGE_SIZE << order) < need)
+		if (++order > PMM_MAX_ORDER)
+			return 0;
+
+	uintptr_t phys = pmm_alloc(order);
+	if (!phys)
+		return 0;
+	struct arena_chunk* chunk = phys_to_virt(phys);
+	chunk->prev = arena->chunk;
+	chunk->order = order;
+	arena->chunk = chunk;
+	arena->cur = (char*) chunk + CHUNK_HEADER_SIZE;
+	arena->end = chunk_end(chunk);
+	return 1;
+}
+
+void* arena_alloc(struct arena* arena, size_t size, size_t align) {
+	if (align == 0)
+		align = 1;
+
+	for (;;) {
+		uintptr_t start = ((uintptr_t) arena->cur + align - 1) & ~(uintptr_t) (align - 1);
+		// An arena with no buffer has cur == end == NULL, where even a
+		// zero-byte allocation would fit and come back as NULL.
+		if (arena->cur && start >= (uintptr_t) arena->cur && start <= (uintptr_t) arena->end &&
+		    size <= (uintptr_t) arena->end - start) {
+			arena->cur = (char*) start + size;
+			return (void*) start;
+		}
+		if (!arena->grow || !arena_grow(arena, size, align))
+			return NULL;
+	}
+}
+
+struct arena_mark arena_mark(const struct arena* arena) {
+	return (struct arena_mark) { arena->chunk, arena->cur };
+}
+
+void arena_reset(struct arena* arena, struct arena_mark mark) {
+	while (arena->chunk != mark.chunk) {
+		struct arena_chunk* chunk = arena->chunk;
+		arena->chunk = chunk->prev;
+		pmm_free(virt_to_phys(chunk), chunk->order);
+	}
+	arena->cur = mark.cur;
+	arena->end = mark.chunk ? chunk_end(mark.chunk) : arena->buf_end;
+}
+
+void arena_release(struct arena* arena) {
+	arena_reset(arena, (struct arena_mark) { NULL, arena->buf });
+}
+
+#endif
@@ -0,0 +1,256 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#if defined(__is_libk)
+#include <kernel/pmm.h>
+#include <kernel/sync.h>
+#include <kernel/vmm.h>
+
+/*
+ * A slab allocator in the style of Bonwick's. Every slab is one page that
+ * starts with its struct slab header and is followed by equal sized objects.
+ * A free object holds the link to the next free one, so an allocation is a
+ * pop and a free is a push. For caches with a constructor the link goes after
+ * the object instead, so a freed object keeps its constructed state.
+ *
+ * Blocks that do not fit in a slab come straight from the page allocator.
+ * They start with a header as well, marked by a NULL cache. Either way
+ * kfree finds the header by rounding the pointer down to its page.
+ *
+ * Each cache has its own lock, taken with interrupts off so handlers can
+ * allocate too.
+ */
+
+#define KMALLOC_ALIGN 16
+#define KMALLOC_MIN_SHIFT 3
+#define KMALLOC_MAX_SHIFT 10
+#define KMALLOC_CLASSES (KMALLOC_MAX_SHIFT - KMALLOC_MIN_SHIFT + 1)
+
+struct slab {
+	struct kmem_cache* cache; // NULL for a large block
+	struct slab* next;
+	struct slab* prev;
+	void* free;
+	unsigned inuse;
+	unsigned order; // large blocks only
+};
+
+#define ALIGN_UP(x, a) (((x) + (a) - 1) & ~((size_t) (a) - 1))
+#define SLAB_HEADER_SIZE ALIGN_UP(sizeof(struct slab), KMALLOC_ALIGN)
+
+struct kmem_cache {
+	const char* name;
+	size_t size;
+	size_t stride;
+	size_t offset;      // of the first object in the slab
+	size_t link;        // of the free list link in an object
+	unsigned per_slab;
+	void (*ctor)(void*);
+	struct slab* partial;
+	struct slab* full;
+	struct slab* empty; // one spare slab, so a cache at a page boundary does not thrash
+	struct spinlock lock;
+};
+
+#define STATIC_CACHE(n, sz) {                                             \
+	.name = (n),                                                      \
+	.size = (sz),                                                     \
+	.stride = ALIGN_UP((sz), sizeof(void*)),                          \
+	.offset = SLAB_HEADER_SIZE,                                       \
+	.link = 0,                                                        \
+	.per_slab = (PAGE_SIZE - SLAB_HEADER_SIZE) / ALIGN_UP((sz), sizeof(void*)), \
+}
+
+static struct kmem_cache kmalloc_caches[KMALLOC_CLASSES] = {
+	STATIC_CACHE("kmalloc-8", 8),
+	STATIC_CACHE("kmalloc-16", 16),
+	STATIC_CACHE("kmalloc-32", 32),
+	STATIC_CACHE("kmalloc-64", 64),
+	STATIC_CACHE("kmalloc-128", 128),
+	STATIC_CACHE("kmalloc-256", 256),
+	STATIC_CACHE("kmalloc-512", 512),
+	STATIC_CACHE("kmalloc-1024", 1024),
+};
+
+// Where kmem_cache_create gets its struct kmem_cache from.
+static struct kmem_cache cache_cache = STATIC_CACHE("kmem_cache", sizeof(struct kmem_cache));
+
+// Pages are used through the kernel's direct map.
+static void* page_alloc(unsigned order) {
+	uintptr_t phys = pmm_alloc(order);
+	return phys ? phys_to_virt(phys) : NULL;
+}
+
+static void page_free(void* page, unsigned order) {
+	pmm_free(virt_to_phys(page), order);
+}
+
+static inline struct slab* slab_of(const void* obj) {
+	return (struct slab*) ((uintptr_t) obj & ~(uintptr_t) (PAGE_SIZE - 1));
+}
+
+static inline void** free_link(const struct kmem_cache* cache, void* obj) {
+	return (void**) ((char*) obj + cache->link);
+}
+
+static void slab_push(struct slab** list, struct slab* slab) {
+	slab->prev = NULL;
+	slab->next = *list;
+	if (*list)
+		(*list)->prev = slab;
+	*list = slab;
+}
+
+static void slab_remove(struct slab** list, struct slab* slab) {
+	if (slab->prev)
+		slab->prev->next = slab->next;
+	else
+		*list = slab->next;
+	if (slab->next)
+		slab->next->prev = slab->prev;
+}
+
+static struct slab* slab_create(struct kmem_cache* cache) {
+	struct slab* slab = page_alloc(0);
+	if (!slab)
+		return NULL;
+
+	slab->cache = cache;
+	slab->inuse = 0;
+	slab->order = 0;
+	slab->free = NULL;
+
+	// Link back to front so the free list hands objects out in address order.
+	char* obj = (char*) slab + cache->offset + (size_t) cache->per_slab * cache->stride;
+	for (unsigned i = 0; i < cache->per_slab; i++) {
+		obj -= cache->stride;
+		if (cache->ctor)
+			cache->ctor(obj);
+		*free_link(cache, obj) = slab->free;
+		slab->free = obj;
+	}
+	return slab;
+}
+
+void* kmem_cache_alloc(struct kmem_cache* cache) {
+	uint32_t eflags = spin_lock_irqsave(&cache->lock);
+	struct slab* slab = cache->partial;
+
+	if (!slab) {
+		slab = cache->empty;
+		if (slab) {
+			cache->empty = NULL;
+		} else if (!(slab = slab_create(cache))) {
+			spin_unlock_irqrestore(&cache->lock, eflags);
+			return NULL;
+		}
+		slab_push(&cache->partial, slab);
+	}
+
+	void* obj = slab->free;
+	slab->free = *free_link(cache, obj);
+	if (++slab->inuse == cache->per_slab) {
+		slab_remove(&cache->partial, slab);
+		slab_push(&cache->full, slab);
+	}
+	spin_unlock_irqrestore(&cache->lock, eflags);
+	return obj;
+}
+
+void kmem_cache_free(struct kmem_cache* cache, void* obj) {
+	struct slab* slab = slab_of(obj);
+	uint32_t eflags = spin_lock_irqsave(&cache->lock);
+
+	*free_link(cache, obj) = slab->free;
+	slab->free = obj;
+	if (slab->inuse-- == cache->per_slab) {
+		slab_remove(&cache->full, slab);
+		slab_push(&cache->partial, slab);
+	}
+	if (slab->inuse == 0) {
+		slab_remove(&cache->partial, slab);
+		if (cache->empty)
+			page_free(slab, 0);
+		else
+			cache->empty = slab;
+	}
+	spin_unlock_irqrestore(&cache->lock, eflags);
+}
+
+struct kmem_cache* kmem_cache_create(const char* name, size_t size, size_t align, void (*ctor)(void*)) {
+	if (align < sizeof(void*))
+		align = sizeof(void*);
+	if (align & (align - 1))
+		return NULL;
+
+	size_t link = ctor ? ALIGN_UP(size, sizeof(void*)) : 0;
+	size_t stride = ALIGN_UP(ctor ? link + sizeof(void*) : size, align);
+	size_t offset = ALIGN_UP(sizeof(struct slab), align);
+	if (stride == 0 || offset + stride > PAGE_SIZE)
+		return NULL;
+
+	struct kmem_cache* cache = kmem_cache_alloc(&cache_cache);
+	if (!cache)
+		return NULL;
+	*cache = (struct kmem_cache) {
+		.name = name,
+		.size = size,
+		.stride = stride,
+		.offset = offset,
+		.link = link,
+		.per_slab = (unsigned) ((PAGE_SIZE - offset) / stride),
+		.ctor = ctor,
+	};
+	return cache;
+}
+
+static void release_slabs(struct slab* slab) {
+	while (slab) {
+		struct slab* next = slab->next;
+		page_free(slab, 0);
+		slab = next;
+	}
+}
+
+void kmem_cache_destroy(struct kmem_cache* cache) {
+	release_slabs(cache->partial);
+	release_slabs(cache->full);
+	if (cache->empty)
+		page_free(cache->empty, 0);
+	kmem_cache_free(&cache_cache, cache);
+}
+
+void* kmalloc(size_t size) {
+	if (size <= (1u << KMALLOC_MAX_SHIFT)) {
+		unsigned shift = size <= (1u << KMALLOC_MIN_SHIFT)
+			? KMALLOC_MIN_SHIFT : 32 - (unsigned) __builtin_clz((unsigned) size - 1);
+		return kmem_cache_alloc(&kmalloc_caches[shift - KMALLOC_MIN_SHIFT]);
+	}
+
+	if (size > ((size_t) PAGE_SIZE << PMM_MAX_ORDER) - SLAB_HEADER_SIZE)
+		return NULL;
+	unsigned order = 0;
+	while (((size_t) PAGE_SIZE << order) - SLAB_HEADER_SIZE < size)
+		order++;
+
+	struct slab* block = page_alloc(order);
+	if (!block)
+		return NULL;
+	block->cache = NULL;
+	block->order = order;
+	return (char*) block + SLAB_HEADER_SIZE;
+}
+
+void kfree(void* ptr) {
+	if (!ptr)
+		return;
+
+	struct slab* slab = slab_of(ptr);
+	if (slab->cache)
+		kmem_cache_free(slab->cache, ptr);
+	else
+		page_free(slab, slab->order);
+}
+
+#endif
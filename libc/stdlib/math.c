@@ -1,161 +1,792 @@
-/* TODO: Implement all the functions descripted in this comment.
-| Return Type | Function Name | Parameter Type(s) | Description |
-|-------------|---------------|-------------------|-------------|
-| double      | acos          | double x          | Calculates the arccosine of x. | OK
-| double      | asin          | double x          | Calculates the arcsine of x. | Ok
-| double      | atan          | double x          | Calculates the arctangent of x. | Ok
-| double      | atan2         | double y, double x| Calculates the arctangent of y/x. | Ok
-| double      | ceil          | double x          | Returns the smallest integer not less than x. | OK
-| double      | cos           | double x          | Calculates the cosine of x. |
-| double      | cosh          | double x          | Calculates the hyperbolic cosine of x. |
-| double      | exp           | double x          | Calculates e^x, where e is the base of the natural logarithm. |
-| double      | fabs          | double x          | Returns the absolute value of x. | OK
-| double      | floor         | double x          | Returns the largest integer not greater than x. | OK
-| double      | fmod          | double x, double y| Returns the remainder of the division of x by y. |
-| double      | frexp         | double x, int* exp| Breaks x into a normalized fraction and an exponent. |
-| double      | ldexp         | double x, int exp | Multiplies x by 2 raised to the power of exp. |
-| double      | log           | double x          | Calculates the natural logarithm of x. |
-| double      | log10         | double x          | Calculates the base 10 logarithm of x. | OK
-| double      | modf          | double x, double* intpart | Breaks x into an integral and a fractional part. |
-| double      | pow           | double x, double y| Calculates x^y. | OK
-| double      | sin           | double x          | Calculates the sine of x. |
-| double      | sinh          | double x          | Calculates the hyperbolic sine of x. |
-| double      | sqrt          | double x          | Calculates the square root of x. |
-| double      | tan           | double x          | Calculates the tangent of x. |
-| double      | tanh          | double x          | Calculates the hyperbolic tangent of x. |
+#include <math.h>
+#include <stdint.h>
+
+/*
+ * Double precision math.
+ *
+ * The transcendental functions follow the usual scheme: reduce the argument to
+ * a small interval with an exactly known offset (a multiple of ln 2, a power of
+ * two, a multiple of pi/2), evaluate a minimax polynomial on it, and put the
+ * offset back. The polynomials are fdlibm's, whose errors are below one ulp on
+ * their intervals. Cancellation-prone steps carry a second double, or use the
+ * x87's 64-bit long double, so results stay within one or two ulps.
+ *
+ * i386 evaluates doubles on the x87, which may keep intermediates in extended
+ * precision until they are stored. The algorithms here only get more accurate
+ * from that, except where a value is split into high and low parts; those go
+ * through round_double.
  */
 
-#define M_PI 3.14159265358979323846
+union dbits {
+    double f;
+    uint64_t i;
+};
 
-static const double NAN = 0.0 / 0.0;
+static inline uint64_t dbl_bits(double x) {
+    union dbits u = { .f = x };
+    return u.i;
+}
 
-double ceil(double x) {
-    int i = (int)x;
-    return (x > i) ? i + 1 : x;
+static inline double bits_dbl(uint64_t i) {
+    union dbits u = { .i = i };
+    return u.f;
+}
+
+/* The high word holds the sign, the exponent and 20 bits of mantissa. */
+static inline uint32_t high_word(double x) {
+    return (uint32_t) (dbl_bits(x) >> 32);
+}
+
+static inline double with_low_word(double x, uint32_t low) {
+    return bits_dbl((dbl_bits(x) & 0xffffffff00000000) | low);
+}
+
+/* Stored, to drop the extended precision an x87 register might still hold. */
+static inline double round_double(long double x) {
+    volatile double d = (double) x;
+    return d;
+}
+
+/* x * 2^n, for results in range, with gradual underflow. */
+static double scale2(double x, int n) {
+    if (n > 1023) {
+        x *= 0x1p1023;
+        n -= 1023;
+        if (n > 1023)
+            n = 1023;
+    } else if (n < -1022) {
+        /* Two steps, so the subnormal result is rounded once. */
+        x *= 0x1p-1022 * 0x1p53;
+        n += 1022 - 53;
+        if (n < -1022)
+            n = -1022;
+    }
+    return x * bits_dbl((uint64_t) (0x3ff + n) << 52);
+}
+
+double fabs(double x) {
+    return bits_dbl(dbl_bits(x) & ~(UINT64_C(1) << 63));
+}
+
+float fabsf(float x) {
+    return __builtin_fabsf(x);
+}
+
+long double fabsl(long double x) {
+    return __builtin_fabsl(x);
 }
 
 double floor(double x) {
-    int i = (int)x;
-    return (x < i) ? i - 1 : x;
+    uint64_t i = dbl_bits(x);
+    int e = (int) (i >> 52 & 0x7ff) - 0x3ff;
+
+    if (e >= 52)
+        return x; /* integral, infinite or NaN */
+    if (e < 0) {
+        if ((i << 1) == 0)
+            return x;
+        return (i >> 63) ? -1.0 : 0.0;
+    }
+    uint64_t fraction = UINT64_C(0x000fffffffffffff) >> e;
+    if ((i & fraction) == 0)
+        return x;
+    /* Negative numbers go up in magnitude; a carry into the exponent is fine. */
+    if (i >> 63)
+        i += fraction;
+    return bits_dbl(i & ~fraction);
 }
 
-double pow(double x, double y) {
-    double result = 1.0;
-    for (int i = 0; i < y; i++) {
-        result *= x;
+double ceil(double x) {
+    uint64_t i = dbl_bits(x);
+    int e = (int) (i >> 52 & 0x7ff) - 0x3ff;
+
+    if (e >= 52)
+        return x;
+    if (e < 0) {
+        if ((i << 1) == 0)
+            return x;
+        return (i >> 63) ? -0.0 : 1.0;
     }
-    return result;
+    uint64_t fraction = UINT64_C(0x000fffffffffffff) >> e;
+    if ((i & fraction) == 0)
+        return x;
+    if (!(i >> 63))
+        i += fraction;
+    return bits_dbl(i & ~fraction);
 }
 
-double atan(double x) {
-    double result = 0.0;
-    double term = x;
-    double xsq = x*x;
-    for (int i = 0; i < 10; i++) {
-        result += term / (2*i+1);
-        term *= -xsq;
-    }
-    return result;
-}
-
-double atan2_approx(double y, double x) {
-    if (x > 0) {
-        return atan(y / x);
-    } else if (y >= 0 && x < 0) {
-        return atan(y / x) + M_PI;
-    } else if (y < 0 && x < 0) {
-        return atan(y / x) - M_PI;
-    } else if (y > 0 && x == 0) {
-        return M_PI / 2;
-    } else if (y < 0 && x == 0) {
-        return -M_PI / 2;
+/*
+ * Exact: the remainder is computed on the integer mantissas by shift and
+ * subtract, one bit of exponent difference at a time.
+ */
+double fmod(double x, double y) {
+    uint64_t ix = dbl_bits(x), iy = dbl_bits(y);
+    uint64_t sign = ix & (UINT64_C(1) << 63);
+    int ex = (int) (ix >> 52 & 0x7ff);
+    int ey = (int) (iy >> 52 & 0x7ff);
+
+    if ((iy << 1) == 0 || isnan(y) || ex == 0x7ff)
+        return (x * y) / (x * y);
+    if ((ix << 1) <= (iy << 1))
+        return (ix << 1) == (iy << 1) ? 0.0 * x : x;
+
+    /* Normalize the mantissas to bit 52, with the exponents to match. */
+    uint64_t mx = ix & UINT64_C(0x000fffffffffffff);
+    uint64_t my = iy & UINT64_C(0x000fffffffffffff);
+    if (ex == 0) {
+        for (ex = 1; !(mx >> 52); ex--)
+            mx <<= 1;
     } else {
-        // x and y are both zero, return undefined
-        return NAN;
+        mx |= UINT64_C(1) << 52;
     }
+    if (ey == 0) {
+        for (ey = 1; !(my >> 52); ey--)
+            my <<= 1;
+    } else {
+        my |= UINT64_C(1) << 52;
+    }
+
+    for (; ex > ey; ex--) {
+        if (mx >= my)
+            mx -= my;
+        mx <<= 1;
+    }
+    if (mx >= my)
+        mx -= my;
+    if (mx == 0)
+        return 0.0 * x;
+
+    for (; !(mx >> 52); ex--)
+        mx <<= 1;
+    if (ex > 0)
+        mx = (mx & UINT64_C(0x000fffffffffffff)) | (uint64_t) ex << 52;
+    else
+        mx >>= 1 - ex;
+    return bits_dbl(mx | sign);
 }
 
-double asin(double x) {
-    double result = 0.0;
-    double term = x;
-    double xsq = x*x;
-    for (int i = 0; i < 10; i++) {
-        result += term;
-        term *= xsq * (2*i+1) / (2*(i+1));
+/* Rounded by the x87 to the precision of its operand. */
+double sqrt(double x) {
+    __asm__ ("fsqrt" : "+t"(x));
+    return x;
+}
+
+/*
+ * exp(x) = 2^k * exp(r) with x = k*ln2 + r and |r| <= ln2/2. ln2 is split so
+ * that k*ln2_hi is exact. exp(r) comes from a minimax approximation of
+ * r*(exp(r)+1)/(exp(r)-1), which is even and smoother than exp itself.
+ */
+static const double ln2_hi = 6.93147180369123816490e-01;
+static const double ln2_lo = 1.90821492927058770002e-10;
+static const double inv_ln2 = 1.44269504088896338700e+00;
+
+static const double exp_p1 = 1.66666666666666019037e-01;
+static const double exp_p2 = -2.77777777770155933842e-03;
+static const double exp_p3 = 6.61375632143793436117e-05;
+static const double exp_p4 = -1.65339022054652515390e-06;
+static const double exp_p5 = 4.13813679705723846039e-08;
+
+double exp(double x) {
+    uint32_t hx = high_word(x) & 0x7fffffff;
+    int negative = (int) (high_word(x) >> 31);
+    double hi, lo, t, c;
+    int k;
+
+    if (hx >= 0x40862e42) { /* |x| >= 709.78 */
+        if (hx >= 0x7ff00000) {
+            if (isnan(x))
+                return x + x;
+            return negative ? 0.0 : x;
+        }
+        if (x > 7.09782712893383973096e+02)
+            return HUGE_VAL;
+        if (x < -7.45133219101941108420e+02)
+            return 0.0;
     }
-    return result;
+
+    if (hx > 0x3fd62e42) { /* |x| > ln2/2 */
+        k = (int) (inv_ln2 * x + (negative ? -0.5 : 0.5));
+        hi = x - k * ln2_hi;
+        lo = k * ln2_lo;
+        x = hi - lo;
+    } else if (hx < 0x3e300000) { /* |x| < 2^-28 */
+        return 1.0 + x;
+    } else {
+        k = 0;
+        hi = x;
+        lo = 0.0;
+    }
+
+    t = x * x;
+    c = x - t * (exp_p1 + t * (exp_p2 + t * (exp_p3 + t * (exp_p4 + t * exp_p5))));
+    double y = 1.0 - ((lo - (x * c) / (2.0 - c)) - hi);
+    return k == 0 ? y : scale2(y, k);
 }
 
-double acos(double x) {
-    // Initialize the sum to 0. This will hold the final result.
-    double sum = 0.0;
-    // Initialize the term to 1. This will hold the current term in the series.
-    double term;
-    // Initialize j to 1. This will be used to calculate the factorial in the series.
-    double j = 1.0;
-    // Loop for the first 10 terms of the series.
-    for(int n = 0; n < 10; n++) {
-        // Reset the term to 1 for each new term in the series.
-        term = 1.0;
-        // Calculate the factorial part of the term.
-        for(int i = 1; i <= 2*n; i++) {
-            term *= (j/i);
-            j++;
+/*
+ * log(x) = k*ln2 + log(1+f) with x = 2^k * (1+f) and sqrt(2)/2 <= 1+f < sqrt(2).
+ * With s = f/(2+f), log(1+f) = 2s + s*R(s^2), R being a minimax polynomial.
+ * The result is kept in pieces so log10 can scale them separately.
+ */
+static const double lg1 = 6.666666666666735130e-01;
+static const double lg2 = 3.999999999940941908e-01;
+static const double lg3 = 2.857142874366239149e-01;
+static const double lg4 = 2.222219843214978396e-01;
+static const double lg5 = 1.818357216161805012e-01;
+static const double lg6 = 1.531383769920937332e-01;
+static const double lg7 = 1.479819860511658591e-01;
+
+struct log_parts {
+    int k;
+    double f;
+    double hfsq; /* f*f/2 */
+    double tail; /* s*(hfsq + R) */
+};
+
+/* Returns 0 and sets *special to the result for zero, negative, infinite and NaN x. */
+static int log_reduce(double x, struct log_parts* parts, double* special) {
+    uint64_t i = dbl_bits(x);
+    uint32_t hx = (uint32_t) (i >> 32);
+    int k = 0;
+
+    if (hx < 0x00100000 || (hx >> 31)) {
+        if ((i << 1) == 0) {
+            *special = -HUGE_VAL;
+            return 0;
+        }
+        if (hx >> 31) {
+            *special = (x - x) / 0.0;
+            return 0;
         }
-        // Add the current term to the sum.
-        sum += term * pow(x, 2*n+1) / (2*n+1);
+        /* Subnormal: scale it up into the normal range. */
+        k -= 54;
+        x *= 0x1p54;
+        i = dbl_bits(x);
+        hx = (uint32_t) (i >> 32);
+    } else if (hx >= 0x7ff00000) {
+        *special = x + x;
+        return 0;
     }
-    // Return the approximation of the arccosine of x.
-    return (M_PI / 2) - sum;
+
+    /* Move 1+f into [sqrt(2)/2, sqrt(2)). */
+    hx += 0x3ff00000 - 0x3fe6a09e;
+    k += (int) (hx >> 20) - 0x3ff;
+    hx = (hx & 0x000fffff) + 0x3fe6a09e;
+    double f = bits_dbl((uint64_t) hx << 32 | (i & 0xffffffff)) - 1.0;
+
+    double s = f / (2.0 + f);
+    double z = s * s;
+    double w = z * z;
+    double t1 = w * (lg2 + w * (lg4 + w * lg6));
+    double t2 = z * (lg1 + w * (lg3 + w * (lg5 + w * lg7)));
+    parts->k = k;
+    parts->f = f;
+    parts->hfsq = 0.5 * f * f;
+    parts->tail = s * (parts->hfsq + t1 + t2);
+    return 1;
 }
 
+double log(double x) {
+    struct log_parts p;
+    double special;
 
-double fabs(double x) {
-    if (x < 0) {
-        return -x;
-    } else {
-        return x;
+    if (!log_reduce(x, &p, &special))
+        return special;
+    double dk = p.k;
+    return dk * ln2_hi - ((p.hfsq - (p.tail + dk * ln2_lo)) - p.f);
+}
+
+static const double inv_ln10_hi = 4.34294481878168880939e-01;
+static const double inv_ln10_lo = 2.50829467116452752298e-11;
+static const double log10_2_hi = 3.01029995663611771306e-01;
+static const double log10_2_lo = 3.69423907715893078616e-13;
+
+/* log(1+f) is split into hi, with a short mantissa, and lo, so hi * inv_ln10_hi is exact. */
+double log10(double x) {
+    struct log_parts p;
+    double special;
+
+    if (!log_reduce(x, &p, &special))
+        return special;
+    double hi = with_low_word(p.f - p.hfsq, 0);
+    double lo = p.f - hi - p.hfsq + p.tail;
+    double dk = p.k;
+    double y = dk * log10_2_hi;
+    double val_hi = hi * inv_ln10_hi;
+    double val_lo = dk * log10_2_lo + (lo + hi) * inv_ln10_lo + lo * inv_ln10_hi;
+    double w = y + val_hi;
+    val_lo += (y - w) + val_hi;
+    return val_lo + w;
+}
+
+/* 0 when y is not an integer, 1 when it is odd, 2 when it is even. */
+static int integer_kind(double y) {
+    uint64_t i = dbl_bits(y);
+    int e = (int) (i >> 52 & 0x7ff) - 0x3ff;
+
+    if (e >= 53)
+        return 2;
+    if (e < 0)
+        return (i << 1) == 0 ? 2 : 0;
+    uint64_t fraction = UINT64_C(0x000fffffffffffff) >> e;
+    if (i & fraction)
+        return 0;
+    return ((i | UINT64_C(1) << 52) >> (52 - e) & 1) ? 1 : 2;
+}
+
+/*
+ * y*log2(x) needs about 64 good bits for the result to be within an ulp when
+ * it is large, which the x87 gives directly: fyl2x computes y*log2(x) in
+ * extended precision, and f2xm1 and fscale raise 2 to it. Doing it in doubles
+ * would take a double-double logarithm instead.
+ */
+static double pow_x87(double x, double y) {
+    long double t, n, r;
+
+    __asm__ ("fyl2x" : "=t"(t) : "0"((long double) x), "u"((long double) y) : "st(1)");
+    /* Far outside the double range either way; keeps fscale's count small. */
+    if (t > 2000.0L)
+        t = 2000.0L;
+    else if (t < -2000.0L)
+        t = -2000.0L;
+    __asm__ ("frndint" : "=t"(n) : "0"(t));
+    t -= n;
+    __asm__ ("f2xm1" : "=t"(r) : "0"(t));
+    r += 1.0L;
+    __asm__ ("fscale" : "=t"(r) : "0"(r), "u"(n));
+    return (double) r;
+}
+
+double pow(double x, double y) {
+    double ax = fabs(x);
+
+    if (y == 0.0 || x == 1.0)
+        return 1.0;
+    if (isnan(x) || isnan(y))
+        return x + y;
+
+    int kind = integer_kind(y);
+    int odd = kind == 1 && signbit(x);
+    if (isinf(y)) {
+        if (ax == 1.0)
+            return 1.0;
+        return (ax < 1.0) == (y < 0.0) ? HUGE_VAL : 0.0;
     }
+    if (ax == 0.0 || isinf(x)) {
+        /* 1/x for the zeros, x for the infinities, with the sign when y is odd. */
+        double r = ((ax == 0.0) == (y < 0.0)) ? HUGE_VAL : 0.0;
+        return odd ? -r : r;
+    }
+    if (signbit(x) && kind == 0)
+        return (x - x) / (x - x);
+
+    double r = pow_x87(ax, y);
+    return odd ? -r : r;
 }
 
-float fabsf(float x) {
-    if (x < 0) {
-        return -x;
+/*
+ * Argument reduction for the trigonometric functions: x = n*pi/2 + y[0] + y[1]
+ * with |y[0] + y[1]| <= pi/4, returning n. Up to 2^19 * pi/2, pi/2 is taken
+ * in three pieces, the first two short enough for n times them to be exact in
+ * a long double. Past that, x's mantissa is multiplied by a window of the bits
+ * of 2/pi wide enough that the fraction keeps all its precision even when x is
+ * as close to a multiple of pi/2 as a double can get.
+ */
+static const long double pio2_1 = 0xc90fdaa2216p-43L;
+static const long double pio2_2 = 0x8c234c4c662p-87L;
+static const long double pio2_3 = 0x8b80dc1cd129024ep-151L;
+static const long double pio2_l = 0xc90fdaa22168c235p-63L;
+static const double inv_pio2 = 6.36619772367581382433e-01;
+
+/* 2/pi = 0.a2f9836e4e441529..., 32 bits per word. */
+static const uint32_t two_over_pi[40] = {
+    0xa2f9836e, 0x4e441529, 0xfc2757d1, 0xf534ddc0, 0xdb629599, 0x3c439041, 0xfe5163ab, 0xdebbc561,
+    0xb7246e3a, 0x424dd2e0, 0x06492eea, 0x09d1921c, 0xfe1deb1c, 0xb129a73e, 0xe88235f5, 0x2ebb4484,
+    0xe99c7026, 0xb45f7e41, 0x3991d639, 0x835339f4, 0x9c845f8b, 0xbdf9283b, 0x1ff897ff, 0xde05980f,
+    0xef2f118b, 0x5a0a6d1f, 0x6d367ecf, 0x27cb09b7, 0x4f463f66, 0x9e5fea2d, 0x7527bac7, 0xebe5f17b,
+    0x3d0739f7, 0x8a5292ea, 0x6bfb5fb1, 0x1f8d5d08, 0x56033046, 0xfc7b6bab, 0xf0cfbc20, 0x9af4361d,
+};
+
+/* The 32 bits of 2/pi starting at the one worth 2^-j; those before 2^-1 are zero. */
+static uint32_t two_over_pi_bits(int j) {
+    int bit = j - 1;
+
+    if (bit <= -32)
+        return 0;
+    if (bit < 0)
+        return two_over_pi[0] >> -bit;
+    int word = bit / 32, shift = bit % 32;
+    uint32_t bits = two_over_pi[word] << shift;
+    if (shift)
+        bits |= two_over_pi[word + 1] >> (32 - shift);
+    return bits;
+}
+
+#define PIO2_WINDOW_WORDS 7
+
+/* |x| >= 2^19 * pi/2, finite. Returns n mod 4 and the reduced argument as a long double. */
+static int rem_pio2_large(double x, long double* r) {
+    uint64_t i = dbl_bits(x);
+    /* x = m * 2^e with m a 53-bit integer. */
+    int e = (int) (i >> 52 & 0x7ff) - 1075;
+    uint64_t m = (i & UINT64_C(0x000fffffffffffff)) | UINT64_C(1) << 52;
+
+    /*
+     * Bits of 2/pi worth 2^-(e-1) and less. Those before only add multiples of
+     * 4 to x*2/pi, which do not change the quadrant. The window is 224 bits,
+     * so m*window is x*2/pi mod 4 times 2^222.
+     */
+    uint32_t w[PIO2_WINDOW_WORDS];
+    for (int k = 0; k < PIO2_WINDOW_WORDS; k++)
+        w[PIO2_WINDOW_WORDS - 1 - k] = two_over_pi_bits(e - 1 + 32 * k);
+
+    uint32_t p[PIO2_WINDOW_WORDS + 2] = { 0 };
+    uint32_t mw[2] = { (uint32_t) m, (uint32_t) (m >> 32) };
+    for (int a = 0; a < 2; a++) {
+        uint64_t carry = 0;
+        for (int k = 0; k < PIO2_WINDOW_WORDS; k++) {
+            uint64_t t = (uint64_t) mw[a] * w[k] + p[a + k] + carry;
+            p[a + k] = (uint32_t) t;
+            carry = t >> 32;
+        }
+        p[a + PIO2_WINDOW_WORDS] = (uint32_t) carry;
     }
-    return x;
+
+    /* Bits 223 and 222 are the quadrant, the 222 below the fraction. */
+    int n = (int) (p[6] >> 30);
+    int negative = 0;
+    p[6] &= 0x3fffffff;
+    if (p[6] >> 29) {
+        /* Round to the nearest quadrant: the fraction becomes 1 - itself, negated. */
+        uint32_t borrow = 0;
+        for (int k = 0; k < 7; k++) {
+            uint64_t t = (uint64_t) 0 - p[k] - borrow;
+            p[k] = (uint32_t) t;
+            borrow = (uint32_t) (t >> 63);
+        }
+        p[6] &= 0x3fffffff;
+        n++;
+        negative = 1;
+    }
+
+    long double f = 0.0L;
+    for (int k = 6; k >= 0; k--)
+        f = f * 0x1p32L + p[k];
+    f *= 0x1p-222L * pio2_l;
+    *r = negative ? -f : f;
+    return n;
 }
-long double fabsl(long double x) {
-    if (x < 0) {
-        return -x;
+
+static int rem_pio2(double x, double* y) {
+    uint32_t ix = high_word(x) & 0x7fffffff;
+    long double r;
+    int n;
+
+    if (ix <= 0x413921fb) { /* |x| <= 2^19 * pi/2 */
+        n = (int) (x * inv_pio2 + (x < 0.0 ? -0.5 : 0.5));
+        long double fn = n;
+        r = (((long double) x - fn * pio2_1) - fn * pio2_2) - fn * pio2_3;
+    } else {
+        n = rem_pio2_large(fabs(x), &r);
+        if (signbit(x)) {
+            n = -n;
+            r = -r;
+        }
     }
-    return x;
+    y[0] = round_double(r);
+    y[1] = (double) (r - y[0]);
+    return n;
 }
 
-double pow10(int n) {
-    double result = 1.0;
-    if (n >= 0) {
-        for (int i = 0; i < n; i++) {
-            result *= 10.0;
+/*
+ * Kernels on [-pi/4, pi/4] for an argument x + y, y being the tail of the
+ * reduction, well below an ulp of x.
+ */
+static const double s1 = -1.66666666666666324348e-01;
+static const double s2 = 8.33333333332248946124e-03;
+static const double s3 = -1.98412698298579493134e-04;
+static const double s4 = 2.75573137070700676789e-06;
+static const double s5 = -2.50507602534068634195e-08;
+static const double s6 = 1.58969099521155010221e-10;
+
+static double kernel_sin(double x, double y) {
+    double z = x * x;
+    double v = z * x;
+    double r = s2 + z * (s3 + z * (s4 + z * (s5 + z * s6)));
+    return x - ((z * (0.5 * y - v * r) - y) - v * s1);
+}
+
+static const double c1 = 4.16666666666666019037e-02;
+static const double c2 = -1.38888888888741095749e-03;
+static const double c3 = 2.48015872894767294178e-05;
+static const double c4 = -2.75573143513906633035e-07;
+static const double c5 = 2.08757232129817482790e-09;
+static const double c6 = -1.13596475577881948265e-11;
+
+static double kernel_cos(double x, double y) {
+    double z = x * x;
+    double w = z * z;
+    double r = z * (c1 + z * (c2 + z * c3)) + w * w * (c4 + z * (c5 + z * c6));
+    double hz = 0.5 * z;
+    w = 1.0 - hz;
+    return w + (((1.0 - w) - hz) + (z * r - x * y));
+}
+
+static const double tan_t[13] = {
+    3.33333333333334091986e-01,
+    1.33333333333201242699e-01,
+    5.39682539762260521377e-02,
+    2.18694882948595424599e-02,
+    8.86323982359930005737e-03,
+    3.59207910759131235356e-03,
+    1.45620945432529025516e-03,
+    5.88041240820264096874e-04,
+    2.46463134818469906812e-04,
+    7.81794442939557092300e-05,
+    7.14072491382608190305e-05,
+    -1.85586374855275456654e-05,
+    2.59073051863633712884e-05,
+};
+static const double pio4_hi = 7.85398163397448278999e-01;
+static const double pio4_lo = 3.06161699786838301793e-17;
+
+/* tan(x + y), or -1/tan(x + y) when odd. */
+static double kernel_tan(double x, double y, int odd) {
+    int big = fabs(x) >= 0.6744;
+    int negative = signbit(x);
+
+    if (big) {
+        /* tan(pi/4 - t) = (1 - tan t) / (1 + tan t), with t small. */
+        if (negative) {
+            x = -x;
+            y = -y;
         }
+        x = (pio4_hi - x) + (pio4_lo - y);
+        y = 0.0;
+    }
+    double z = x * x;
+    double w = z * z;
+    double r = tan_t[1] + w * (tan_t[3] + w * (tan_t[5] + w * (tan_t[7] + w * (tan_t[9] + w * tan_t[11]))));
+    double v = z * (tan_t[2] + w * (tan_t[4] + w * (tan_t[6] + w * (tan_t[8] + w * (tan_t[10] + w * tan_t[12])))));
+    double s = z * x;
+    r = y + z * (s * (r + v) + y) + s * tan_t[0];
+    w = x + r;
+    if (big) {
+        s = 1 - 2 * odd;
+        v = s - 2.0 * (x + (r - w * w / (w + s)));
+        return negative ? -v : v;
+    }
+    if (!odd)
+        return w;
+    /* -1/w directly would be off by up to 2 ulps; refine it from split parts. */
+    double w0 = with_low_word(w, 0);
+    v = r - (w0 - x);
+    double a = -1.0 / w;
+    double a0 = with_low_word(a, 0);
+    return a0 + a * (1.0 + a0 * w0 + a0 * v);
+}
+
+double sin(double x) {
+    uint32_t ix = high_word(x) & 0x7fffffff;
+    double y[2];
+
+    if (ix <= 0x3fe921fb) { /* |x| <= pi/4 */
+        if (ix < 0x3e500000) /* |x| < 2^-26 */
+            return x;
+        return kernel_sin(x, 0.0);
+    }
+    if (ix >= 0x7ff00000)
+        return x - x;
+    switch (rem_pio2(x, y) & 3) {
+    case 0:
+        return kernel_sin(y[0], y[1]);
+    case 1:
+        return kernel_cos(y[0], y[1]);
+    case 2:
+        return -kernel_sin(y[0], y[1]);
+    default:
+        return -kernel_cos(y[0], y[1]);
+    }
+}
+
+double cos(double x) {
+    uint32_t ix = high_word(x) & 0x7fffffff;
+    double y[2];
+
+    if (ix <= 0x3fe921fb) {
+        if (ix < 0x3e46a09e) /* |x| < 2^-27 * sqrt(2) */
+            return 1.0;
+        return kernel_cos(x, 0.0);
+    }
+    if (ix >= 0x7ff00000)
+        return x - x;
+    switch (rem_pio2(x, y) & 3) {
+    case 0:
+        return kernel_cos(y[0], y[1]);
+    case 1:
+        return -kernel_sin(y[0], y[1]);
+    case 2:
+        return -kernel_cos(y[0], y[1]);
+    default:
+        return kernel_sin(y[0], y[1]);
+    }
+}
+
+double tan(double x) {
+    uint32_t ix = high_word(x) & 0x7fffffff;
+    double y[2];
+
+    if (ix <= 0x3fe921fb) {
+        if (ix < 0x3e400000) /* |x| < 2^-27 */
+            return x;
+        return kernel_tan(x, 0.0, 0);
+    }
+    if (ix >= 0x7ff00000)
+        return x - x;
+    int n = rem_pio2(x, y);
+    return kernel_tan(y[0], y[1], n & 1);
+}
+
+/*
+ * atan(x) = atan(c) + atan((x - c)/(1 + x*c)) for c in {0, 1/2, 1, 3/2, inf},
+ * picked by |x| so the second argument stays below 7/16, where a minimax
+ * polynomial takes over. atan(c) is kept in two parts.
+ */
+static const double atan_hi[4] = {
+    4.63647609000806093515e-01, /* atan(1/2) */
+    7.85398163397448278999e-01, /* atan(1) */
+    9.82793723247329054082e-01, /* atan(3/2) */
+    1.57079632679489655800e+00, /* atan(inf) */
+};
+static const double atan_lo[4] = {
+    2.26987774529616870924e-17,
+    3.06161699786838301793e-17,
+    1.39033110312309984516e-17,
+    6.12323399573676603587e-17,
+};
+static const double atan_t[11] = {
+    3.33333333333329318027e-01,
+    -1.99999999998764832476e-01,
+    1.42857142725034663711e-01,
+    -1.11111104054623557880e-01,
+    9.09088713343650656196e-02,
+    -7.69187620504482999495e-02,
+    6.66107313738753120669e-02,
+    -5.83357013379057348645e-02,
+    4.97687799461593236017e-02,
+    -3.65315727442169155270e-02,
+    1.62858201153657823623e-02,
+};
+
+double atan(double x) {
+    uint32_t ix = high_word(x) & 0x7fffffff;
+    int negative = signbit(x);
+    int id;
+
+    if (ix >= 0x44100000) { /* |x| >= 2^66 */
+        if (isnan(x))
+            return x + x;
+        double z = atan_hi[3] + atan_lo[3];
+        return negative ? -z : z;
+    }
+    if (ix < 0x3fdc0000) { /* |x| < 7/16 */
+        if (ix < 0x3e400000) /* |x| < 2^-27 */
+            return x;
+        id = -1;
     } else {
-        for (int i = 0; i < -n; i++) {
-            result /= 10.0;
+        x = fabs(x);
+        if (ix < 0x3ff30000) { /* |x| < 19/16 */
+            if (ix < 0x3fe60000) { /* |x| < 11/16 */
+                id = 0;
+                x = (2.0 * x - 1.0) / (2.0 + x);
+            } else {
+                id = 1;
+                x = (x - 1.0) / (x + 1.0);
+            }
+        } else if (ix < 0x40038000) { /* |x| < 39/16 */
+            id = 2;
+            x = (x - 1.5) / (1.0 + 1.5 * x);
+        } else {
+            id = 3;
+            x = -1.0 / x;
         }
     }
-    return result;
+
+    double z = x * x;
+    double w = z * z;
+    double s1 = z * (atan_t[0] + w * (atan_t[2] + w * (atan_t[4] + w * (atan_t[6] + w * (atan_t[8] + w * atan_t[10])))));
+    double s2 = w * (atan_t[1] + w * (atan_t[3] + w * (atan_t[5] + w * (atan_t[7] + w * atan_t[9]))));
+    if (id < 0)
+        return x - x * (s1 + s2);
+    z = atan_hi[id] - ((x * (s1 + s2) - atan_lo[id]) - x);
+    return negative ? -z : z;
 }
 
-double log10(double x) {
-    double lower = 0, upper = x, mid = 0;
-    while (upper - lower > 1e-6) { // Continue until the desired precision is reached
-        mid = (lower + upper) / 2;
-        if (pow10(mid) > x) {
-            upper = mid;
-        } else {
-            lower = mid;
+static const double pi_hi = 3.1415926535897931160e+00;
+static const double pi_lo = 1.2246467991473531772e-16;
+
+double atan2(double y, double x) {
+    if (isnan(x) || isnan(y))
+        return x + y;
+    if (x == 1.0)
+        return atan(y);
+
+    /* Bit 0: y negative, bit 1: x negative. */
+    int m = (signbit(y) ? 1 : 0) | (signbit(x) ? 2 : 0);
+    double z;
+
+    if (y == 0.0) {
+        switch (m) {
+        case 0:
+        case 1:
+            return y;
+        case 2:
+            return pi_hi + pi_lo;
+        default:
+            return -pi_hi - pi_lo;
         }
     }
-    return mid;
+    if (x == 0.0)
+        return (m & 1) ? -atan_hi[3] - atan_lo[3] : atan_hi[3] + atan_lo[3];
+    if (isinf(x)) {
+        if (isinf(y)) {
+            static const double corner[4] = {
+                M_PI_4, -M_PI_4, 3 * M_PI_4, -3 * M_PI_4,
+            };
+            return corner[m];
+        }
+        static const double edge[4] = { 0.0, -0.0, M_PI, -M_PI };
+        return edge[m];
+    }
+    if (isinf(y))
+        return (m & 1) ? -atan_hi[3] - atan_lo[3] : atan_hi[3] + atan_lo[3];
+
+    int ey = (int) (high_word(y) >> 20 & 0x7ff);
+    int ex = (int) (high_word(x) >> 20 & 0x7ff);
+    if (ey - ex > 60) /* |y/x| > 2^60 */
+        z = atan_hi[3] + 0.5 * pi_lo;
+    else if ((m & 2) && ex - ey > 60) /* |y/x| < 2^-60 with x < 0 */
+        z = 0.0;
+    else
+        z = atan(fabs(y / x));
+
+    switch (m) {
+    case 0:
+        return z;
+    case 1:
+        return -z;
+    case 2:
+        return pi_hi - (z - pi_lo);
+    default:
+        return (z - pi_lo) - pi_hi;
+    }
 }
 
+/* (1 - x)(1 + x) is exact enough near |x| = 1, where 1 - x*x would cancel. */
+double asin(double x) {
+    return atan2(x, sqrt((1.0 - x) * (1.0 + x)));
+}
 
+double acos(double x) {
+    return atan2(sqrt((1.0 - x) * (1.0 + x)), x);
+}
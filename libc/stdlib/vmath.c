@@ -0,0 +1,505 @@
+#include <emmintrin.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Math over arrays.
+ *
+ * The SSE2 kernels work on two doubles or four floats at a time. The double
+ * ones use the same reductions and fdlibm polynomials as math.c, done
+ * without branches: the nearest multiple comes from adding and subtracting
+ * 1.5 * 2^52 (2^23 for floats), and the sign and quadrant fixups are masks.
+ * Lanes outside the range a kernel handles (huge arguments for sin and cos,
+ * overflow for exp, non-positive or subnormal ones for log, and infinities
+ * and NaNs) are rare, so a single test per vector sends them to the scalar
+ * functions. The float kernels use the shorter single precision polynomials
+ * from Cephes and are good to an ulp or two of float.
+ *
+ * Until the kernel has checked the CPU, every function is a loop over the
+ * scalar math.c ones.
+ */
+
+#pragma GCC push_options
+#pragma GCC target("sse2")
+
+static inline __m128d abs_pd(__m128d x) {
+    return _mm_andnot_pd(_mm_set1_pd(-0.0), x);
+}
+
+static inline __m128 abs_ps(__m128 x) {
+    return _mm_andnot_ps(_mm_set1_ps(-0.0f), x);
+}
+
+/* Where mask is set, b, else a. */
+static inline __m128d select_pd(__m128d mask, __m128d a, __m128d b) {
+    return _mm_or_pd(_mm_andnot_pd(mask, a), _mm_and_pd(mask, b));
+}
+
+static inline __m128 select_ps(__m128 mask, __m128 a, __m128 b) {
+    return _mm_or_ps(_mm_andnot_ps(mask, a), _mm_and_ps(mask, b));
+}
+
+static __attribute__((noinline)) __m128d fixup_pd(__m128d y, __m128d x, int lanes, double (*f)(double)) {
+    double ys[2], xs[2];
+
+    _mm_storeu_pd(ys, y);
+    _mm_storeu_pd(xs, x);
+    for (int i = 0; i < 2; i++) {
+        if (lanes >> i & 1)
+            ys[i] = f(xs[i]);
+    }
+    return _mm_loadu_pd(ys);
+}
+
+static __attribute__((noinline)) __m128 fixup_ps(__m128 y, __m128 x, int lanes, double (*f)(double)) {
+    float ys[4], xs[4];
+
+    _mm_storeu_ps(ys, y);
+    _mm_storeu_ps(xs, x);
+    for (int i = 0; i < 4; i++) {
+        if (lanes >> i & 1)
+            ys[i] = (float) f(xs[i]);
+    }
+    return _mm_loadu_ps(ys);
+}
+
+/*
+ * sin and cos, for |x| <= 2^19 * pi/2. x = n*pi/2 + y0 + y1 with pi/2 in
+ * three 33-bit pieces, so n times each is exact; fdlibm's three reduction
+ * rounds all run, where math.c stops once the result has enough bits. Both
+ * kernels are evaluated and the quadrant picks one.
+ */
+static const double pio2_1 = 1.57079632673412561417e+00;
+static const double pio2_2 = 6.07710050630396597660e-11;
+static const double pio2_2t = 2.02226624879595063154e-21;
+static const double pio2_3 = 2.02226624871116645580e-21;
+static const double pio2_3t = 8.47842766036889956997e-32;
+static const double inv_pio2 = 6.36619772367581382433e-01;
+static const double round_pd = 0x1.8p52;
+
+static const double s1 = -1.66666666666666324348e-01;
+static const double s2 = 8.33333333332248946124e-03;
+static const double s3 = -1.98412698298579493134e-04;
+static const double s4 = 2.75573137070700676789e-06;
+static const double s5 = -2.50507602534068634195e-08;
+static const double s6 = 1.58969099521155010221e-10;
+
+static const double c1 = 4.16666666666666019037e-02;
+static const double c2 = -1.38888888888741095749e-03;
+static const double c3 = 2.48015872894767294178e-05;
+static const double c4 = -2.75573143513906633035e-07;
+static const double c5 = 2.08757232129817482790e-09;
+static const double c6 = -1.13596475577881948265e-11;
+
+/* Returns sin of the reduced argument in *s and cos in *c, and n in the low dword of each lane. */
+static inline __m128i sincos_reduce_pd(__m128d x, __m128d* s, __m128d* c) {
+    __m128d t = _mm_add_pd(_mm_mul_pd(x, _mm_set1_pd(inv_pio2)), _mm_set1_pd(round_pd));
+    __m128d fn = _mm_sub_pd(t, _mm_set1_pd(round_pd));
+    __m128i n = _mm_castpd_si128(t);
+
+    __m128d r = _mm_sub_pd(x, _mm_mul_pd(fn, _mm_set1_pd(pio2_1)));
+    __m128d w = _mm_mul_pd(fn, _mm_set1_pd(pio2_2));
+    __m128d u = r;
+    r = _mm_sub_pd(u, w);
+    w = _mm_sub_pd(_mm_mul_pd(fn, _mm_set1_pd(pio2_2t)), _mm_sub_pd(_mm_sub_pd(u, r), w));
+    u = r;
+    __m128d w3 = _mm_mul_pd(fn, _mm_set1_pd(pio2_3));
+    r = _mm_sub_pd(u, w3);
+    w = _mm_sub_pd(_mm_mul_pd(fn, _mm_set1_pd(pio2_3t)), _mm_sub_pd(_mm_sub_pd(u, r), w3));
+    __m128d y0 = _mm_sub_pd(r, w);
+    __m128d y1 = _mm_sub_pd(_mm_sub_pd(r, y0), w);
+
+    __m128d z = _mm_mul_pd(y0, y0);
+    __m128d half = _mm_set1_pd(0.5);
+
+    /* kernel_sin */
+    __m128d v = _mm_mul_pd(z, y0);
+    __m128d p = _mm_add_pd(_mm_set1_pd(s5), _mm_mul_pd(z, _mm_set1_pd(s6)));
+    p = _mm_add_pd(_mm_set1_pd(s4), _mm_mul_pd(z, p));
+    p = _mm_add_pd(_mm_set1_pd(s3), _mm_mul_pd(z, p));
+    p = _mm_add_pd(_mm_set1_pd(s2), _mm_mul_pd(z, p));
+    __m128d e = _mm_sub_pd(_mm_mul_pd(half, y1), _mm_mul_pd(v, p));
+    e = _mm_sub_pd(_mm_sub_pd(_mm_mul_pd(z, e), y1), _mm_mul_pd(v, _mm_set1_pd(s1)));
+    *s = _mm_sub_pd(y0, e);
+
+    /* kernel_cos */
+    __m128d z2 = _mm_mul_pd(z, z);
+    __m128d q = _mm_add_pd(_mm_set1_pd(c2), _mm_mul_pd(z, _mm_set1_pd(c3)));
+    q = _mm_mul_pd(z, _mm_add_pd(_mm_set1_pd(c1), _mm_mul_pd(z, q)));
+    __m128d q2 = _mm_add_pd(_mm_set1_pd(c5), _mm_mul_pd(z, _mm_set1_pd(c6)));
+    q2 = _mm_add_pd(_mm_set1_pd(c4), _mm_mul_pd(z, q2));
+    q = _mm_add_pd(q, _mm_mul_pd(_mm_mul_pd(z2, z2), q2));
+    __m128d hz = _mm_mul_pd(half, z);
+    __m128d one = _mm_set1_pd(1.0);
+    __m128d wc = _mm_sub_pd(one, hz);
+    __m128d tail = _mm_add_pd(_mm_sub_pd(_mm_sub_pd(one, wc), hz),
+                              _mm_sub_pd(_mm_mul_pd(z, q), _mm_mul_pd(y0, y1)));
+    *c = _mm_add_pd(wc, tail);
+    return n;
+}
+
+/* All ones in the lanes whose n has bit 0 set. */
+static inline __m128d odd_mask_pd(__m128i n) {
+    __m128i odd = _mm_and_si128(n, _mm_set1_epi32(1));
+    odd = _mm_cmpeq_epi32(odd, _mm_set1_epi32(1));
+    return _mm_castsi128_pd(_mm_shuffle_epi32(odd, _MM_SHUFFLE(2, 2, 0, 0)));
+}
+
+/* Bit 1 of n moved to the sign bit of each lane. */
+static inline __m128d sign_pd(__m128i n) {
+    return _mm_castsi128_pd(_mm_and_si128(_mm_slli_epi64(n, 62), _mm_castpd_si128(_mm_set1_pd(-0.0))));
+}
+
+#define SINCOS_LIMIT_PD 0x1.921fb54442d18p+19
+
+static inline __m128d sin_pd(__m128d x) {
+    __m128d s, c;
+    __m128i n = sincos_reduce_pd(x, &s, &c);
+    __m128d y = _mm_xor_pd(select_pd(odd_mask_pd(n), s, c), sign_pd(n));
+
+    int bad = _mm_movemask_pd(_mm_cmpnle_pd(abs_pd(x), _mm_set1_pd(SINCOS_LIMIT_PD)));
+    if (__builtin_expect(bad, 0))
+        y = fixup_pd(y, x, bad, sin);
+    return y;
+}
+
+static inline __m128d cos_pd(__m128d x) {
+    __m128d s, c;
+    __m128i n = sincos_reduce_pd(x, &s, &c);
+    __m128i n1 = _mm_add_epi32(n, _mm_set1_epi32(1));
+    __m128d y = _mm_xor_pd(select_pd(odd_mask_pd(n), c, s), sign_pd(n1));
+
+    int bad = _mm_movemask_pd(_mm_cmpnle_pd(abs_pd(x), _mm_set1_pd(SINCOS_LIMIT_PD)));
+    if (__builtin_expect(bad, 0))
+        y = fixup_pd(y, x, bad, cos);
+    return y;
+}
+
+/* exp, for |x| <= 708 so 2^k is a normal double. */
+static const double ln2_hi = 6.93147180369123816490e-01;
+static const double ln2_lo = 1.90821492927058770002e-10;
+static const double inv_ln2 = 1.44269504088896338700e+00;
+static const double exp_p1 = 1.66666666666666019037e-01;
+static const double exp_p2 = -2.77777777770155933842e-03;
+static const double exp_p3 = 6.61375632143793436117e-05;
+static const double exp_p4 = -1.65339022054652515390e-06;
+static const double exp_p5 = 4.13813679705723846039e-08;
+
+static inline __m128d exp_pd(__m128d x) {
+    __m128d t = _mm_add_pd(_mm_mul_pd(x, _mm_set1_pd(inv_ln2)), _mm_set1_pd(round_pd));
+    __m128d fk = _mm_sub_pd(t, _mm_set1_pd(round_pd));
+    __m128i k = _mm_sub_epi64(_mm_castpd_si128(t), _mm_castpd_si128(_mm_set1_pd(round_pd)));
+
+    __m128d hi = _mm_sub_pd(x, _mm_mul_pd(fk, _mm_set1_pd(ln2_hi)));
+    __m128d lo = _mm_mul_pd(fk, _mm_set1_pd(ln2_lo));
+    __m128d r = _mm_sub_pd(hi, lo);
+    __m128d r2 = _mm_mul_pd(r, r);
+    __m128d p = _mm_add_pd(_mm_set1_pd(exp_p4), _mm_mul_pd(r2, _mm_set1_pd(exp_p5)));
+    p = _mm_add_pd(_mm_set1_pd(exp_p3), _mm_mul_pd(r2, p));
+    p = _mm_add_pd(_mm_set1_pd(exp_p2), _mm_mul_pd(r2, p));
+    p = _mm_add_pd(_mm_set1_pd(exp_p1), _mm_mul_pd(r2, p));
+    __m128d c = _mm_sub_pd(r, _mm_mul_pd(r2, p));
+    __m128d q = _mm_div_pd(_mm_mul_pd(r, c), _mm_sub_pd(_mm_set1_pd(2.0), c));
+    __m128d y = _mm_sub_pd(_mm_set1_pd(1.0), _mm_sub_pd(_mm_sub_pd(lo, q), hi));
+
+    __m128i scale = _mm_slli_epi64(_mm_add_epi64(k, _mm_set1_epi64x(0x3ff)), 52);
+    y = _mm_mul_pd(y, _mm_castsi128_pd(scale));
+
+    int bad = _mm_movemask_pd(_mm_cmpnle_pd(abs_pd(x), _mm_set1_pd(708.0)));
+    if (__builtin_expect(bad, 0))
+        y = fixup_pd(y, x, bad, exp);
+    return y;
+}
+
+/* log, for normal positive x. */
+static const double lg1 = 6.666666666666735130e-01;
+static const double lg2 = 3.999999999940941908e-01;
+static const double lg3 = 2.857142874366239149e-01;
+static const double lg4 = 2.222219843214978396e-01;
+static const double lg5 = 1.818357216161805012e-01;
+static const double lg6 = 1.531383769920937332e-01;
+static const double lg7 = 1.479819860511658591e-01;
+
+static inline __m128d log_pd(__m128d x) {
+    /* Move the mantissa into [sqrt(2)/2, sqrt(2)), as math.c does on the high word. */
+    __m128i ix = _mm_add_epi64(_mm_castpd_si128(x), _mm_set1_epi64x((int64_t) (0x3ff00000 - 0x3fe6a09e) << 32));
+    __m128i k = _mm_sub_epi64(_mm_srli_epi64(ix, 52), _mm_set1_epi64x(0x3ff));
+    __m128i m = _mm_add_epi64(_mm_and_si128(ix, _mm_set1_epi64x(0x000fffffffffffff)),
+                              _mm_set1_epi64x((int64_t) 0x3fe6a09e << 32));
+    __m128d dk = _mm_sub_pd(_mm_castsi128_pd(_mm_add_epi64(k, _mm_castpd_si128(_mm_set1_pd(round_pd)))),
+                            _mm_set1_pd(round_pd));
+    __m128d f = _mm_sub_pd(_mm_castsi128_pd(m), _mm_set1_pd(1.0));
+
+    __m128d s = _mm_div_pd(f, _mm_add_pd(_mm_set1_pd(2.0), f));
+    __m128d z = _mm_mul_pd(s, s);
+    __m128d w = _mm_mul_pd(z, z);
+    __m128d t1 = _mm_add_pd(_mm_set1_pd(lg4), _mm_mul_pd(w, _mm_set1_pd(lg6)));
+    t1 = _mm_mul_pd(w, _mm_add_pd(_mm_set1_pd(lg2), _mm_mul_pd(w, t1)));
+    __m128d t2 = _mm_add_pd(_mm_set1_pd(lg5), _mm_mul_pd(w, _mm_set1_pd(lg7)));
+    t2 = _mm_add_pd(_mm_set1_pd(lg3), _mm_mul_pd(w, t2));
+    t2 = _mm_mul_pd(z, _mm_add_pd(_mm_set1_pd(lg1), _mm_mul_pd(w, t2)));
+    __m128d hfsq = _mm_mul_pd(_mm_mul_pd(_mm_set1_pd(0.5), f), f);
+    __m128d tail = _mm_mul_pd(s, _mm_add_pd(hfsq, _mm_add_pd(t1, t2)));
+    __m128d e = _mm_sub_pd(hfsq, _mm_add_pd(tail, _mm_mul_pd(dk, _mm_set1_pd(ln2_lo))));
+    __m128d y = _mm_sub_pd(_mm_mul_pd(dk, _mm_set1_pd(ln2_hi)), _mm_sub_pd(e, f));
+
+    __m128d ok = _mm_and_pd(_mm_cmpge_pd(x, _mm_set1_pd(0x1p-1022)), _mm_cmple_pd(x, _mm_set1_pd(0x1.fffffffffffffp1023)));
+    int bad = _mm_movemask_pd(ok) ^ 3;
+    if (__builtin_expect(bad, 0))
+        y = fixup_pd(y, x, bad, log);
+    return y;
+}
+
+/*
+ * Float kernels. sin and cos reduce in double, two lanes at a time: x and n
+ * convert exactly, n times the first 33-bit piece of pi/2 is exact, and the
+ * second piece leaves r far more accurate than a float needs while
+ * |x| <= 8192. Reducing in float lost most of r's bits near multiples of
+ * pi/2, where r itself is tiny.
+ */
+static const float round_ps = 0x1.8p23f;
+
+static inline __m128 reduce_pio2_ps(__m128 x, __m128 fn) {
+    __m128 xh = _mm_movehl_ps(x, x);
+    __m128 nh = _mm_movehl_ps(fn, fn);
+    __m128d rl = _mm_sub_pd(_mm_cvtps_pd(x), _mm_mul_pd(_mm_cvtps_pd(fn), _mm_set1_pd(pio2_1)));
+    __m128d rh = _mm_sub_pd(_mm_cvtps_pd(xh), _mm_mul_pd(_mm_cvtps_pd(nh), _mm_set1_pd(pio2_1)));
+    rl = _mm_sub_pd(rl, _mm_mul_pd(_mm_cvtps_pd(fn), _mm_set1_pd(pio2_2)));
+    rh = _mm_sub_pd(rh, _mm_mul_pd(_mm_cvtps_pd(nh), _mm_set1_pd(pio2_2)));
+    return _mm_movelh_ps(_mm_cvtpd_ps(rl), _mm_cvtpd_ps(rh));
+}
+
+static inline __m128i sincos_reduce_ps(__m128 x, __m128* s, __m128* c) {
+    __m128 t = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(0.636619772367581343f)), _mm_set1_ps(round_ps));
+    __m128 fn = _mm_sub_ps(t, _mm_set1_ps(round_ps));
+    __m128i n = _mm_castps_si128(t);
+
+    __m128 r = reduce_pio2_ps(x, fn);
+    __m128 z = _mm_mul_ps(r, r);
+
+    __m128 p = _mm_add_ps(_mm_set1_ps(8.3321608736e-3f), _mm_mul_ps(z, _mm_set1_ps(-1.9515295891e-4f)));
+    p = _mm_add_ps(_mm_set1_ps(-1.6666654611e-1f), _mm_mul_ps(z, p));
+    *s = _mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(r, z), p));
+
+    __m128 q = _mm_add_ps(_mm_set1_ps(-1.388731625493765e-3f), _mm_mul_ps(z, _mm_set1_ps(2.443315711809948e-5f)));
+    q = _mm_add_ps(_mm_set1_ps(4.166664568298827e-2f), _mm_mul_ps(z, q));
+    q = _mm_sub_ps(_mm_mul_ps(_mm_mul_ps(z, z), q), _mm_mul_ps(_mm_set1_ps(0.5f), z));
+    *c = _mm_add_ps(_mm_set1_ps(1.0f), q);
+    return n;
+}
+
+static inline __m128 odd_mask_ps(__m128i n) {
+    __m128i odd = _mm_and_si128(n, _mm_set1_epi32(1));
+    return _mm_castsi128_ps(_mm_cmpeq_epi32(odd, _mm_set1_epi32(1)));
+}
+
+static inline __m128 sign_ps(__m128i n) {
+    return _mm_castsi128_ps(_mm_and_si128(_mm_slli_epi32(n, 30), _mm_set1_epi32(INT32_MIN)));
+}
+
+static inline __m128 sin_ps(__m128 x) {
+    __m128 s, c;
+    __m128i n = sincos_reduce_ps(x, &s, &c);
+    __m128 y = _mm_xor_ps(select_ps(odd_mask_ps(n), s, c), sign_ps(n));
+    /* r + r*z*p is +0 for r = -0; give sin(-0) its sign back. */
+    y = _mm_or_ps(y, _mm_and_ps(x, _mm_cmpeq_ps(x, _mm_setzero_ps())));
+
+    int bad = _mm_movemask_ps(_mm_cmpnle_ps(abs_ps(x), _mm_set1_ps(8192.0f)));
+    if (__builtin_expect(bad, 0))
+        y = fixup_ps(y, x, bad, sin);
+    return y;
+}
+
+static inline __m128 cos_ps(__m128 x) {
+    __m128 s, c;
+    __m128i n = sincos_reduce_ps(x, &s, &c);
+    __m128i n1 = _mm_add_epi32(n, _mm_set1_epi32(1));
+    __m128 y = _mm_xor_ps(select_ps(odd_mask_ps(n), c, s), sign_ps(n1));
+
+    int bad = _mm_movemask_ps(_mm_cmpnle_ps(abs_ps(x), _mm_set1_ps(8192.0f)));
+    if (__builtin_expect(bad, 0))
+        y = fixup_ps(y, x, bad, cos);
+    return y;
+}
+
+/* exp, for |x| <= 87 so 2^k is a normal float. ln2 is split as for double. */
+static inline __m128 exp_ps(__m128 x) {
+    __m128 t = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(1.44269504088896341f)), _mm_set1_ps(round_ps));
+    __m128 fk = _mm_sub_ps(t, _mm_set1_ps(round_ps));
+    __m128i k = _mm_sub_epi32(_mm_castps_si128(t), _mm_castps_si128(_mm_set1_ps(round_ps)));
+
+    __m128 r = _mm_sub_ps(x, _mm_mul_ps(fk, _mm_set1_ps(0.693359375f)));
+    r = _mm_sub_ps(r, _mm_mul_ps(fk, _mm_set1_ps(-2.12194440e-4f)));
+    __m128 p = _mm_add_ps(_mm_set1_ps(1.3981999507e-3f), _mm_mul_ps(r, _mm_set1_ps(1.9875691500e-4f)));
+    p = _mm_add_ps(_mm_set1_ps(8.3334519073e-3f), _mm_mul_ps(r, p));
+    p = _mm_add_ps(_mm_set1_ps(4.1665795894e-2f), _mm_mul_ps(r, p));
+    p = _mm_add_ps(_mm_set1_ps(1.6666665459e-1f), _mm_mul_ps(r, p));
+    p = _mm_add_ps(_mm_set1_ps(5.0000001201e-1f), _mm_mul_ps(r, p));
+    __m128 y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(r, r), p), r), _mm_set1_ps(1.0f));
+
+    __m128i scale = _mm_slli_epi32(_mm_add_epi32(k, _mm_set1_epi32(0x7f)), 23);
+    y = _mm_mul_ps(y, _mm_castsi128_ps(scale));
+
+    int bad = _mm_movemask_ps(_mm_cmpnle_ps(abs_ps(x), _mm_set1_ps(87.0f)));
+    if (__builtin_expect(bad, 0))
+        y = fixup_ps(y, x, bad, exp);
+    return y;
+}
+
+/* log, for normal positive x. f = mantissa - 1 is in [sqrt(2)/2 - 1, sqrt(2) - 1). */
+static inline __m128 log_ps(__m128 x) {
+    __m128i ix = _mm_add_epi32(_mm_castps_si128(x), _mm_set1_epi32(0x3f800000 - 0x3f3504f3));
+    __m128 fk = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(ix, 23), _mm_set1_epi32(0x7f)));
+    __m128i m = _mm_add_epi32(_mm_and_si128(ix, _mm_set1_epi32(0x007fffff)), _mm_set1_epi32(0x3f3504f3));
+    __m128 f = _mm_sub_ps(_mm_castsi128_ps(m), _mm_set1_ps(1.0f));
+    __m128 z = _mm_mul_ps(f, f);
+
+    __m128 p = _mm_add_ps(_mm_set1_ps(-1.1514610310e-1f), _mm_mul_ps(f, _mm_set1_ps(7.0376836292e-2f)));
+    p = _mm_add_ps(_mm_set1_ps(1.1676998740e-1f), _mm_mul_ps(f, p));
+    p = _mm_add_ps(_mm_set1_ps(-1.2420140846e-1f), _mm_mul_ps(f, p));
+    p = _mm_add_ps(_mm_set1_ps(1.4249322787e-1f), _mm_mul_ps(f, p));
+    p = _mm_add_ps(_mm_set1_ps(-1.6668057665e-1f), _mm_mul_ps(f, p));
+    p = _mm_add_ps(_mm_set1_ps(2.0000714765e-1f), _mm_mul_ps(f, p));
+    p = _mm_add_ps(_mm_set1_ps(-2.4999993993e-1f), _mm_mul_ps(f, p));
+    p = _mm_add_ps(_mm_set1_ps(3.3333331174e-1f), _mm_mul_ps(f, p));
+    __m128 y = _mm_mul_ps(_mm_mul_ps(f, z), p);
+    y = _mm_add_ps(y, _mm_mul_ps(fk, _mm_set1_ps(-2.12194440e-4f)));
+    y = _mm_sub_ps(y, _mm_mul_ps(_mm_set1_ps(0.5f), z));
+    y = _mm_add_ps(_mm_add_ps(f, y), _mm_mul_ps(fk, _mm_set1_ps(0.693359375f)));
+
+    __m128 ok = _mm_and_ps(_mm_cmpge_ps(x, _mm_set1_ps(0x1p-126f)), _mm_cmple_ps(x, _mm_set1_ps(0x1.fffffep127f)));
+    int bad = _mm_movemask_ps(ok) ^ 15;
+    if (__builtin_expect(bad, 0))
+        y = fixup_ps(y, x, bad, log);
+    return y;
+}
+
+static inline __m128d sqrt_pd(__m128d x) {
+    return _mm_sqrt_pd(x);
+}
+
+static inline __m128 sqrt_ps(__m128 x) {
+    return _mm_sqrt_ps(x);
+}
+
+/* Whole vectors, then the tail in a vector padded with ones. */
+#define VMATH_SSE2_PD(name, kernel) \
+    static void name(double* y, const double* x, size_t n) { \
+        size_t i = 0; \
+        for (; i + 2 <= n; i += 2) \
+            _mm_storeu_pd(y + i, kernel(_mm_loadu_pd(x + i))); \
+        if (i < n) \
+            _mm_store_sd(y + i, kernel(_mm_loadh_pd(_mm_load_sd(x + i), &one_d))); \
+    }
+
+#define VMATH_SSE2_PS(name, kernel) \
+    static void name(float* y, const float* x, size_t n) { \
+        size_t i = 0; \
+        for (; i + 4 <= n; i += 4) \
+            _mm_storeu_ps(y + i, kernel(_mm_loadu_ps(x + i))); \
+        if (i < n) { \
+            float t[4] = { 1.0f, 1.0f, 1.0f, 1.0f }; \
+            for (size_t j = 0; i + j < n; j++) \
+                t[j] = x[i + j]; \
+            _mm_storeu_ps(t, kernel(_mm_loadu_ps(t))); \
+            for (size_t j = 0; i + j < n; j++) \
+                y[i + j] = t[j]; \
+        } \
+    }
+
+static const double one_d = 1.0;
+
+VMATH_SSE2_PD(vsin_sse2, sin_pd)
+VMATH_SSE2_PD(vcos_sse2, cos_pd)
+VMATH_SSE2_PD(vexp_sse2, exp_pd)
+VMATH_SSE2_PD(vlog_sse2, log_pd)
+VMATH_SSE2_PD(vsqrt_sse2, sqrt_pd)
+VMATH_SSE2_PS(vsinf_sse2, sin_ps)
+VMATH_SSE2_PS(vcosf_sse2, cos_ps)
+VMATH_SSE2_PS(vexpf_sse2, exp_ps)
+VMATH_SSE2_PS(vlogf_sse2, log_ps)
+VMATH_SSE2_PS(vsqrtf_sse2, sqrt_ps)
+
+#pragma GCC pop_options
+
+#define VMATH_SCALAR(name, type, f) \
+    static void name(type* y, const type* x, size_t n) { \
+        for (size_t i = 0; i < n; i++) \
+            y[i] = (type) f(x[i]); \
+    }
+
+VMATH_SCALAR(vsin_scalar, double, sin)
+VMATH_SCALAR(vcos_scalar, double, cos)
+VMATH_SCALAR(vexp_scalar, double, exp)
+VMATH_SCALAR(vlog_scalar, double, log)
+VMATH_SCALAR(vsqrt_scalar, double, sqrt)
+VMATH_SCALAR(vsinf_scalar, float, sin)
+VMATH_SCALAR(vcosf_scalar, float, cos)
+VMATH_SCALAR(vexpf_scalar, float, exp)
+VMATH_SCALAR(vlogf_scalar, float, log)
+VMATH_SCALAR(vsqrtf_scalar, float, sqrt)
+
+static void (*vsin_impl)(double*, const double*, size_t) = vsin_scalar;
+static void (*vcos_impl)(double*, const double*, size_t) = vcos_scalar;
+static void (*vexp_impl)(double*, const double*, size_t) = vexp_scalar;
+static void (*vlog_impl)(double*, const double*, size_t) = vlog_scalar;
+static void (*vsqrt_impl)(double*, const double*, size_t) = vsqrt_scalar;
+static void (*vsinf_impl)(float*, const float*, size_t) = vsinf_scalar;
+static void (*vcosf_impl)(float*, const float*, size_t) = vcosf_scalar;
+static void (*vexpf_impl)(float*, const float*, size_t) = vexpf_scalar;
+static void (*vlogf_impl)(float*, const float*, size_t) = vlogf_scalar;
+static void (*vsqrtf_impl)(float*, const float*, size_t) = vsqrtf_scalar;
+
+void __math_enable_sse2(void) {
+    vsin_impl = vsin_sse2;
+    vcos_impl = vcos_sse2;
+    vexp_impl = vexp_sse2;
+    vlog_impl = vlog_sse2;
+    vsqrt_impl = vsqrt_sse2;
+    vsinf_impl = vsinf_sse2;
+    vcosf_impl = vcosf_sse2;
+    vexpf_impl = vexpf_sse2;
+    vlogf_impl = vlogf_sse2;
+    vsqrtf_impl = vsqrtf_sse2;
+}
+
+void vsin(double* y, const double* x, size_t n) {
+    vsin_impl(y, x, n);
+}
+
+void vcos(double* y, const double* x, size_t n) {
+    vcos_impl(y, x, n);
+}
+
+void vexp(double* y, const double* x, size_t n) {
+    vexp_impl(y, x, n);
+}
+
+void vlog(double* y, const double* x, size_t n) {
+    vlog_impl(y, x, n);
+}
+
+void vsqrt(double* y, const double* x, size_t n) {
+    vsqrt_impl(y, x, n);
+}
+
+void vsinf(float* y, const float* x, size_t n) {
+    vsinf_impl(y, x, n);
+}
+
+void vcosf(float* y, const float* x, size_t n) {
+    vcosf_impl(y, x, n);
+}
+
+void vexpf(float* y, const float* x, size_t n) {
+    vexpf_impl(y, x, n);
+}
+
+void vlogf(float* y, const float* x, size_t n) {
+    vlogf_impl(y, x, n);
+}
+
+void vsqrtf(float* y, const float* x, size_t n) {
+    vsqrtf_impl(y, x, n);
+}
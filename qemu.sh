@@ -2,4 +2,11 @@
 set -e
 . ./iso.sh
 
-qemu-system-$(./target-triplet-to-arch.sh $HOST) -cdrom barebones.iso
+# "./qemu.sh serial" runs headless with the COM1 console on stdio. SMP sets
+# the number of CPUs, 4 by default: SMP=1 ./qemu.sh
+case "$1" in
+  serial) QEMU_DISPLAY="-serial stdio -display none" ;;
+  *)      QEMU_DISPLAY="" ;;
+esac
+
+qemu-system-$(./target-triplet-to-arch.sh $HOST) -smp ${SMP:-4} -cdrom barebones.iso $QEMU_DISPLAY
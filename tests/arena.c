@@ -0,0 +1,194 @@
+/*
+ * Test for the arena allocator in libc/stdlib/arena.c, on the buddy
+ * allocator over physmem.c's memory.
+ *
+ * Every allocation has to be aligned as asked, inside the arena and clear
+ * of the ones before it. A fixed arena has to hand out exactly its buffer
+ * and then fail, without giving out anything past its end. A growing one
+ * chains page blocks; resetting to a mark has to give back to the page
+ * allocator just the blocks taken since the mark and carry on from where
+ * the mark was, and arena_release all of them. A zero-byte allocation
+ * from a growing arena with no buffer is a real one.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <kernel/pmm.h>
+
+#include "physmem.h"
+
+// From libc/include/stdlib.h; keep in step.
+struct arena_chunk;
+
+struct arena {
+	char* cur;
+	char* end;
+	char* buf;
+	char* buf_end;
+	struct arena_chunk* chunk;
+	int grow;
+};
+
+struct arena_mark {
+	struct arena_chunk* chunk;
+	char* cur;
+};
+
+void arena_init(struct arena* arena, void* buf, size_t size);
+void arena_init_growing(struct arena* arena, void* buf, size_t size);
+void* arena_alloc(struct arena* arena, size_t size, size_t align);
+struct arena_mark arena_mark(const struct arena* arena);
+void arena_reset(struct arena* arena, struct arena_mark mark);
+void arena_release(struct arena* arena);
+
+#define FIXED_SIZE 65536
+#define GROWN_ALLOCS 200
+
+static char fixed_buf[FIXED_SIZE + 1] __attribute__((aligned(16)));
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ull;
+
+static uint64_t rng(void) {
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return rng_state;
+}
+
+static void fail(const char* what, const void* ptr, size_t size, size_t align) {
+	printf("arena: %s: %p, %zu bytes, align %zu\n", what, ptr, size, align);
+	exit(1);
+}
+
+// An allocation that has to succeed. Chunks come from anywhere in the page
+// allocator, so only the alignment can be checked; the bytes are written so
+// that a chunk smaller than it claims corrupts its neighbour's header.
+static char* checked_alloc(struct arena* arena, size_t size, size_t align) {
+	char* p = arena_alloc(arena, size, align);
+
+	if (!p)
+		fail("allocation failed", NULL, size, align);
+	if ((uintptr_t) p & (align - 1))
+		fail("misaligned", p, size, align);
+	memset(p, 0xA5, size);
+	return p;
+}
+
+static void test_fixed(void) {
+	struct arena arena;
+	char* last_end = NULL;
+	size_t handed_out = 0;
+
+	// One byte in, so the buffer itself is misaligned.
+	char* buf = fixed_buf + 1;
+	arena_init(&arena, buf, FIXED_SIZE);
+	for (;;) {
+		size_t size = rng() % 200;
+		size_t align = (size_t) 1 << rng() % 8;
+		char* p = arena_alloc(&arena, size, align);
+		if (!p)
+			break;
+		if ((uintptr_t) p & (align - 1))
+			fail("misaligned", p, size, align);
+		if (p < buf || p + size > buf + FIXED_SIZE || (last_end && p < last_end))
+			fail("outside the buffer or overlapping", p, size, align);
+		last_end = p + size;
+		handed_out += size;
+	}
+	if ((size_t) (buf + FIXED_SIZE - last_end) >= 200 + 128)
+		fail("full with room left", last_end, 0, 0);
+
+	// Full: what is left still fits exactly, and not a byte more.
+	size_t left = (size_t) (buf + FIXED_SIZE - last_end);
+	if (arena_alloc(&arena, left + 1, 1))
+		fail("allocated past the end", last_end, left + 1, 1);
+	if (arena_alloc(&arena, left, 1) != last_end)
+		fail("the last bytes did not fit", last_end, left, 1);
+	if (arena_alloc(&arena, 1, 1) || arena_alloc(&arena, SIZE_MAX, 1) || arena_alloc(&arena, 0, 1u << 20))
+		fail("allocated from an exhausted arena", NULL, 1, 1);
+	printf("arena: fixed arena handed out %zu bytes at alignments up to 128, then failed\n", handed_out);
+}
+
+static void test_growing(void) {
+	static char small[256];
+	struct arena arena;
+	size_t free_at_start = pmm_free_frames();
+
+	arena_init_growing(&arena, small, sizeof(small));
+	checked_alloc(&arena, 200, 8);
+	struct arena_mark start = arena_mark(&arena);
+
+	// Enough to need many chunks, some bigger than a page.
+	for (unsigned i = 0; i < GROWN_ALLOCS / 2; i++)
+		checked_alloc(&arena, 1 + rng() % 3000, (size_t) 1 << rng() % 7);
+	checked_alloc(&arena, 5 * PAGE_SIZE, PAGE_SIZE);
+	size_t free_at_mark = pmm_free_frames();
+	if (free_at_mark >= free_at_start)
+		fail("no page blocks taken", NULL, 0, 0);
+	struct arena_mark middle = arena_mark(&arena);
+	char* after_middle = arena_alloc(&arena, 16, 16);
+
+	for (unsigned i = 0; i < GROWN_ALLOCS / 2; i++)
+		checked_alloc(&arena, 1 + rng() % 3000, 16);
+	if (pmm_free_frames() >= free_at_mark)
+		fail("no page blocks taken after the mark", NULL, 0, 0);
+
+	arena_reset(&arena, middle);
+	if (pmm_free_frames() != free_at_mark)
+		fail("reset did not return the blocks taken since the mark", NULL, pmm_free_frames(), free_at_mark);
+	if (arena_alloc(&arena, 16, 16) != after_middle)
+		fail("reset did not go back to the mark", after_middle, 16, 16);
+
+	arena_reset(&arena, start);
+	if (pmm_free_frames() != free_at_start)
+		fail("reset to the first mark did not return every block", NULL, pmm_free_frames(), free_at_start);
+	if (arena_alloc(&arena, 56, 1) != small + 200)
+		fail("reset to the first mark did not go back into the buffer", small + 200, 56, 1);
+
+	// Too big for any page block.
+	if (arena_alloc(&arena, ((size_t) PAGE_SIZE << PMM_MAX_ORDER) + 1, 1))
+		fail("allocated more than the largest page block", NULL, 0, 1);
+	if (pmm_free_frames() != free_at_start)
+		fail("a failed allocation kept pages", NULL, 0, 0);
+
+	for (unsigned i = 0; i < GROWN_ALLOCS; i++)
+		arena_alloc(&arena, 1 + rng() % 8000, 64);
+	arena_release(&arena);
+	if (pmm_free_frames() != free_at_start)
+		fail("arena_release did not return every block", NULL, pmm_free_frames(), free_at_start);
+	if (arena_alloc(&arena, sizeof(small), 1) != small)
+		fail("arena_release did not empty the buffer", small, sizeof(small), 1);
+	printf("arena: growing arena returned its page blocks on reset and release\n");
+}
+
+static void test_no_buffer(void) {
+	struct arena arena;
+	size_t free_at_start = pmm_free_frames();
+
+	arena_init_growing(&arena, NULL, 0);
+	char* zero = arena_alloc(&arena, 0, 1);
+	if (!zero)
+		fail("zero bytes from a growing arena with no buffer", NULL, 0, 1);
+	char* next = arena_alloc(&arena, 8, 8);
+	if (!next)
+		fail("allocation after a zero-byte one", next, 8, 8);
+	arena_release(&arena);
+	if (pmm_free_frames() != free_at_start)
+		fail("arena_release did not return every block", NULL, pmm_free_frames(), free_at_start);
+
+	arena_init(&arena, NULL, 0);
+	if (arena_alloc(&arena, 1, 1))
+		fail("allocated from a fixed arena with no buffer", NULL, 1, 1);
+	printf("arena: zero-byte allocation from a growing arena with no buffer\n");
+}
+
+int main(void) {
+	physmem_boot();
+	test_fixed();
+	test_growing();
+	test_no_buffer();
+	return 0;
+}
@@ -0,0 +1,19 @@
+#ifndef _KERNEL_IRQ_H
+#define _KERNEL_IRQ_H
+
+// Host stand-in for kernel/irq.h: there are no interrupts to turn off.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define EFLAGS_IF (1u << 9)
+
+static inline uint32_t irq_save(void) {
+	return 0;
+}
+
+static inline void irq_restore(uint32_t eflags) {
+	(void) eflags;
+}
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef _KERNEL_SMP_H
+#define _KERNEL_SMP_H
+
+// Host stand-in for kernel/smp.h: each test thread plays a CPU, and
+// this_cpu is the struct cpu the thread was given.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define MAX_CPUS 16
+
+struct cpu {
+	unsigned id;
+	unsigned rcu_nesting;
+	uint32_t rcu_seq;
+};
+
+extern _Thread_local struct cpu* test_cpu;
+
+static inline struct cpu* this_cpu(void) {
+	return test_cpu;
+}
+
+unsigned smp_cpu_count(void);
+struct cpu* smp_cpu(unsigned id);
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef _KERNEL_VMM_H
+#define _KERNEL_VMM_H
+
+// Host stand-in for kernel/vmm.h. "Physical memory" is the test's
+// test_memory array, and the direct map is that array.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define KERNEL_DIRECT_MAP_SIZE (256u << 20)
+
+extern char test_memory[KERNEL_DIRECT_MAP_SIZE];
+
+static inline void* phys_to_virt(uintptr_t phys) {
+	return test_memory + phys;
+}
+
+// Defined by the test, which also places the kernel image symbols.
+uintptr_t virt_to_phys(const void* virt);
+
+#endif
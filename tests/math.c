@@ -0,0 +1,296 @@
+/*
+ * Accuracy and speed of libc/stdlib/math.c against the host's libm. libc's
+ * functions are built with a k_ prefix and with -mfpmath=387, so they run
+ * on the x87 as they do on i386.
+ *
+ * Every function is compared with the host's long double version over
+ * random arguments in ranges that exercise its reduction, and the one
+ * argument transcendentals over random bit patterns as well, so every
+ * exponent comes up. The error is measured in ulps of the correctly
+ * rounded result and must stay under a bound per function. fmod, floor,
+ * ceil and sqrt must be exact. Then a grid of special values (zeros of
+ * both signs, infinities, NaN, subnormals, huge values, integers) goes
+ * through every function, and the result must match the host's double
+ * version to within an ulp, NaN for NaN. Last, both are timed in cycles
+ * per call.
+ */
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <x86intrin.h>
+
+double k_acos(double);
+double k_asin(double);
+double k_atan(double);
+double k_atan2(double, double);
+double k_ceil(double);
+double k_cos(double);
+double k_exp(double);
+double k_floor(double);
+double k_fmod(double, double);
+double k_log(double);
+double k_log10(double);
+double k_pow(double, double);
+double k_sin(double);
+double k_sqrt(double);
+double k_tan(double);
+
+#define SAMPLES 1000000
+#define BITS_SAMPLES 1000000
+#define BENCH_ARGS 4096
+#define BENCH_ROUNDS 50
+
+struct function {
+	const char* name;
+	double (*f)(double);
+	long double (*ref)(long double);
+	double (*host)(double);
+	double max_ulp;
+};
+
+static const struct function functions[] = {
+	{ "sin", k_sin, sinl, sin, 1 },
+	{ "cos", k_cos, cosl, cos, 1 },
+	{ "tan", k_tan, tanl, tan, 1 },
+	{ "exp", k_exp, expl, exp, 1 },
+	{ "log", k_log, logl, log, 1 },
+	{ "log10", k_log10, log10l, log10, 1 },
+	{ "atan", k_atan, atanl, atan, 1 },
+	{ "asin", k_asin, asinl, asin, 2 },
+	{ "acos", k_acos, acosl, acos, 2 },
+	{ "sqrt", k_sqrt, sqrtl, sqrt, 0 },
+	{ "floor", k_floor, floorl, floor, 0 },
+	{ "ceil", k_ceil, ceill, ceil, 0 },
+};
+
+#define FUNCTIONS (sizeof(functions) / sizeof(functions[0]))
+
+struct range {
+	const char* name;
+	double lo;
+	double hi;
+};
+
+static const struct range ranges[][4] = {
+	{ { "sin", -3.2, 3.2 }, { "sin", -1e6, 1e6 }, { "sin", -1e300, 1e300 } },
+	{ { "cos", -3.2, 3.2 }, { "cos", -1e6, 1e6 }, { "cos", -1e300, 1e300 } },
+	{ { "tan", -3.2, 3.2 }, { "tan", -1e6, 1e6 }, { "tan", -1e22, 1e22 } },
+	{ { "exp", -745, 709.7 }, { "exp", -1, 1 } },
+	{ { "log", 1e-300, 1e300 }, { "log", 0.5, 2 }, { "log", 0, 1e-310 } },
+	{ { "log10", 1e-300, 1e300 }, { "log10", 0.5, 2 } },
+	{ { "atan", -10, 10 }, { "atan", -1e20, 1e20 } },
+	{ { "asin", -1, 1 } },
+	{ { "acos", -1, 1 } },
+	{ { "sqrt", 0, 1e300 }, { "sqrt", 0, 1e-300 } },
+	{ { "floor", -1e17, 1e17 }, { "floor", -3, 3 } },
+	{ { "ceil", -1e17, 1e17 }, { "ceil", -3, 3 } },
+};
+
+static const double specials[] = {
+	0.0, -0.0, 1.0, -1.0, 0.5, -0.5, 2.0, -2.0, 3.0, -3.0, 0.25, 7.0, -7.0,
+	INFINITY, -INFINITY, NAN, 1e-310, -1e-310, 1e308, -1e308, 1e300,
+	4503599627370497.0,
+};
+
+#define SPECIALS (sizeof(specials) / sizeof(specials[0]))
+
+static int failures;
+
+static uint64_t rng_state = 88172645463325252ull;
+
+static uint64_t rng(void) {
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return rng_state;
+}
+
+static double uniform(double lo, double hi) {
+	return lo + (hi - lo) * ((rng() >> 11) * 0x1p-53);
+}
+
+// The error of got in ulps of ref rounded to double.
+static double ulp_error(double got, long double ref) {
+	double rounded = (double) ref;
+	int exponent;
+
+	if (isnan(got) && isnan(rounded))
+		return 0;
+	if (got == rounded)
+		return 0;
+	if (isinf(got) || isinf(rounded) || isnan(got) || isnan(rounded))
+		return INFINITY;
+	frexp(rounded, &exponent);
+	double ulp = ldexp(1.0, exponent - 53);
+	if (ulp < 0x1p-1074)
+		ulp = 0x1p-1074;
+	return (double) (fabsl((long double) got - ref) / ulp);
+}
+
+static void report(const char* name, const char* where, double max, double at, double at2, double bound) {
+	printf("math: %-6s %-22s max %.3f ulp", name, where, max);
+	if (max > 0) {
+		printf(" at %.17g", at);
+		if (!isnan(at2))
+			printf(", %.17g", at2);
+	}
+	if (max > bound) {
+		printf("  FAILED, bound %g", bound);
+		failures++;
+	}
+	printf("\n");
+}
+
+static void test_ranges(void) {
+	for (size_t i = 0; i < FUNCTIONS; i++) {
+		const struct function* fn = &functions[i];
+		for (size_t r = 0; r < 4 && ranges[i][r].name; r++) {
+			double lo = ranges[i][r].lo, hi = ranges[i][r].hi, max = 0, at = 0;
+			char where[32];
+			for (unsigned n = 0; n < SAMPLES; n++) {
+				double x = uniform(lo, hi);
+				double e = ulp_error(fn->f(x), fn->ref(x));
+				if (e > max) {
+					max = e;
+					at = x;
+				}
+			}
+			snprintf(where, sizeof(where), "[%g, %g]", lo, hi);
+			report(fn->name, where, max, at, NAN, fn->max_ulp);
+		}
+	}
+}
+
+// Finite doubles of every exponent, for the functions defined on all of
+// them or on all positive ones.
+static void test_all_bits(void) {
+	for (size_t i = 0; i < FUNCTIONS; i++) {
+		const struct function* fn = &functions[i];
+		double max = 0, at = 0;
+		if (fn->f == k_asin || fn->f == k_acos)
+			continue;
+		for (unsigned n = 0; n < BITS_SAMPLES; n++) {
+			uint64_t bits = rng() & 0x7FEFFFFFFFFFFFFFull;
+			double x;
+			memcpy(&x, &bits, sizeof(x));
+			if (fn->f != k_log && fn->f != k_log10 && fn->f != k_sqrt && rng() % 2)
+				x = -x;
+			double e = ulp_error(fn->f(x), fn->ref(x));
+			if (e > max) {
+				max = e;
+				at = x;
+			}
+		}
+		report(fn->name, "all exponents", max, at, NAN, fn->max_ulp);
+	}
+}
+
+static void test_two_arguments(void) {
+	double max = 0, at = 0, at2 = 0;
+
+	for (unsigned n = 0; n < 2 * SAMPLES; n++) {
+		double x = uniform(0, 50), y = uniform(-200, 200);
+		// Half of them with results across the whole exponent range.
+		if (n % 2) {
+			x = exp(uniform(-700, 700));
+			y = uniform(-1, 1) * 700 / (fabs(log(x)) + 1e-3);
+		}
+		double e = ulp_error(k_pow(x, y), powl(x, y));
+		if (e > max) {
+			max = e;
+			at = x;
+			at2 = y;
+		}
+	}
+	report("pow", "x^y", max, at, at2, 1);
+
+	max = 0;
+	for (unsigned n = 0; n < SAMPLES; n++) {
+		double x = uniform(-10, 10), y = uniform(-10, 10);
+		double e = ulp_error(k_atan2(y, x), atan2l(y, x));
+		if (e > max) {
+			max = e;
+			at = y;
+			at2 = x;
+		}
+	}
+	report("atan2", "[-10, 10]^2", max, at, at2, 2);
+
+	max = 0;
+	for (unsigned n = 0; n < SAMPLES; n++) {
+		double x = uniform(-1e30, 1e30), y = uniform(-1e3, 1e3);
+		if (n % 2)
+			y = ldexp(y, -(int) (rng() % 900));
+		double e = ulp_error(k_fmod(x, y), fmod(x, y));
+		if (e > max) {
+			max = e;
+			at = x;
+			at2 = y;
+		}
+	}
+	report("fmod", "huge x, tiny y", max, at, at2, 0);
+}
+
+static void check_special(const char* name, double x, double y, double got, double expected) {
+	if (ulp_error(got, expected) > 1 || (got == 0 && expected == 0 && signbit(got) != signbit(expected))) {
+		printf("math: %s(%a, %a) = %a, host %a\n", name, x, y, got, expected);
+		failures++;
+	}
+}
+
+static void test_specials(void) {
+	for (size_t i = 0; i < SPECIALS; i++) {
+		double x = specials[i];
+		for (size_t f = 0; f < FUNCTIONS; f++)
+			check_special(functions[f].name, x, NAN, functions[f].f(x), functions[f].host(x));
+		for (size_t j = 0; j < SPECIALS; j++) {
+			double y = specials[j];
+			check_special("pow", x, y, k_pow(x, y), pow(x, y));
+			check_special("atan2", y, x, k_atan2(y, x), atan2(y, x));
+			check_special("fmod", x, y, k_fmod(x, y), fmod(x, y));
+		}
+	}
+	printf("math: %zu special values through every function\n", SPECIALS);
+}
+
+static volatile double sink;
+
+static double cycles_per_call(double (*f)(double), const double* args) {
+	double sum = 0;
+	uint64_t start = __rdtsc();
+	for (unsigned r = 0; r < BENCH_ROUNDS; r++) {
+		for (unsigned i = 0; i < BENCH_ARGS; i++)
+			sum += f(args[i]);
+	}
+	uint64_t cycles = __rdtsc() - start;
+	sink = sum;
+	return (double) cycles / (BENCH_ROUNDS * BENCH_ARGS);
+}
+
+static void bench(void) {
+	static double args[BENCH_ARGS];
+
+	printf("math: %-22s %10s %10s\n", "cycles per call", "libc", "host");
+	for (size_t i = 0; i < FUNCTIONS; i++) {
+		// The first range of each is the common one.
+		for (unsigned n = 0; n < BENCH_ARGS; n++)
+			args[n] = uniform(ranges[i][0].lo, ranges[i][0].hi);
+		printf("math: %-22s %10.1f %10.1f\n", functions[i].name, cycles_per_call(functions[i].f, args),
+		       cycles_per_call(functions[i].host, args));
+	}
+}
+
+int main(void) {
+	test_ranges();
+	test_all_bits();
+	test_two_arguments();
+	test_specials();
+	bench();
+	if (failures) {
+		printf("math: %d failures\n", failures);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,57 @@
+/*
+ * test_memory and the linker and direct map symbols the kernel code under
+ * test expects, with a memory map that has the holes a PC has below 1 MiB,
+ * a reserved range below a second bank, a hole at the very top and an
+ * entry above the direct map.
+ */
+#include <stdint.h>
+#include <string.h>
+
+#include <kernel/multiboot.h>
+#include <kernel/pmm.h>
+#include <kernel/vmm.h>
+
+#include "physmem.h"
+
+#define KERNEL_PHYS 0x100000
+#define KERNEL_SIZE (2u << 20)
+#define MBI_PHYS 0x9000
+
+char test_memory[KERNEL_DIRECT_MAP_SIZE] __attribute__((aligned(PAGE_SIZE)));
+char _kernel_start[1];
+char _kernel_end[1];
+
+const struct multiboot_mmap_entry physmem_map[] = {
+	{ 20, 0x0, 0x9FC00, MULTIBOOT_MEMORY_AVAILABLE },
+	{ 20, 0x9FC00, 0x400, 2 },
+	{ 20, 0xF0000, 0x10000, 2 },
+	{ 20, 0x100000, 0x07EE0000, MULTIBOOT_MEMORY_AVAILABLE },
+	{ 20, 0x07FE0000, 0x20000, 2 },
+	{ 20, 0x08000000, 0x07FFF000, MULTIBOOT_MEMORY_AVAILABLE },
+	{ 20, 0x0FFFF000, 0x1000, 2 },
+	{ 20, 0x100000000, 0x40000000, MULTIBOOT_MEMORY_AVAILABLE },
+};
+
+const size_t physmem_map_entries = sizeof(physmem_map) / sizeof(physmem_map[0]);
+
+uintptr_t virt_to_phys(const void* virt) {
+	if (virt == _kernel_start)
+		return KERNEL_PHYS;
+	if (virt == _kernel_end)
+		return KERNEL_PHYS + KERNEL_SIZE;
+	return (uintptr_t) ((const char*) virt - test_memory);
+}
+
+void physmem_boot(void) {
+	struct multiboot_info* mbi = phys_to_virt(MBI_PHYS);
+	uint32_t mmap = MBI_PHYS + sizeof(*mbi);
+
+	memset(mbi, 0, sizeof(*mbi));
+	mbi->flags = MULTIBOOT_INFO_MEMORY | MULTIBOOT_INFO_MEM_MAP;
+	mbi->mem_lower = 639;
+	mbi->mem_upper = (0x07FE0000 - 0x100000) / 1024;
+	mbi->mmap_addr = mmap;
+	mbi->mmap_length = (uint32_t) sizeof(physmem_map);
+	memcpy(phys_to_virt(mmap), physmem_map, sizeof(physmem_map));
+	pmm_initialize(mbi);
+}
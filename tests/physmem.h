@@ -0,0 +1,18 @@
+#ifndef _TESTS_PHYSMEM_H
+#define _TESTS_PHYSMEM_H
+
+// Physical memory for the kernel code under test: test_memory, from
+// include/kernel/vmm.h, with a PC-like multiboot memory map over it.
+
+#include <stddef.h>
+
+#include <kernel/multiboot.h>
+
+extern const struct multiboot_mmap_entry physmem_map[];
+extern const size_t physmem_map_entries;
+
+// Writes the multiboot structures into test_memory and runs pmm_initialize
+// on them.
+void physmem_boot(void);
+
+#endif
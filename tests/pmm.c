@@ -0,0 +1,217 @@
+/*
+ * Stress test for the buddy allocator. kernel/kernel/pmm.c is built
+ * straight into the test, with include/kernel/ standing in for the kernel
+ * headers that need the real machine: test_memory is physical memory and
+ * its direct map, and the locks are no-ops.
+ *
+ * pmm_initialize gets physmem.c's memory map. Then millions of random
+ * allocations of random orders and frees in random order, each block
+ * checked for alignment, for lying inside usable memory clear of every
+ * reserved range and for overlapping no other live block. The free count
+ * has to follow along, and once everything is freed, coalescing has to put
+ * every free block back exactly where pmm_initialize left it.
+ */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../kernel/kernel/pmm.c"
+#include "physmem.h"
+
+#define STEPS 4000000
+// Live blocks at most; allocation gets likelier the fewer there are.
+#define MAX_LIVE 4096
+
+struct block {
+	uintptr_t addr;
+	unsigned order;
+};
+
+static struct block live[MAX_LIVE];
+static size_t live_count;
+static size_t live_frames;
+// Frames handed out, by frame number.
+static bool owned[KERNEL_DIRECT_MAP_SIZE / PAGE_SIZE];
+static uint8_t initial_orders[KERNEL_DIRECT_MAP_SIZE / PAGE_SIZE];
+static size_t initial_free;
+
+static uint64_t rng_state = 0x2545F4914F6CDD1Dull;
+
+static uint64_t rng(void) {
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return rng_state;
+}
+
+static void fail(const char* what, uintptr_t addr, unsigned order) {
+	printf("pmm: %s: block %#lx, order %u\n", what, (unsigned long) addr, order);
+	exit(1);
+}
+
+static bool usable(uintptr_t start, uintptr_t end) {
+	for (size_t i = 0; i < physmem_map_entries; i++) {
+		if (physmem_map[i].type == MULTIBOOT_MEMORY_AVAILABLE && physmem_map[i].addr <= start
+		    && end <= physmem_map[i].addr + physmem_map[i].len)
+			return true;
+	}
+	return false;
+}
+
+// Walks every free list: links, orders and alignment have to agree, and
+// the blocks have to add up to free_count.
+static void check_lists(void) {
+	size_t total = 0;
+
+	for (unsigned order = 0; order <= PMM_MAX_ORDER; order++) {
+		uint32_t prev = FRAME_NONE;
+		if ((free_lists[order] != FRAME_NONE) != !!(free_orders & (1u << order)))
+			fail("free_orders out of step", 0, order);
+		for (uint32_t f = free_lists[order]; f != FRAME_NONE; f = frames[f].next) {
+			if (frames[f].order != order || frames[f].prev != prev || f & ((1u << order) - 1))
+				fail("bad free list entry", (uintptr_t) f << PAGE_SHIFT, order);
+			total += (size_t) 1 << order;
+			prev = f;
+		}
+	}
+	if (total != pmm_free_frames())
+		fail("free lists do not add up to the free count", 0, 0);
+}
+
+static void alloc_one(void) {
+	// Mostly small blocks, as the kernel asks for; now and then past the top.
+	unsigned order = rng() % 4 ? (unsigned) (rng() % 4) : (unsigned) (rng() % (PMM_MAX_ORDER + 2));
+	uintptr_t addr = pmm_alloc(order);
+	uint32_t first = (uint32_t) (addr >> PAGE_SHIFT);
+
+	if (order > PMM_MAX_ORDER) {
+		if (addr != 0)
+			fail("order past PMM_MAX_ORDER allocated", addr, order);
+		return;
+	}
+	if (addr == 0)
+		return;
+	if (addr & (((uintptr_t) PAGE_SIZE << order) - 1))
+		fail("misaligned", addr, order);
+	if (!usable(addr, addr + ((uintptr_t) PAGE_SIZE << order)))
+		fail("outside usable memory", addr, order);
+	for (size_t i = 0; i < reserved_count; i++) {
+		if (reserved[i].start < addr + ((uintptr_t) PAGE_SIZE << order) && addr < reserved[i].end)
+			fail("overlaps a reserved range", addr, order);
+	}
+	for (uint32_t f = first; f < first + (1u << order); f++) {
+		if (owned[f])
+			fail("overlaps a live block", addr, order);
+		owned[f] = true;
+	}
+	live[live_count++] = (struct block) { addr, order };
+	live_frames += (size_t) 1 << order;
+}
+
+static void free_one(size_t i) {
+	struct block b = live[i];
+	uint32_t first = (uint32_t) (b.addr >> PAGE_SHIFT);
+
+	for (uint32_t f = first; f < first + (1u << b.order); f++)
+		owned[f] = false;
+	live[i] = live[--live_count];
+	live_frames -= (size_t) 1 << b.order;
+	pmm_free(b.addr, b.order);
+}
+
+static void free_all(void) {
+	while (live_count > 0)
+		free_one(rng() % live_count);
+}
+
+static void check_restored(const char* after) {
+	check_lists();
+	if (pmm_free_frames() != initial_free) {
+		printf("pmm: %zu frames free after %s, %zu at boot\n", pmm_free_frames(), after, initial_free);
+		exit(1);
+	}
+	for (uint32_t f = 0; f < frame_count; f++) {
+		if (frames[f].order != initial_orders[f])
+			fail("free blocks not coalesced back", (uintptr_t) f << PAGE_SHIFT, frames[f].order);
+	}
+}
+
+// Takes every frame one at a time, then gives them all back.
+static void exhaust(void) {
+	size_t taken = 0;
+	uintptr_t addr;
+
+	while ((addr = pmm_alloc(0)) != 0) {
+		if (owned[addr >> PAGE_SHIFT])
+			fail("handed out twice", addr, 0);
+		owned[addr >> PAGE_SHIFT] = true;
+		taken++;
+	}
+	if (taken != initial_free || pmm_free_frames() != 0)
+		fail("not every free frame could be allocated", 0, 0);
+	for (uint32_t f = 0; f < frame_count; f++) {
+		if (owned[f]) {
+			owned[f] = false;
+			pmm_free((uintptr_t) f << PAGE_SHIFT, 0);
+		}
+	}
+}
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(void) {
+	physmem_boot();
+	initial_free = pmm_free_frames();
+	if (initial_free == 0 || frame_count != 0x0FFFF000 / PAGE_SIZE)
+		fail("pmm_initialize did not take the memory map", 0, 0);
+	for (uint32_t f = 0; f < frame_count; f++)
+		initial_orders[f] = frames[f].order;
+	check_lists();
+
+	exhaust();
+	check_restored("taking every frame");
+
+	for (unsigned step = 0; step < STEPS; step++) {
+		if (live_count == 0 || (live_count < MAX_LIVE && rng() % MAX_LIVE >= live_count))
+			alloc_one();
+		else
+			free_one(rng() % live_count);
+		if (pmm_free_frames() != initial_free - live_frames)
+			fail("free count out of step", 0, 0);
+		if (step % (STEPS / 8) == 0)
+			check_lists();
+	}
+	free_all();
+	check_restored("random allocation");
+
+	// Timing: a steady half-full allocator, one pmm_alloc and one pmm_free
+	// per step.
+	for (unsigned i = 0; i < MAX_LIVE / 2; i++)
+		live[live_count++] = (struct block) { pmm_alloc(0), 0 };
+	unsigned pairs = 0;
+	double start = now();
+	for (; pairs < STEPS; pairs++) {
+		size_t i = rng() % live_count;
+		unsigned order = (unsigned) (rng() % 4);
+		pmm_free(live[i].addr, live[i].order);
+		live[i] = (struct block) { pmm_alloc(order), order };
+	}
+	double elapsed = now() - start;
+	for (size_t i = 0; i < live_count; i++)
+		pmm_free(live[i].addr, live[i].order);
+	live_count = 0;
+	check_restored("the timing run");
+
+	printf("pmm: %u random steps and a full exhaustion, free lists back as booted (%zu frames)\n", STEPS,
+	       initial_free);
+	printf("pmm: %.1f ns per pmm_alloc and pmm_free pair\n", elapsed / pairs * 1e9);
+	return 0;
+}
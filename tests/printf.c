@@ -0,0 +1,261 @@
+/*
+ * Conformance and throughput test for libc's printf against the host's.
+ * Every case formats the same arguments with both, libc's through its
+ * stdout into stdio_sink, the host's with vsnprintf, and the text and the
+ * return value have to match. There are fixed cases for the corners of
+ * each conversion, then randomly built integer and floating point
+ * conversions: random flags, width, precision and length, and doubles
+ * from random bit patterns, so every exponent and the subnormals come up.
+ * Finally both are timed on a few common formats.
+ */
+#include <float.h>
+#include <limits.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+void sink_open(char* buf, size_t size);
+size_t sink_close(void);
+int k_vprintf(const char* format, va_list ap);
+
+#define TEXT_MAX 4096
+#define RANDOM_CASES 200000
+#define BATCH 10000
+#define MIN_SECONDS 0.25
+
+static char expected[TEXT_MAX];
+static char got[TEXT_MAX];
+static unsigned long cases;
+
+static void check(const char* format, ...) {
+	va_list ap, ap2;
+
+	va_start(ap, format);
+	va_copy(ap2, ap);
+	int expected_ret = vsnprintf(expected, sizeof(expected), format, ap);
+	sink_open(got, sizeof(got));
+	int got_ret = k_vprintf(format, ap2);
+	sink_close();
+	va_end(ap2);
+	va_end(ap);
+
+	cases++;
+	if (got_ret != expected_ret || strcmp(got, expected) != 0) {
+		printf("printf: \"%s\" gave \"%s\" (%d), expected \"%s\" (%d)\n", format, got, got_ret, expected,
+		       expected_ret);
+		exit(1);
+	}
+}
+
+static void fixed_cases(void) {
+	int count = 0;
+
+	check("");
+	check("plain text");
+	check("%%");
+	check("%5%|%-5%|");
+
+	check("%d %i %d %d %d", 0, 1, -1, INT_MAX, INT_MIN);
+	check("%u %o %x %X", UINT_MAX, UINT_MAX, UINT_MAX, UINT_MAX);
+	check("%5d|%-5d|%05d|%+d|% d|%+ d", 42, 42, 42, 42, 42, 42);
+	check("%.0d|%.0x|%#.0o|%#x|%#o|%#X", 0, 0, 0, 0, 0, 0);
+	check("%#x %#X %#o %#.5o %#10.5x", 255, 255, 8, 8, 255);
+	check("%.5d|%8.5d|%-8.5d|%08.5d|%+.3d", -42, -42, -42, 42, 7);
+	check("%hhd %hhu %hd %hu", 300, 300, 70000, 70000);
+	check("%ld %lu %lx", LONG_MIN, ULONG_MAX, ULONG_MAX);
+	check("%lld %llu %llo %llX", LLONG_MIN, ULLONG_MAX, ULLONG_MAX, ULLONG_MAX);
+	check("%jd %zu %zd %td", INTMAX_MIN, SIZE_MAX, (ptrdiff_t) -1, PTRDIFF_MIN);
+	check("%*d|%-*d|%.*d|%*.*d", 6, 1, 6, 1, 3, 1, -6, 4, 1);
+	check("%.*d", -1, 5);
+
+	check("%c|%5c|%-5c|", 'a', 'b', 'c');
+	check("%s|%10s|%-10s|%.2s|%10.2s", "abc", "abc", "abc", "abc", "abc");
+	check("%s|%.3s|%.6s|%10s", (char*) NULL, (char*) NULL, (char*) NULL, (char*) NULL);
+	check("%p|%20p|%-20p|", (void*) 0x1234, (void*) 0xdeadbeef, (void*) 1);
+	check("%p|%10p", NULL, NULL);
+	check("ab%nc", &count);
+	check("%d", count);
+
+	check("%f %F %e %E %g %G", 0.0, 0.0, 0.0, 0.0, 0.0, 0.0);
+	check("%f %e %g", -0.0, -0.0, -0.0);
+	check("%f %e %g", 1.0, 1.0, 1.0);
+	check("%.0f %.0f %.0f %.0f %.0f", 0.5, 1.5, 2.5, -0.5, 3.5);
+	check("%.1f %.2f %.3f", 0.05, 0.005, 0.0005);
+	check("%f %e %g", 1.0 / 3, 1.0 / 3, 1.0 / 3);
+	check("%.17g %.17g %.17g", 0.1, 1e23, 5e-324);
+	check("%.20f %.40e", 0.1, 0.1);
+	check("%f", DBL_MAX);
+	check("%.1100f", DBL_TRUE_MIN);
+	check("%e %e %g %g", DBL_MAX, DBL_MIN, DBL_MAX, DBL_TRUE_MIN);
+	check("%g %g %g %g %g", 100000.0, 1000000.0, 0.0001, 0.00001, 123456789.0);
+	check("%#g %#.0f %#.0e %#g", 1.0, 1.0, 1.0, 0.0001);
+	check("%+f|% f|%10.3f|%-10.3f|%010.3f|%+010.3f", 3.14159, 3.14159, 3.14159, 3.14159, -3.14159, 3.14159);
+	check("%f %F %e %G %010f %-6f|", INFINITY, -INFINITY, INFINITY, INFINITY, -INFINITY, INFINITY);
+	check("%f %F %5e %G", NAN, NAN, -NAN, NAN);
+	check("%Lf %Le %Lg", 1.5L, 1.5L, (long double) 0.1);
+	check("%.3Lf", (long double) 2.0 / 3);
+}
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ull;
+
+static uint64_t rng(void) {
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return rng_state;
+}
+
+// Appends random flags, width and precision to *p.
+static void random_spec(char** p) {
+	static const char flags[] = "-+ #0";
+
+	for (size_t i = 0; i < sizeof(flags) - 1; i++) {
+		if (rng() % 4 == 0)
+			*(*p)++ = flags[i];
+	}
+	if (rng() % 2)
+		*p += sprintf(*p, "%u", (unsigned) (rng() % 30));
+	if (rng() % 2)
+		*p += sprintf(*p, ".%u", (unsigned) (rng() % 8 == 0 ? rng() % 60 : rng() % 20));
+}
+
+static void random_integer(void) {
+	static const char* const lengths[] = { "", "hh", "h", "l", "ll", "j", "z", "t" };
+	static const char conversions[] = "diouxX";
+	char format[64];
+	char* p = format;
+	unsigned length = (unsigned) (rng() % 8);
+	// Mostly short values: every digit count turns up.
+	uint64_t value = rng() >> (rng() % 64);
+
+	random_spec(&p);
+	p = stpcpy(p, lengths[length]);
+	*p++ = conversions[rng() % (sizeof(conversions) - 1)];
+	*p = '\0';
+
+	switch (length) {
+	case 0:
+	case 1:
+	case 2:
+		check(format, (int) value);
+		break;
+	case 3:
+		check(format, (long) value);
+		break;
+	case 4:
+		check(format, (long long) value);
+		break;
+	case 5:
+		check(format, (intmax_t) value);
+		break;
+	case 6:
+		check(format, (size_t) value);
+		break;
+	default:
+		check(format, (ptrdiff_t) value);
+		break;
+	}
+}
+
+static void random_float(void) {
+	static const char conversions[] = "fFeEgG";
+	char format[64];
+	char* p = format;
+	uint64_t bits = rng();
+	double value;
+
+	// Keep most of them in the range people print.
+	if (rng() % 2)
+		bits = (bits & ~(UINT64_C(0x7ff) << 52)) | (UINT64_C(1023) + rng() % 80 - 40) << 52;
+	memcpy(&value, &bits, sizeof(value));
+
+	random_spec(&p);
+	*p++ = conversions[rng() % (sizeof(conversions) - 1)];
+	*p = '\0';
+	check(format, value);
+}
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int host_printf(const char* format, ...) {
+	static char buf[TEXT_MAX];
+	va_list ap;
+	va_start(ap, format);
+	int ret = vsnprintf(buf, sizeof(buf), format, ap);
+	va_end(ap);
+	return ret;
+}
+
+static int libc_printf(const char* format, ...) {
+	va_list ap;
+	va_start(ap, format);
+	int ret = k_vprintf(format, ap);
+	va_end(ap);
+	return ret;
+}
+
+// ns per call of f(format, value), which formats value as a double when
+// is_double is set and as an int otherwise.
+static double time_format(int (*f)(const char*, ...), const char* format, double value, int is_double) {
+	unsigned long calls = 0;
+	double start = now(), elapsed;
+
+	sink_open(NULL, 0);
+	do {
+		for (unsigned i = 0; i < BATCH; i++) {
+			if (is_double)
+				f(format, value + i);
+			else
+				f(format, (int) value + (int) i);
+		}
+		calls += BATCH;
+		elapsed = now() - start;
+	} while (elapsed < MIN_SECONDS);
+	sink_close();
+	return elapsed / calls * 1e9;
+}
+
+static void throughput(void) {
+	static const struct {
+		const char* format;
+		double value;
+		int is_double;
+	} cases[] = {
+		{ "%d\n", 123456, 0 },
+		{ "%08x\n", 0xBEEF, 0 },
+		{ "[%-+8d]\n", 17, 0 },
+		{ "%f\n", 3.14159, 1 },
+		{ "%.17g\n", 0.1, 1 },
+		{ "%e\n", 6.02214076e23, 1 },
+	};
+
+	printf("printf: %24s %10s %10s\n", "ns per call", "libc", "host");
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		char name[32];
+		size_t n = strcspn(cases[i].format, "\n");
+		snprintf(name, sizeof(name), "\"%.*s\"", (int) n, cases[i].format);
+		printf("printf: %24s %10.1f %10.1f\n", name,
+		       time_format(libc_printf, cases[i].format, cases[i].value, cases[i].is_double),
+		       time_format(host_printf, cases[i].format, cases[i].value, cases[i].is_double));
+	}
+}
+
+int main(void) {
+	fixed_cases();
+	for (unsigned i = 0; i < RANDOM_CASES; i++) {
+		random_integer();
+		random_float();
+	}
+	printf("printf: %lu cases match the host's output\n", cases);
+	throughput();
+	return 0;
+}
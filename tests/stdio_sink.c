@@ -0,0 +1,49 @@
+/*
+ * Glue between the tests, which are built against the host's stdio, and
+ * libc's own: points libc's stdout at a buffer, or at a counter for the
+ * benchmarks. Built with libc's headers and its names given the k_ prefix
+ * like the rest of its stdio, see the Makefile.
+ */
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+static char* sink_buf;
+static size_t sink_size;
+static size_t sink_len;
+
+static int sink_write(const char* data, size_t len) {
+	if (sink_buf && sink_len < sink_size) {
+		size_t room = sink_size - sink_len;
+		memcpy(sink_buf + sink_len, data, len < room ? len : room);
+	}
+	sink_len += len;
+	return (int) len;
+}
+
+// Collect what libc's stdout writes from now on in buf, or only count it
+// when buf is NULL.
+void sink_open(char* buf, size_t size) {
+	fflush(stdout);
+	sink_buf = buf;
+	sink_size = size;
+	sink_len = 0;
+	stdout->pfn_write_all = sink_write;
+}
+
+// Flush stdout and return the number of bytes written since sink_open.
+// The text in the buffer is NUL-terminated when there is room.
+size_t sink_close(void) {
+	fflush(stdout);
+	if (sink_buf && sink_len < sink_size)
+		sink_buf[sink_len] = '\0';
+	return sink_len;
+}
+
+int sink_vfprintf(const char* format, ...) {
+	va_list ap;
+	va_start(ap, format);
+	int ret = vfprintf(stdout, format, ap);
+	va_end(ap);
+	return ret;
+}
@@ -0,0 +1,245 @@
+/*
+ * Equivalence test for the i386 string routines. The word and SSE2
+ * versions of memcpy, memmove and memset run against the byte loops in
+ * libc/string over every alignment of source and destination within 16
+ * bytes, every size up to past the small-copy, rep and vector thresholds
+ * and a few larger ones, and for memmove every overlap distance up to 70
+ * bytes either way. The result has to match byte for byte, guard bytes
+ * around the destination included, and the return value has to be the
+ * destination.
+ *
+ * strlen and memcmp get the same alignments and sizes, with bytes above
+ * 0x7F to catch signed compares, and are run on strings and buffers that
+ * end right before an unmapped page: their aligned over-reads must not
+ * cross it.
+ */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+void* ref_memcpy(void*, const void*, size_t);
+void* ref_memmove(void*, const void*, size_t);
+void* ref_memset(void*, int, size_t);
+int ref_memcmp(const void*, const void*, size_t);
+size_t ref_strlen(const char*);
+
+void* __memcpy_word(void*, const void*, size_t);
+void* __memmove_word(void*, const void*, size_t);
+void* __memset_word(void*, int, size_t);
+void* __memcpy_sse2(void*, const void*, size_t);
+void* __memmove_sse2(void*, const void*, size_t);
+void* __memset_sse2(void*, int, size_t);
+int __memcmp_word(const void*, const void*, size_t);
+size_t __strlen_word(const char*);
+int __memcmp_sse2(const void*, const void*, size_t);
+size_t __strlen_sse2(const char*);
+
+// Read by __memset_sse2. Low, so the non-temporal path is covered as well.
+size_t __memset_nt_threshold = 8192;
+
+#define ALIGNS 16
+#define GUARD 64
+#define SMALL_SIZES 300
+#define MAX_SIZE 20000
+#define MAX_OVERLAP 70
+
+#define BUF_SIZE (MAX_SIZE + 2 * (GUARD + ALIGNS + MAX_OVERLAP))
+
+struct impl {
+	const char* name;
+	void* (*memcpy)(void*, const void*, size_t);
+	void* (*memmove)(void*, const void*, size_t);
+	void* (*memset)(void*, int, size_t);
+	int (*memcmp)(const void*, const void*, size_t);
+	size_t (*strlen)(const char*);
+};
+
+static const struct impl impls[] = {
+	{ "word", __memcpy_word, __memmove_word, __memset_word, __memcmp_word, __strlen_word },
+	{ "sse2", __memcpy_sse2, __memmove_sse2, __memset_sse2, __memcmp_sse2, __strlen_sse2 },
+};
+
+static const size_t large_sizes[] = {
+	511, 512, 513, 1000, 4095, 4096, 4097, 8191, 8192, 8193, 12345, MAX_SIZE,
+};
+
+static unsigned char src_buf[BUF_SIZE] __attribute__((aligned(64)));
+static unsigned char dst_buf[BUF_SIZE] __attribute__((aligned(64)));
+static unsigned char ref_buf[BUF_SIZE] __attribute__((aligned(64)));
+
+static uint32_t seed = 1;
+
+static void fill(unsigned char* p, size_t size) {
+	for (size_t i = 0; i < size; i++) {
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		p[i] = (unsigned char) seed;
+	}
+}
+
+static bool same(const unsigned char* a, const unsigned char* b, size_t size) {
+	for (size_t i = 0; i < size; i++) {
+		if (a[i] != b[i])
+			return false;
+	}
+	return true;
+}
+
+static void fail(const struct impl* impl, const char* op, size_t dst_align, const char* what, long value,
+                 size_t size) {
+	printf("string: %s %s wrong: dst align %zu, %s %ld, size %zu\n", impl->name, op, dst_align, what, value, size);
+	exit(1);
+}
+
+// Calls f for every size: all of them up to SMALL_SIZES, then large_sizes.
+static void for_each_size(void (*f)(const struct impl*, size_t), const struct impl* impl) {
+	for (size_t size = 0; size <= SMALL_SIZES; size++)
+		f(impl, size);
+	for (size_t i = 0; i < sizeof(large_sizes) / sizeof(large_sizes[0]); i++)
+		f(impl, large_sizes[i]);
+}
+
+static void test_memcpy(const struct impl* impl, size_t size) {
+	for (size_t dst_align = 0; dst_align < ALIGNS; dst_align++) {
+		for (size_t src_align = 0; src_align < ALIGNS; src_align++) {
+			unsigned char* src = src_buf + GUARD + src_align;
+			size_t span = size + 2 * GUARD + ALIGNS;
+
+			fill(src_buf, span + ALIGNS);
+			fill(dst_buf, span);
+			ref_memcpy(ref_buf, dst_buf, span);
+			ref_memcpy(ref_buf + GUARD + dst_align, src, size);
+			if (impl->memcpy(dst_buf + GUARD + dst_align, src, size) != dst_buf + GUARD + dst_align
+			    || !same(dst_buf, ref_buf, span))
+				fail(impl, "memcpy", dst_align, "src align", (long) src_align, size);
+		}
+	}
+}
+
+static void test_memmove(const struct impl* impl, size_t size) {
+	size_t span = size + 2 * (GUARD + ALIGNS + MAX_OVERLAP);
+
+	for (size_t dst_align = 0; dst_align < ALIGNS; dst_align++) {
+		for (long offset = -MAX_OVERLAP; offset <= MAX_OVERLAP; offset++) {
+			unsigned char* dst = dst_buf + GUARD + MAX_OVERLAP + dst_align;
+			unsigned char* ref = ref_buf + GUARD + MAX_OVERLAP + dst_align;
+
+			// Both ranges in the one buffer, src offset bytes from dst.
+			fill(dst_buf, span);
+			ref_memcpy(ref_buf, dst_buf, span);
+			ref_memmove(ref, ref + offset, size);
+			if (impl->memmove(dst, dst + offset, size) != dst || !same(dst_buf, ref_buf, span))
+				fail(impl, "memmove", dst_align, "src offset", offset, size);
+		}
+	}
+}
+
+static void test_memset(const struct impl* impl, size_t size) {
+	static const int values[] = { 0, 0xA5, 0x1FF, -1 };
+
+	for (size_t dst_align = 0; dst_align < ALIGNS; dst_align++) {
+		for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+			unsigned char* dst = dst_buf + GUARD + dst_align;
+			size_t span = size + 2 * GUARD + ALIGNS;
+
+			fill(dst_buf, span);
+			ref_memcpy(ref_buf, dst_buf, span);
+			ref_memset(ref_buf + GUARD + dst_align, values[i], size);
+			if (impl->memset(dst, values[i], size) != dst || !same(dst_buf, ref_buf, span))
+				fail(impl, "memset", dst_align, "value", values[i], size);
+		}
+	}
+}
+
+static int sign(int value) {
+	return (value > 0) - (value < 0);
+}
+
+static void test_strlen(const struct impl* impl, size_t size) {
+	for (size_t align = 0; align < ALIGNS; align++) {
+		char* str = (char*) src_buf + GUARD + align;
+
+		// Non-zero bytes, with zeros all around the string.
+		fill(src_buf, size + 2 * GUARD + ALIGNS);
+		for (size_t i = 0; i < size; i++)
+			str[i] |= str[i] == 0;
+		ref_memset(src_buf, 0, GUARD + align);
+		str[size] = '\0';
+		if (impl->strlen(str) != ref_strlen(str))
+			fail(impl, "strlen", align, "size", (long) size, size);
+	}
+}
+
+static void test_memcmp(const struct impl* impl, size_t size) {
+	for (size_t a_align = 0; a_align < ALIGNS; a_align++) {
+		for (size_t b_align = 0; b_align < ALIGNS; b_align++) {
+			unsigned char* a = src_buf + GUARD + a_align;
+			unsigned char* b = dst_buf + GUARD + b_align;
+
+			fill(a, size);
+			ref_memcpy(b, a, size);
+			if (impl->memcmp(a, b, size) != 0)
+				fail(impl, "memcmp", a_align, "b align", (long) b_align, size);
+			if (size == 0)
+				continue;
+
+			// One differing byte, first, last, in the middle or anywhere,
+			// both ways round.
+			size_t at[] = { 0, size - 1, size / 2, seed % size };
+			for (size_t i = 0; i < sizeof(at) / sizeof(at[0]); i++) {
+				unsigned char saved = b[at[i]];
+				b[at[i]] = (unsigned char) (a[at[i]] ^ (0x80 >> (i * 2)));
+				if (sign(impl->memcmp(a, b, size)) != sign(ref_memcmp(a, b, size))
+				    || sign(impl->memcmp(b, a, size)) != sign(ref_memcmp(b, a, size)))
+					fail(impl, "memcmp", a_align, "difference at", (long) at[i], size);
+				b[at[i]] = saved;
+			}
+		}
+	}
+}
+
+// Strings and buffers that end at the last byte before a PROT_NONE page.
+static void test_page_end(const struct impl* impl) {
+	long page = sysconf(_SC_PAGESIZE);
+	unsigned char* a = mmap(NULL, 2 * page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	unsigned char* b = mmap(NULL, 2 * page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (a == MAP_FAILED || b == MAP_FAILED || mprotect(a + page, page, PROT_NONE) != 0
+	    || mprotect(b + page, page, PROT_NONE) != 0) {
+		printf("string: cannot map guard pages\n");
+		exit(1);
+	}
+	ref_memset(a, 'x', page);
+	ref_memset(b, 'x', page);
+	a[page - 1] = '\0';
+	b[page - 1] = '\0';
+
+	for (size_t size = 0; size < 2 * ALIGNS + 1; size++) {
+		const char* str = (const char*) a + page - 1 - size;
+		if (impl->strlen(str) != size)
+			fail(impl, "strlen", (uintptr_t) str % ALIGNS, "page end, size", (long) size, size);
+		if (impl->memcmp(a + page - size, b + page - size, size) != 0)
+			fail(impl, "memcmp", (uintptr_t) (a + page - size) % ALIGNS, "page end, size", (long) size, size);
+	}
+
+	munmap(a, 2 * page);
+	munmap(b, 2 * page);
+}
+
+int main(void) {
+	for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+		for_each_size(test_memcpy, &impls[i]);
+		for_each_size(test_memmove, &impls[i]);
+		for_each_size(test_memset, &impls[i]);
+		for_each_size(test_strlen, &impls[i]);
+		for_each_size(test_memcmp, &impls[i]);
+		test_page_end(&impls[i]);
+		printf("string: %s memcpy, memmove, memset, strlen and memcmp match the byte loops\n", impls[i].name);
+	}
+	return 0;
+}
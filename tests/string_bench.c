@@ -0,0 +1,100 @@
+/*
+ * Microbenchmark for strlen and memcmp: the byte loops in libc/string
+ * against the word and SSE2 versions, in cycles per call over a range of
+ * sizes. Calls cycle through all 16 start alignments. memcmp compares
+ * equal buffers, so every version has to read them whole.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <x86intrin.h>
+
+int ref_memcmp(const void*, const void*, size_t);
+size_t ref_strlen(const char*);
+int __memcmp_word(const void*, const void*, size_t);
+size_t __strlen_word(const char*);
+int __memcmp_sse2(const void*, const void*, size_t);
+size_t __strlen_sse2(const char*);
+
+// Read by __memset_sse2, which the SSE2 object brings along.
+size_t __memset_nt_threshold = 256 * 1024;
+
+#define ALIGNS 16
+#define MAX_SIZE 4096
+// Bytes each measurement goes through, whatever the size.
+#define WORK (64u << 20)
+
+struct impl {
+	const char* name;
+	int (*memcmp)(const void*, const void*, size_t);
+	size_t (*strlen)(const char*);
+};
+
+static const struct impl impls[] = {
+	{ "byte", ref_memcmp, ref_strlen },
+	{ "word", __memcmp_word, __strlen_word },
+	{ "sse2", __memcmp_sse2, __strlen_sse2 },
+};
+
+#define IMPLS (sizeof(impls) / sizeof(impls[0]))
+
+static const size_t sizes[] = { 1, 7, 16, 31, 64, 255, 1024, MAX_SIZE };
+
+// One string per alignment: strings[n] starts n bytes in.
+static char strings[ALIGNS][MAX_SIZE + ALIGNS + 1] __attribute__((aligned(64)));
+static char a_buf[MAX_SIZE + ALIGNS] __attribute__((aligned(64)));
+static char b_buf[MAX_SIZE + ALIGNS] __attribute__((aligned(64)));
+static volatile size_t sink;
+
+static double time_strlen(const struct impl* impl, size_t size) {
+	unsigned calls = WORK / (size + 1);
+	size_t sum = 0;
+
+	for (size_t align = 0; align < ALIGNS; align++) {
+		for (size_t i = 0; i < size; i++)
+			strings[align][align + i] = 'a' + i % 26;
+		strings[align][align + size] = '\0';
+	}
+
+	uint64_t start = __rdtsc();
+	for (unsigned i = 0; i < calls; i++)
+		sum += impl->strlen(&strings[i % ALIGNS][i % ALIGNS]);
+	uint64_t cycles = __rdtsc() - start;
+	sink = sum;
+	return (double) cycles / calls;
+}
+
+static double time_memcmp(const struct impl* impl, size_t size) {
+	unsigned calls = WORK / (size + 1);
+	int sum = 0;
+
+	for (size_t i = 0; i < MAX_SIZE + ALIGNS; i++)
+		a_buf[i] = b_buf[i] = 'x';
+
+	uint64_t start = __rdtsc();
+	for (unsigned i = 0; i < calls; i++)
+		sum += impl->memcmp(a_buf + i % ALIGNS, b_buf + (i * 5) % ALIGNS, size);
+	uint64_t cycles = __rdtsc() - start;
+	sink = (size_t) sum;
+	return (double) cycles / calls;
+}
+
+static void run(const char* name, double (*time)(const struct impl*, size_t)) {
+	printf("string_bench: %s, cycles per call\n%8s", name, "size");
+	for (size_t i = 0; i < IMPLS; i++)
+		printf("%10s", impls[i].name);
+	printf("\n");
+
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		printf("%8zu", sizes[s]);
+		for (size_t i = 0; i < IMPLS; i++)
+			printf("%10.1f", time(&impls[i], sizes[s]));
+		printf("\n");
+	}
+}
+
+int main(void) {
+	run("strlen", time_strlen);
+	run("memcmp", time_memcmp);
+	return 0;
+}
@@ -0,0 +1,278 @@
+/*
+ * Test for the seqlock and RCU-lite of kernel/include/kernel/sync.h, with
+ * kernel/kernel/sync.c built straight in. Host threads stand in for CPUs:
+ * include/kernel/smp.h gives each its own struct cpu, and preemption is
+ * a no-op.
+ *
+ * A read that a write overlapped has to be retried, both one step at a
+ * time and with a writer changing two fields under readers that must never
+ * keep a copy where they differ. synchronize_rcu has to wait for a reader
+ * already inside a section, nested or not, and return once it leaves. Then
+ * an updater keeps replacing a pointer and poisons each old object after
+ * synchronize_rcu, while readers check that nothing they reach through the
+ * pointer inside a section is ever poisoned.
+ */
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../kernel/include/kernel/sync.h"
+#include "../kernel/kernel/sync.c"
+
+#define READERS 3
+// Each phase runs at least this long and until every reader has done
+// READS reads, however the host schedules the threads.
+#define RUN_MS 200
+#define READS 10000
+#define TIMEOUT_S 30
+#define OBJECT_LIVE 0x11FE11FEu
+#define OBJECT_DEAD 0xDEADDEADu
+
+_Thread_local struct cpu* test_cpu;
+static struct cpu cpus[MAX_CPUS];
+static unsigned cpu_count = READERS + 2;
+
+unsigned smp_cpu_count(void) {
+	return cpu_count;
+}
+
+struct cpu* smp_cpu(unsigned id) {
+	return &cpus[id];
+}
+
+void preempt_disable(void) {
+}
+
+void preempt_enable(void) {
+}
+
+static void fail(const char* what) {
+	printf("sync: %s\n", what);
+	exit(1);
+}
+
+static void become_cpu(unsigned id) {
+	cpus[id].id = id;
+	test_cpu = &cpus[id];
+}
+
+static void start(pthread_t* thread, void* (*entry)(void*), unsigned id) {
+	if (pthread_create(thread, NULL, entry, (void*) (uintptr_t) id) != 0)
+		fail("pthread_create failed");
+}
+
+static void sleep_ms(unsigned ms) {
+	struct timespec ts = { 0, (long) ms * 1000000 };
+	nanosleep(&ts, NULL);
+}
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static unsigned long reads[MAX_CPUS];
+
+// Whether a phase that began at start has run long enough.
+static bool phase_done(double start) {
+	double elapsed = now() - start;
+
+	if (elapsed > TIMEOUT_S)
+		fail("readers made no progress");
+	if (elapsed * 1000 < RUN_MS)
+		return false;
+	for (unsigned i = 1; i <= READERS; i++) {
+		if (__atomic_load_n(&reads[i], __ATOMIC_RELAXED) < READS)
+			return false;
+	}
+	return true;
+}
+
+static struct seqlock sl = SEQLOCK_INIT;
+static volatile uint32_t field_a, field_b;
+static volatile bool writing_done;
+static unsigned long retries[MAX_CPUS];
+
+static void test_seqlock_steps(void) {
+	uint32_t seq = read_seqbegin(&sl);
+	if (read_seqretry(&sl, seq))
+		fail("read retried with no write");
+	write_seqlock(&sl);
+	field_a = field_b = 1;
+	write_sequnlock(&sl);
+	if (!read_seqretry(&sl, seq))
+		fail("read overlapping a write not retried");
+}
+
+static bool any_retry(void) {
+	for (unsigned i = 1; i <= READERS; i++) {
+		if (__atomic_load_n(&retries[i], __ATOMIC_RELAXED))
+			return true;
+	}
+	return false;
+}
+
+static void* seqlock_reader(void* arg) {
+	unsigned id = (unsigned) (uintptr_t) arg;
+	uint32_t seq, a, b;
+
+	become_cpu(id);
+	while (!writing_done) {
+		bool first = true;
+		do {
+			if (!first)
+				__atomic_store_n(&retries[id], retries[id] + 1, __ATOMIC_RELAXED);
+			first = false;
+			seq = read_seqbegin(&sl);
+			a = field_a;
+			b = field_b;
+		} while (read_seqretry(&sl, seq));
+		if (a != b)
+			fail("reader kept a torn copy");
+		__atomic_store_n(&reads[id], reads[id] + 1, __ATOMIC_RELAXED);
+	}
+	return NULL;
+}
+
+static void test_seqlock_threads(void) {
+	pthread_t readers[READERS];
+	unsigned long total = 0;
+	uint32_t writes = 0;
+
+	for (unsigned i = 0; i < READERS; i++)
+		start(&readers[i], seqlock_reader, 1 + i);
+	// Until a read has overlapped a write, too, which one host CPU may
+	// take a while to interleave.
+	for (double begin = now(); !phase_done(begin) || !any_retry(); writes++) {
+		write_seqlock(&sl);
+		field_a = writes;
+		for (volatile int spin = 0; spin < 50; spin++)
+			;
+		field_b = writes;
+		write_sequnlock(&sl);
+	}
+	writing_done = true;
+	for (unsigned i = 0; i < READERS; i++) {
+		pthread_join(readers[i], NULL);
+		total += retries[1 + i];
+	}
+	printf("sync: seqlock: %u writes, %lu read retries, no torn copy kept\n", writes, total);
+}
+
+static volatile bool reader_inside, reader_release, sync_returned;
+
+static void* held_reader(void* arg) {
+	become_cpu((unsigned) (uintptr_t) arg);
+	rcu_read_lock();
+	rcu_read_lock();
+	reader_inside = true;
+	while (!reader_release)
+		cpu_relax();
+	// Still inside the outer section.
+	rcu_read_unlock();
+	sleep_ms(50);
+	if (sync_returned)
+		fail("synchronize_rcu returned while a nested reader was inside");
+	rcu_read_unlock();
+	return NULL;
+}
+
+static void* synchronizer(void* arg) {
+	become_cpu((unsigned) (uintptr_t) arg);
+	synchronize_rcu();
+	sync_returned = true;
+	return NULL;
+}
+
+static void test_rcu_wait(void) {
+	pthread_t reader, waiter;
+
+	start(&reader, held_reader, 1);
+	while (!reader_inside)
+		cpu_relax();
+	start(&waiter, synchronizer, 2);
+	sleep_ms(50);
+	if (sync_returned)
+		fail("synchronize_rcu did not wait for a reader");
+	reader_release = true;
+	pthread_join(reader, NULL);
+	pthread_join(waiter, NULL);
+	if (cpus[1].rcu_nesting != 0 || cpus[1].rcu_seq & 1)
+		fail("reader left its count odd");
+	printf("sync: rcu: synchronize_rcu waited for a reader and returned when it left\n");
+}
+
+struct object {
+	uint32_t magic;
+	uint32_t value;
+};
+
+static struct object* shared;
+static volatile bool updating_done;
+
+static void* rcu_reader(void* arg) {
+	unsigned id = (unsigned) (uintptr_t) arg;
+
+	become_cpu(id);
+	while (!updating_done) {
+		rcu_read_lock();
+		struct object* obj = rcu_dereference(shared);
+		uint32_t magic = obj->magic;
+		for (volatile int spin = 0; spin < 20; spin++)
+			;
+		if (magic != OBJECT_LIVE || obj->magic != OBJECT_LIVE)
+			fail("reader reached an object retired under it");
+		rcu_read_unlock();
+		__atomic_store_n(&reads[id], reads[id] + 1, __ATOMIC_RELAXED);
+	}
+	return NULL;
+}
+
+static struct object* object_new(uint32_t value) {
+	struct object* obj = malloc(sizeof(*obj));
+	if (!obj)
+		fail("out of memory");
+	obj->magic = OBJECT_LIVE;
+	obj->value = value;
+	return obj;
+}
+
+static void test_rcu_updates(void) {
+	pthread_t readers[READERS];
+	unsigned long total = 0;
+	uint32_t updates = 0;
+
+	become_cpu(0);
+	shared = object_new(0);
+	for (unsigned i = 0; i <= READERS; i++)
+		reads[i] = 0;
+	for (unsigned i = 0; i < READERS; i++)
+		start(&readers[i], rcu_reader, 1 + i);
+	for (double begin = now(); !phase_done(begin); updates++) {
+		struct object* old = shared;
+		rcu_assign_pointer(shared, object_new(updates));
+		synchronize_rcu();
+		// Poisoned rather than freed, so a late reader sees it.
+		old->magic = OBJECT_DEAD;
+	}
+	updating_done = true;
+	for (unsigned i = 0; i < READERS; i++) {
+		pthread_join(readers[i], NULL);
+		total += reads[1 + i];
+	}
+	printf("sync: rcu: %u updates under %lu reads, no retired object reached\n", updates, total);
+}
+
+int main(void) {
+	become_cpu(0);
+	test_seqlock_steps();
+	test_seqlock_threads();
+	test_rcu_wait();
+	test_rcu_updates();
+	return 0;
+}
@@ -0,0 +1,204 @@
+/*
+ * Test and benchmark for the timer wheel. kernel/kernel/timer.c is built
+ * straight into the test, on a clock and a clockevent that the test drives:
+ * ktime_get_ns reads a variable, and clockevent_program only records the
+ * deadline.
+ *
+ * With TIMERS timers armed at random expiries from a nanosecond to about
+ * 18 minutes out, timer_add, timer_cancel and moving a pending timer are
+ * timed in ns per call. Then the clock jumps from one programmed deadline to the
+ * next, with some callbacks cancelling timers still to come and others
+ * re-arming themselves, and every timer has to run once, no earlier than
+ * its expiry and at most a tick after it, cancelled ones not at all.
+ */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../kernel/kernel/timer.c"
+
+#define TIMERS 100000
+// Expiries up to 2^40 ns, about 18 minutes.
+#define MAX_EXPIRY_BITS 40
+
+struct test_timer {
+	struct timer timer;
+	uint64_t expires;
+	unsigned fired;
+	bool cancelled;
+	unsigned rearms; // left to do
+	struct test_timer* victim; // cancelled by this one's callback
+};
+
+static struct test_timer timers[TIMERS];
+static unsigned order[TIMERS];
+
+static uint64_t now_ns;
+static void (*clock_handler)(void);
+static uint64_t deadline = NO_TICK;
+static unsigned interrupts;
+
+void clockevent_initialize(void (*handler)(void)) {
+	clock_handler = handler;
+}
+
+void clockevent_program(uint64_t delta_ns) {
+	deadline = now_ns + delta_ns;
+}
+
+void clockevent_cancel(void) {
+	deadline = NO_TICK;
+}
+
+uint64_t clockevent_tsc_hz(void) {
+	return NSEC_PER_SEC;
+}
+
+void ktime_initialize(uint64_t tsc_hz) {
+	(void) tsc_hz;
+	now_ns = 0;
+}
+
+uint64_t ktime_get_ns(void) {
+	return now_ns;
+}
+
+static uint64_t rng_state = 0x2545F4914F6CDD1Dull;
+
+static uint64_t rng(void) {
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return rng_state;
+}
+
+static void fail(const char* what, const struct test_timer* t) {
+	printf("timer: timer %td %s: expires %llu, now %llu\n", t - timers, what, (unsigned long long) t->expires,
+	       (unsigned long long) now_ns);
+	exit(1);
+}
+
+// Mostly near, as timeouts are, with every level of the wheel in use.
+static uint64_t random_expiry(void) {
+	return now_ns + 1 + (rng() >> (64 - MAX_EXPIRY_BITS + rng() % MAX_EXPIRY_BITS));
+}
+
+static void expire(void* data) {
+	struct test_timer* t = data;
+
+	if (t->cancelled || timer_pending(&t->timer))
+		fail("ran while cancelled or still pending", t);
+	if (now_ns < t->expires)
+		fail("ran early", t);
+	if (now_ns >= t->expires + TIMER_TICK_NS)
+		fail("ran late", t);
+	t->fired++;
+
+	if (t->victim && timer_cancel(&t->victim->timer))
+		t->victim->cancelled = true;
+	if (t->rearms > 0) {
+		t->rearms--;
+		t->fired--;
+		t->expires = now_ns + rng() % (1u << 20);
+		timer_add(&t->timer, t->expires);
+	}
+}
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void shuffle(void) {
+	for (unsigned i = TIMERS - 1; i > 0; i--) {
+		unsigned j = (unsigned) (rng() % (i + 1));
+		unsigned swap = order[i];
+		order[i] = order[j];
+		order[j] = swap;
+	}
+}
+
+// ns per call of timer_add over every timer, in random order.
+static double time_add(void) {
+	shuffle();
+	double start = now();
+	for (unsigned i = 0; i < TIMERS; i++) {
+		struct test_timer* t = &timers[order[i]];
+		timer_add(&t->timer, t->expires);
+	}
+	return (now() - start) / TIMERS * 1e9;
+}
+
+static double time_cancel(void) {
+	shuffle();
+	double start = now();
+	for (unsigned i = 0; i < TIMERS; i++) {
+		if (!timer_cancel(&timers[order[i]].timer))
+			fail("was not pending", &timers[order[i]]);
+	}
+	return (now() - start) / TIMERS * 1e9;
+}
+
+int main(void) {
+	timer_initialize();
+	if (!clock_handler) {
+		printf("timer: timer_initialize did not take the clockevent\n");
+		return 1;
+	}
+	for (unsigned i = 0; i < TIMERS; i++) {
+		timer_init(&timers[i].timer, expire, &timers[i]);
+		timers[i].expires = random_expiry();
+		order[i] = i;
+	}
+
+	double add = time_add();
+	double cancel = time_cancel();
+	time_add();
+	// Moving a pending timer: timer_add on one already in the wheel.
+	for (unsigned i = 0; i < TIMERS; i++)
+		timers[i].expires = random_expiry();
+	double move = time_add();
+	printf("timer: %u armed timers, ns per call: timer_add %.1f, timer_cancel %.1f, moving %.1f\n", TIMERS,
+	       add, cancel, move);
+
+	// Every tenth timer cancels another when it runs, and every seventh
+	// re-arms itself a few times; a tenth are cancelled up front.
+	for (unsigned i = 0; i < TIMERS; i++) {
+		struct test_timer* t = &timers[i];
+		if (i % 10 == 0)
+			t->victim = &timers[rng() % TIMERS];
+		if (i % 7 == 0)
+			t->rearms = 3;
+		if (i % 10 == 5) {
+			timer_cancel(&t->timer);
+			t->cancelled = true;
+		}
+	}
+
+	while (deadline != NO_TICK) {
+		if (deadline < now_ns) {
+			printf("timer: deadline %llu programmed in the past at %llu\n", (unsigned long long) deadline,
+			       (unsigned long long) now_ns);
+			return 1;
+		}
+		now_ns = deadline;
+		deadline = NO_TICK;
+		interrupts++;
+		clock_handler();
+	}
+
+	unsigned fired = 0;
+	for (unsigned i = 0; i < TIMERS; i++) {
+		struct test_timer* t = &timers[i];
+		if (timer_pending(&t->timer) || t->fired != !t->cancelled)
+			fail(t->cancelled ? "ran after being cancelled" : "never ran", t);
+		fired += t->fired;
+	}
+	printf("timer: %u timers ran on time, %u cancelled, over %llu ticks in %u interrupts\n", fired,
+	       TIMERS - fired, (unsigned long long) (now_ns >> TIMER_TICK_SHIFT), interrupts);
+	return 0;
+}
@@ -0,0 +1,74 @@
+/*
+ * Throughput of libc's brace-format vfprintf, in formatted bytes per
+ * second and time per call: short formats that are mostly a conversion,
+ * and long ones that are mostly literal text. Output goes through
+ * stdout's line buffer to a sink that only counts it.
+ */
+#include <stddef.h>
+#include <stdio.h>
+#include <time.h>
+
+void sink_open(char* buf, size_t size);
+size_t sink_close(void);
+int sink_vfprintf(const char* format, ...);
+
+#define BATCH 10000
+#define MIN_SECONDS 0.25
+
+static const char long_text[] =
+	"vfprintf walks the format once and copies the text between conversions "
+	"in one run, so a long format costs about as much as copying it. "
+	"Here is a number, {d}, and a string, {s}, and that is all.\n";
+
+static const char literal_text[] =
+	"0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789abcdefghijklmnopqrstuvwxyz"
+	"0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789abcdefghijklmnopqrstuvwxyz"
+	"0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789abcdefghijklmnopqrstuvwxyz"
+	"0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789abcdefghijklmnopqrstuvwxyz\n";
+
+static void short_decimal(void) {
+	sink_vfprintf("{d}\n", -123456);
+}
+
+static void short_mixed(void) {
+	sink_vfprintf("{s}={?xu} {?ou}\n", "eax", 0xDEADBEEFu, 0755u);
+}
+
+static void long_format(void) {
+	sink_vfprintf(long_text, 42, "forty-two");
+}
+
+static void long_literal(void) {
+	sink_vfprintf(literal_text);
+}
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void bench(const char* name, void (*format)(void)) {
+	unsigned long calls = 0;
+	double start = now(), elapsed;
+
+	sink_open(NULL, 0);
+	do {
+		for (unsigned i = 0; i < BATCH; i++)
+			format();
+		calls += BATCH;
+		elapsed = now() - start;
+	} while (elapsed < MIN_SECONDS);
+	size_t bytes = sink_close();
+
+	printf("vfprintf_bench: %-14s %8.1f MB/s %8.1f ns per call\n", name, bytes / elapsed / 1e6,
+	       elapsed / calls * 1e9);
+}
+
+int main(void) {
+	bench("short decimal", short_decimal);
+	bench("short mixed", short_mixed);
+	bench("long format", long_format);
+	bench("long literal", long_literal);
+	return 0;
+}
@@ -0,0 +1,327 @@
+/*
+ * Accuracy and speed of the array math in libc/stdlib/vmath.c, built with
+ * math.c as for tests/math.c. Every function runs twice: first through the
+ * scalar loops the library starts with, then through the SSE2 kernels
+ * once __math_enable_sse2 has switched them in.
+ *
+ * The double functions are compared with the host's long double versions
+ * and with libc's own scalar functions, over random arrays in ranges that
+ * exercise the reductions, with special values (NaN, infinities, zeros,
+ * subnormals, arguments that overflow or leave the kernels' range) mixed
+ * in. The float ones are compared with the host's double versions. Every
+ * length up to a few vectors is run too, in place as well, for the tails.
+ * vsinf and vcosf are then checked on every float up to 8192 in
+ * magnitude. Last, both paths are timed in cycles per element.
+ */
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <x86intrin.h>
+
+double k_sin(double);
+double k_cos(double);
+double k_exp(double);
+double k_log(double);
+double k_sqrt(double);
+void k_vsin(double*, const double*, size_t);
+void k_vcos(double*, const double*, size_t);
+void k_vexp(double*, const double*, size_t);
+void k_vlog(double*, const double*, size_t);
+void k_vsqrt(double*, const double*, size_t);
+void k_vsinf(float*, const float*, size_t);
+void k_vcosf(float*, const float*, size_t);
+void k_vexpf(float*, const float*, size_t);
+void k_vlogf(float*, const float*, size_t);
+void k_vsqrtf(float*, const float*, size_t);
+void k___math_enable_sse2(void);
+
+#define N 4099
+#define ROUNDS 100
+// Every float up to this in magnitude goes through vsinf and vcosf.
+#define EXHAUSTIVE_LIMIT 8192.0f
+#define BATCH 65536
+
+struct vfunction {
+	const char* name;
+	void (*v)(double*, const double*, size_t);
+	double (*scalar)(double);
+	long double (*ref)(long double);
+	double max_ulp;
+	double lo[2];
+	double hi[2];
+};
+
+static const struct vfunction vfunctions[] = {
+	{ "vsin", k_vsin, k_sin, sinl, 2, { -10, -1e6 }, { 10, 1e6 } },
+	{ "vcos", k_vcos, k_cos, cosl, 2, { -10, -1e6 }, { 10, 1e6 } },
+	{ "vexp", k_vexp, k_exp, expl, 2, { -700, -1 }, { 700, 1 } },
+	{ "vlog", k_vlog, k_log, logl, 2, { 0, 0.5 }, { 1e6, 2 } },
+	{ "vsqrt", k_vsqrt, k_sqrt, sqrtl, 0, { 0, 0 }, { 1e6, 1e-300 } },
+};
+
+struct vfunctionf {
+	const char* name;
+	void (*v)(float*, const float*, size_t);
+	double (*ref)(double);
+	double max_ulp;
+	float lo[2];
+	float hi[2];
+};
+
+static const struct vfunctionf vfunctionsf[] = {
+	{ "vsinf", k_vsinf, sin, 2, { -10, -8000 }, { 10, 8000 } },
+	{ "vcosf", k_vcosf, cos, 2, { -10, -8000 }, { 10, 8000 } },
+	{ "vexpf", k_vexpf, exp, 2, { -87, -1 }, { 88, 1 } },
+	{ "vlogf", k_vlogf, log, 2, { 0, 0.5f }, { 1e6f, 2 } },
+	{ "vsqrtf", k_vsqrtf, sqrt, 0, { 0, 0 }, { 1e6f, 1e-30f } },
+};
+
+static const double specials[] = {
+	NAN, INFINITY, -INFINITY, 0.0, -0.0, 1e-310, -1e-310, -5, 1e300, -1e300, 800, -800, 0x1p-1074,
+};
+
+static const float specialsf[] = {
+	NAN, INFINITY, -INFINITY, 0.0f, -0.0f, 1e-40f, -1e-40f, -3, 1e30f, -1e30f, 100, -100, 0x1p-149f,
+};
+
+#define SPECIALS (sizeof(specials) / sizeof(specials[0]))
+
+static double x[N], y[N], z[N];
+static float xf[N], yf[N], zf[N];
+static int failures;
+
+static uint64_t rng_state = 88172645463325252ull;
+
+static uint64_t rng(void) {
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return rng_state;
+}
+
+static double uniform(double lo, double hi) {
+	return lo + (hi - lo) * ((rng() >> 11) * 0x1p-53);
+}
+
+// The error of got in ulps of ref rounded to the precision of got, which
+// has mantissa_bits bits and a smallest subnormal of 2^min_exponent.
+static double ulp_error(long double got, long double ref, int mantissa_bits, int min_exponent) {
+	long double rounded = mantissa_bits == 24 ? (long double) (float) ref : (long double) (double) ref;
+	int exponent;
+
+	if (isnan(got) && isnan(rounded))
+		return 0;
+	if (got == rounded && signbit(got) == signbit(rounded))
+		return 0;
+	if (isinf(got) || isinf(rounded) || isnan(got) || isnan(rounded) || got == rounded)
+		return INFINITY;
+	frexpl(rounded, &exponent);
+	long double ulp = ldexpl(1.0L, exponent - mantissa_bits);
+	if (ulp < ldexpl(1.0L, min_exponent))
+		ulp = ldexpl(1.0L, min_exponent);
+	return (double) (fabsl(got - ref) / ulp);
+}
+
+static double error(double got, long double ref) {
+	return ulp_error(got, ref, 53, -1074);
+}
+
+static double errorf(float got, double ref) {
+	return ulp_error(got, ref, 24, -149);
+}
+
+static void check(const char* name, const char* what, double max, double at, double bound) {
+	if (max > bound) {
+		printf("vmath: %s %s: %.3f ulp at %.17g, bound %g\n", name, what, max, at, bound);
+		failures++;
+	}
+}
+
+static void fill(size_t r, double lo, double hi) {
+	for (size_t i = 0; i < N; i++)
+		x[i] = uniform(lo, hi);
+	// Spread so that each lands in a different lane of its vector.
+	for (size_t i = 0; i < SPECIALS; i++)
+		x[5 + i * 2 + r % 2] = specials[i];
+}
+
+static void fillf(size_t r, float lo, float hi) {
+	for (size_t i = 0; i < N; i++)
+		xf[i] = (float) uniform(lo, hi);
+	for (size_t i = 0; i < SPECIALS; i++)
+		xf[5 + i * 3 + r % 3] = specialsf[i];
+}
+
+static void test_double(const struct vfunction* fn) {
+	double max_ref = 0, max_scalar = 0, at_ref = 0, at_scalar = 0;
+
+	for (size_t r = 0; r < 2; r++) {
+		fill(r, fn->lo[r], fn->hi[r]);
+		fn->v(y, x, N);
+		for (size_t i = 0; i < N; i++) {
+			double e = error(y[i], fn->ref(x[i]));
+			if (e > max_ref) {
+				max_ref = e;
+				at_ref = x[i];
+			}
+			e = error(y[i], fn->scalar(x[i]));
+			if (e > max_scalar) {
+				max_scalar = e;
+				at_scalar = x[i];
+			}
+		}
+	}
+	printf("vmath: %-7s max %.3f ulp, %.3f from the scalar function\n", fn->name, max_ref, max_scalar);
+	check(fn->name, "against the host", max_ref, at_ref, fn->max_ulp);
+	check(fn->name, "against the scalar function", max_scalar, at_scalar, fn->max_ulp);
+
+	// Every short length, for the tails, and in place.
+	for (size_t n = 0; n <= 9; n++) {
+		fill(0, fn->lo[0], fn->hi[0]);
+		y[n] = z[n] = 12345;
+		fn->v(y, x, n);
+		memcpy(z, x, n * sizeof(*z));
+		fn->v(z, z, n);
+		for (size_t i = 0; i < n; i++) {
+			if (memcmp(&y[i], &z[i], sizeof(y[i])) != 0)
+				check(fn->name, "in place", INFINITY, x[i], 0);
+			check(fn->name, "in a short array", error(y[i], fn->ref(x[i])), x[i], fn->max_ulp);
+		}
+		if (y[n] != 12345 || z[n] != 12345)
+			check(fn->name, "past the end of a short array", INFINITY, (double) n, 0);
+	}
+}
+
+static void test_float(const struct vfunctionf* fn) {
+	double max = 0, at = 0;
+
+	for (size_t r = 0; r < 2; r++) {
+		fillf(r, fn->lo[r], fn->hi[r]);
+		fn->v(yf, xf, N);
+		for (size_t i = 0; i < N; i++) {
+			double e = errorf(yf[i], fn->ref(xf[i]));
+			if (e > max) {
+				max = e;
+				at = xf[i];
+			}
+		}
+	}
+	printf("vmath: %-7s max %.3f ulp\n", fn->name, max);
+	check(fn->name, "against the host", max, at, fn->max_ulp);
+
+	for (size_t n = 0; n <= 9; n++) {
+		fillf(0, fn->lo[0], fn->hi[0]);
+		yf[n] = zf[n] = 12345;
+		fn->v(yf, xf, n);
+		memcpy(zf, xf, n * sizeof(*zf));
+		fn->v(zf, zf, n);
+		for (size_t i = 0; i < n; i++) {
+			if (memcmp(&yf[i], &zf[i], sizeof(yf[i])) != 0)
+				check(fn->name, "in place", INFINITY, xf[i], 0);
+			check(fn->name, "in a short array", errorf(yf[i], fn->ref(xf[i])), xf[i], fn->max_ulp);
+		}
+		if (yf[n] != 12345 || zf[n] != 12345)
+			check(fn->name, "past the end of a short array", INFINITY, (double) n, 0);
+	}
+}
+
+// Every positive float up to EXHAUSTIVE_LIMIT; the kernels take the sign
+// off first, so the negative ones only need the zero checked.
+static void test_exhaustive(const struct vfunctionf* fn) {
+	static float in[BATCH], out[BATCH];
+	float limit = EXHAUSTIVE_LIMIT;
+	uint32_t last;
+	double max = 0, at = 0;
+
+	memcpy(&last, &limit, sizeof(last));
+	for (uint64_t base = 0; base <= last; base += BATCH) {
+		size_t n = 0;
+		for (uint64_t bits = base; bits < base + BATCH && bits <= last; bits++) {
+			uint32_t b = (uint32_t) bits;
+			memcpy(&in[n++], &b, sizeof(b));
+		}
+		fn->v(out, in, n);
+		for (size_t i = 0; i < n; i++) {
+			double e = errorf(out[i], fn->ref(in[i]));
+			if (e > max) {
+				max = e;
+				at = in[i];
+			}
+		}
+	}
+
+	in[0] = -0.0f;
+	in[1] = -EXHAUSTIVE_LIMIT;
+	fn->v(out, in, 2);
+	for (size_t i = 0; i < 2; i++)
+		check(fn->name, "for a negative argument", errorf(out[i], fn->ref(in[i])), in[i], fn->max_ulp);
+
+	printf("vmath: %-7s max %.3f ulp over every float up to %g\n", fn->name, max, EXHAUSTIVE_LIMIT);
+	check(fn->name, "exhaustively", max, at, fn->max_ulp);
+}
+
+// Over the first range, without the special values, which the kernels
+// hand to the scalar functions.
+static double cycles_per_element(const struct vfunction* fn) {
+	for (size_t i = 0; i < N; i++)
+		x[i] = uniform(fn->lo[0], fn->hi[0]);
+	uint64_t start = __rdtsc();
+	for (unsigned r = 0; r < ROUNDS; r++)
+		fn->v(y, x, N);
+	return (double) (__rdtsc() - start) / (ROUNDS * N);
+}
+
+static double cycles_per_elementf(const struct vfunctionf* fn) {
+	for (size_t i = 0; i < N; i++)
+		xf[i] = (float) uniform(fn->lo[0], fn->hi[0]);
+	uint64_t start = __rdtsc();
+	for (unsigned r = 0; r < ROUNDS; r++)
+		fn->v(yf, xf, N);
+	return (double) (__rdtsc() - start) / (ROUNDS * N);
+}
+
+int main(void) {
+	static double scalar_cycles[sizeof(vfunctions) / sizeof(vfunctions[0])];
+	static double scalar_cyclesf[sizeof(vfunctionsf) / sizeof(vfunctionsf[0])];
+	const size_t count = sizeof(vfunctions) / sizeof(vfunctions[0]);
+	const size_t countf = sizeof(vfunctionsf) / sizeof(vfunctionsf[0]);
+
+	printf("vmath: scalar loops\n");
+	for (size_t i = 0; i < count; i++) {
+		test_double(&vfunctions[i]);
+		scalar_cycles[i] = cycles_per_element(&vfunctions[i]);
+	}
+	for (size_t i = 0; i < countf; i++) {
+		test_float(&vfunctionsf[i]);
+		scalar_cyclesf[i] = cycles_per_elementf(&vfunctionsf[i]);
+	}
+
+	k___math_enable_sse2();
+	printf("vmath: SSE2 kernels\n");
+	for (size_t i = 0; i < count; i++)
+		test_double(&vfunctions[i]);
+	for (size_t i = 0; i < countf; i++)
+		test_float(&vfunctionsf[i]);
+	test_exhaustive(&vfunctionsf[0]);
+	test_exhaustive(&vfunctionsf[1]);
+
+	printf("vmath: %-20s %10s %10s %8s\n", "cycles per element", "scalar", "sse2", "speedup");
+	for (size_t i = 0; i < count; i++) {
+		double sse2 = cycles_per_element(&vfunctions[i]);
+		printf("vmath: %-20s %10.1f %10.1f %7.1fx\n", vfunctions[i].name, scalar_cycles[i], sse2,
+		       scalar_cycles[i] / sse2);
+	}
+	for (size_t i = 0; i < countf; i++) {
+		double sse2 = cycles_per_elementf(&vfunctionsf[i]);
+		printf("vmath: %-20s %10.1f %10.1f %7.1fx\n", vfunctionsf[i].name, scalar_cyclesf[i], sse2,
+		       scalar_cyclesf[i] / sse2);
+	}
+
+	if (failures) {
+		printf("vmath: %d failures\n", failures);
+		return 1;
+	}
+	return 0;
+}